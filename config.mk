@@ -6,8 +6,11 @@ curl ?= 1
 debug ?= 0
 exif ?= 0
 help ?= 0
+jpeg ?= 0
 magic ?= 0
+memfd ?= 0
 mkstemps ?= 1
+pthread ?= 1
 verscmp ?= 1
 xinerama ?= 1
 
@@ -65,10 +68,27 @@ ifeq (${stat64},1)
 	CFLAGS += -D_FILE_OFFSET_BITS=64
 endif
 
+ifeq (${jpeg},1)
+	CFLAGS += -DHAVE_LIBJPEG
+	LDLIBS += -ljpeg
+	MAN_JPEG = enabled
+else
+	MAN_JPEG = disabled
+endif
+
+ifeq (${memfd},1)
+	CFLAGS += -DHAVE_MEMFD_CREATE
+endif
+
 ifeq (${mkstemps},1)
 	CFLAGS += -DHAVE_MKSTEMPS
 endif
 
+ifeq (${pthread},1)
+	CFLAGS += -DHAVE_PTHREAD -pthread
+	LDLIBS += -pthread
+endif
+
 ifeq (${magic},1)
 	CFLAGS += -DHAVE_LIBMAGIC
 	LDLIBS += -lmagic
@@ -0,0 +1,101 @@
+/* arena.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "arena.h"
+
+struct __feh_arena_block {
+	feh_arena_block *next;
+	size_t size;
+};
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+/* data starts after the block header, aligned like malloc'ed memory */
+#define ARENA_DATA(b) ((char *) (b) + ARENA_ROUND(sizeof(feh_arena_block)))
+
+static void *feh_arena_take(feh_arena * arena, size_t size, size_t align)
+{
+	feh_arena_block *block;
+	size_t offset = (arena->used + align - 1) & ~(align - 1);
+
+	if (arena->head && (offset + size <= arena->head->size)) {
+		arena->used = offset + size;
+		return(ARENA_DATA(arena->head) + offset);
+	}
+
+	/*
+	 * Large allocations get a block of their own behind the current one,
+	 * so its free space is not wasted.
+	 */
+	if (arena->head && (size > ARENA_BLOCK_SIZE / 4)) {
+		block = emalloc(ARENA_ROUND(sizeof(feh_arena_block)) + size);
+		block->size = size;
+		arena->size += size;
+		block->next = arena->head->next;
+		arena->head->next = block;
+		return(ARENA_DATA(block));
+	}
+
+	block = emalloc(ARENA_ROUND(sizeof(feh_arena_block))
+			+ (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE));
+	block->size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+	arena->size += block->size;
+	block->next = arena->head;
+	arena->head = block;
+	arena->used = size;
+	return(ARENA_DATA(block));
+}
+
+void *feh_arena_alloc(feh_arena * arena, size_t size)
+{
+	return(feh_arena_take(arena, size, ARENA_ALIGN));
+}
+
+/*
+ * Copies the len bytes at s, which need not be NUL-terminated, into arena.
+ */
+char *feh_arena_strndup(feh_arena * arena, const char *s, size_t len)
+{
+	char *ret = feh_arena_take(arena, len + 1, 1);
+
+	memcpy(ret, s, len);
+	ret[len] = '\0';
+	return(ret);
+}
+
+void feh_arena_free(feh_arena * arena)
+{
+	feh_arena_block *block;
+
+	while ((block = arena->head)) {
+		arena->head = block->next;
+		free(block);
+	}
+	arena->used = 0;
+	arena->size = 0;
+}
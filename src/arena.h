@@ -0,0 +1,46 @@
+/* arena.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+typedef struct __feh_arena feh_arena;
+typedef struct __feh_arena_block feh_arena_block;
+
+/*
+ * Bump allocator for data which is released all at once, like the paths
+ * of a filelist. Zero-initialized storage is an empty arena.
+ */
+struct __feh_arena {
+	feh_arena_block *head;	/* block allocations are taken from */
+	size_t used;		/* bytes taken from head */
+	size_t size;		/* bytes in all blocks */
+};
+
+void *feh_arena_alloc(feh_arena * arena, size_t size);
+char *feh_arena_strndup(feh_arena * arena, const char *s, size_t len);
+void feh_arena_free(feh_arena * arena);
+
+#endif
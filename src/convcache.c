@@ -0,0 +1,223 @@
+/* convcache.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <fcntl.h>
+
+#include "feh.h"
+#include "options.h"
+#include "md5.h"
+#include "convcache.h"
+
+typedef struct {
+	char *name;
+	off_t size;
+	time_t mtime;
+} feh_convcache_file;
+
+static char *cache_dir = NULL;
+static int cache_dir_failed = 0;
+
+/* bytes used by the cache directory, -1 if not yet known */
+static off_t cache_bytes = -1;
+
+#define CONVCACHE_BUDGET ((off_t) opt.conversion_cache_size * 1024 * 1024)
+
+/* temporary files of conversions which were interrupted for good */
+#define CONVCACHE_STALE_TMP 3600
+
+static char *feh_convcache_dir(void)
+{
+	if (!cache_dir && !cache_dir_failed)
+		if (!(cache_dir = feh_cache_dir("conversions")))
+			cache_dir_failed = 1;
+	return cache_dir;
+}
+
+static int feh_convcache_cmp(const void *a, const void *b)
+{
+	const feh_convcache_file *fa = a, *fb = b;
+
+	if (fa->mtime != fb->mtime)
+		return (fa->mtime < fb->mtime) ? -1 : 1;
+	return strcmp(fa->name, fb->name);
+}
+
+/*
+ * Determines the size of the cache directory and removes the least recently
+ * used entries other than keep until it fits into the budget again.
+ */
+static void feh_convcache_evict(char *keep)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	feh_convcache_file *files = NULL;
+	size_t num_files = 0, max_files = 0, i;
+	time_t now = time(NULL);
+	char *path;
+
+	if (!(dir = opendir(cache_dir)))
+		return;
+
+	cache_bytes = 0;
+	while ((de = readdir(dir)) != NULL) {
+		if ((de->d_name[0] == '.') || fstatat(dirfd(dir), de->d_name, &st, 0)
+				|| !S_ISREG(st.st_mode))
+			continue;
+		/* temporary files are named <entry>.XXXXXX */
+		if (strchr(de->d_name, '.')) {
+			if (now - st.st_mtime > CONVCACHE_STALE_TMP)
+				unlinkat(dirfd(dir), de->d_name, 0);
+			continue;
+		}
+		if (num_files == max_files) {
+			max_files = max_files ? max_files * 2 : 64;
+			files = erealloc(files, max_files * sizeof(feh_convcache_file));
+		}
+		files[num_files].name = estrdup(de->d_name);
+		files[num_files].size = st.st_size;
+		files[num_files].mtime = st.st_mtime;
+		cache_bytes += st.st_size;
+		num_files++;
+	}
+	closedir(dir);
+
+	qsort(files, num_files, sizeof(feh_convcache_file), feh_convcache_cmp);
+
+	for (i = 0; i < num_files; i++) {
+		if ((cache_bytes > CONVCACHE_BUDGET) && strcmp(files[i].name, keep)) {
+			path = estrjoin("/", cache_dir, files[i].name, NULL);
+			D(("evicting %s\n", path));
+			if (!unlink(path))
+				cache_bytes -= files[i].size;
+			free(path);
+		}
+		free(files[i].name);
+	}
+	free(files);
+}
+
+/*
+ * Returns the cache entry for the conversion of filename, which may or may
+ * not exist yet. Returns NULL if the cache is disabled or cannot
+ * be used for filename. free the result please.
+ */
+char *feh_convcache_entry(char *filename)
+{
+	struct stat st;
+	char *path, *key, *entry;
+	char stamp[64];
+	md5_state_t pms;
+	md5_byte_t digest[16];
+	char hex[33];
+	int i;
+
+	if (!opt.conversion_cache_size || stat(filename, &st)
+			|| !feh_convcache_dir())
+		return NULL;
+
+	if (!(path = realpath(filename, NULL)))
+		path = estrdup(filename);
+
+	snprintf(stamp, sizeof(stamp), "%lld %lld.%09ld", (long long) st.st_size,
+			(long long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+	key = estrjoin("\n", path, stamp, NULL);
+
+	md5_init(&pms);
+	md5_append(&pms, (unsigned char *) key, strlen(key));
+	md5_finish(&pms, digest);
+	for (i = 0; i < 16; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+
+	entry = estrjoin("/", cache_dir, hex, NULL);
+
+	free(key);
+	free(path);
+	return entry;
+}
+
+/*
+ * Returns 1 and marks entry as recently used if it exists.
+ */
+int feh_convcache_lookup(char *entry)
+{
+	if (utimensat(AT_FDCWD, entry, NULL, 0) == -1)
+		return 0;
+
+	D(("%s: cache hit\n", entry));
+	return 1;
+}
+
+/*
+ * Creates a temporary file next to entry for a converter to write to. It
+ * becomes entry once feh_convcache_store is called. Returns the file
+ * descriptor, or -1 on failure.
+ */
+int feh_convcache_mkstemp(char *entry, char **tmpname)
+{
+	int fd;
+
+	*tmpname = estrjoin(".", entry, "XXXXXX", NULL);
+	if ((fd = mkstemp(*tmpname)) == -1) {
+		free(*tmpname);
+		*tmpname = NULL;
+	}
+	return fd;
+}
+
+/*
+ * Moves a finished conversion from tmpname (see feh_convcache_mkstemp) into
+ * the cache. Returns 0 on failure, in which case tmpname is left alone.
+ */
+int feh_convcache_store(char *entry, char *tmpname)
+{
+	struct stat st;
+
+	if (stat(tmpname, &st) || !st.st_size || (st.st_size > CONVCACHE_BUDGET)
+			|| rename(tmpname, entry))
+		return 0;
+
+	if (cache_bytes >= 0)
+		cache_bytes += st.st_size;
+	if ((cache_bytes < 0) || (cache_bytes > CONVCACHE_BUDGET))
+		feh_convcache_evict(strrchr(entry, '/') + 1);
+	return 1;
+}
+
+/*
+ * Returns 1 if path is a cache entry, which must outlive this feh process.
+ * Temporary files which did not make it into the cache are not.
+ */
+int feh_convcache_owns(char *path)
+{
+	size_t len;
+
+	if (!cache_dir)
+		return 0;
+
+	len = strlen(cache_dir);
+	return !strncmp(path, cache_dir, len) && (path[len] == '/')
+		&& !strchr(path + len + 1, '.');
+}
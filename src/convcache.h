@@ -0,0 +1,44 @@
+/* convcache.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CONVCACHE_H
+#define CONVCACHE_H
+
+/*
+ * Images converted by dcraw or ImageMagick are kept in
+ * $XDG_CACHE_HOME/feh/conversions so that later feh invocations do not have
+ * to convert them again. Entries are named after the MD5 sum of path, size
+ * and mtime of the original file. Their own mtime is bumped on every hit,
+ * and the least recently used ones are removed once the directory grows
+ * beyond --conversion-cache-size.
+ */
+
+char *feh_convcache_entry(char *filename);
+int feh_convcache_lookup(char *entry);
+int feh_convcache_mkstemp(char *entry, char **tmpname);
+int feh_convcache_store(char *entry, char *tmpname);
+int feh_convcache_owns(char *path);
+
+#endif
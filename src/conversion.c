@@ -0,0 +1,594 @@
+/* conversion.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "signals.h"
+#include "winwidget.h"
+#include "convcache.h"
+#include "conversion.h"
+
+#include <fcntl.h>
+
+extern char **environ;
+
+enum conversion_state { CONVERSION_RUNNING, CONVERSION_DONE, CONVERSION_FAILED };
+
+/* messages sent by the supervisor process */
+#define CONVERSION_MSG_DCRAW   'd'
+#define CONVERSION_MSG_MAGICK  'm'
+#define CONVERSION_MSG_TIMEOUT 't'
+
+typedef struct {
+	feh_file *file;
+	/* converted image, and where it goes in the persistent cache */
+	char *sfn;
+	char *entry;
+	char *argv_fn;
+	char tempdir[32];
+	pid_t pid;
+	int fd;
+	unsigned char raw;
+	unsigned char timed_out;
+	unsigned char killed;
+	enum conversion_state state;
+} feh_conversion;
+
+static gib_list *jobs = NULL;
+
+static volatile sig_atomic_t supervisor_alarm = 0;
+
+/* where dcraw and convert are found in $PATH, see feh_conversion_which */
+static char *dcraw_path = NULL;
+static char *convert_path = NULL;
+
+static feh_conversion *feh_conversion_find(feh_file * file)
+{
+	gib_list *l;
+
+	for (l = jobs; l; l = l->next)
+		if (((feh_conversion *) l->data)->file == file)
+			return(l->data);
+	return(NULL);
+}
+
+/*
+ * Returns the path of the first executable called name in $PATH, or name
+ * itself if there is none, for execve in the forked children. execlp may
+ * allocate memory, which is not safe in a child of a process whose scan
+ * threads are still running.
+ */
+static char *feh_conversion_which(char *name)
+{
+	char *path, *dir, *end, *candidate;
+	int len;
+
+	if (!(path = getenv("PATH")))
+		path = "/usr/local/bin:/usr/bin:/bin";
+	for (dir = path; ; dir = end + 1) {
+		if (!(end = strchr(dir, ':')))
+			end = dir + strlen(dir);
+		/* an empty entry stands for the current directory */
+		len = (end == dir) ? 1 : (int) (end - dir);
+		candidate = emalloc(len + strlen(name) + 2);
+		sprintf(candidate, "%.*s/%s", len, (end == dir) ? "." : dir, name);
+		if (!access(candidate, X_OK))
+			return(candidate);
+		free(candidate);
+		if (!*end)
+			break;
+	}
+	return(estrdup(name));
+}
+
+/* runs in the supervisor, see feh_conversion_supervise */
+static int feh_file_is_raw(char *filename)
+{
+	char *argv[] = { "dcraw", "-i", filename, NULL };
+	pid_t pid;
+	int status;
+
+	if ((pid = fork()) == -1)
+		return 0;
+
+	if (pid == 0) {
+		int devnull = open("/dev/null", O_WRONLY);
+		dup2(devnull, 1);
+		dup2(devnull, 2);
+		execve(dcraw_path, argv, environ);
+		_exit(1);
+	}
+
+	do {
+		if (waitpid(pid, &status, WUNTRACED) == -1)
+			return 0;
+		if (WIFEXITED(status))
+			return !WEXITSTATUS(status);
+	} while (!WIFSIGNALED(status));
+
+	return 0;
+}
+
+static void feh_conversion_handle_alarm(int signo)
+{
+	(void) signo;
+	supervisor_alarm = 1;
+}
+
+/*
+ * Runs in the forked child, which is the leader of a new process group.
+ * Like the prefetch workers, it must never return. The scan threads may
+ * still run in the parent, so this only uses async-signal-safe calls;
+ * convert gets the environment envp, which is prepared before the fork.
+ */
+static void feh_conversion_supervise(feh_conversion * job, int fd, int msgfd,
+		char **envp)
+{
+	struct sigaction sa;
+	char *filename = job->file->filename;
+	char *dcraw_argv[] = { "dcraw", "-c", "-e", filename, NULL };
+	char *convert_argv[] = { "convert", filename, job->argv_fn, NULL };
+	char msg;
+	int status, devnull;
+	pid_t pid;
+
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGUSR1, SIG_DFL);
+	signal(SIGUSR2, SIG_DFL);
+	/* we send SIGINT to our own process group on timeouts */
+	signal(SIGINT, SIG_IGN);
+
+	msg = feh_file_is_raw(filename) ? CONVERSION_MSG_DCRAW : CONVERSION_MSG_MAGICK;
+	if (write(msgfd, &msg, 1) != 1)
+		_exit(1);
+
+	if ((pid = fork()) < 0)
+		_exit(1);
+	else if (pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGALRM, SIG_DFL);
+
+		if (msg == CONVERSION_MSG_DCRAW) {
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+			execve(dcraw_path, dcraw_argv, environ);
+			_exit(1);
+		}
+
+		close(fd);
+		devnull = open("/dev/null", O_WRONLY);
+		dup2(devnull, 0);
+		if (opt.quiet) {
+			/* discard convert output */
+			dup2(devnull, 1);
+			dup2(devnull, 2);
+		}
+		execve(convert_path, convert_argv, envp);
+		_exit(1);
+	}
+	close(fd);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = feh_conversion_handle_alarm;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	if (opt.conversion_timeout > 0)
+		alarm(opt.conversion_timeout);
+
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR)
+			_exit(1);
+		if (!supervisor_alarm)
+			continue;
+		/*
+		 * convert only accepts SIGINT via killpg. Whatever survives that
+		 * for another second gets SIGKILL.
+		 */
+		if (msg != CONVERSION_MSG_TIMEOUT) {
+			msg = CONVERSION_MSG_TIMEOUT;
+			if (write(msgfd, &msg, 1) != 1)
+				_exit(1);
+			killpg(0, SIGINT);
+		} else
+			kill(pid, SIGKILL);
+		supervisor_alarm = 0;
+		alarm(1);
+	}
+
+	_exit((WIFEXITED(status) && !WEXITSTATUS(status)) ? 0 : 1);
+}
+
+/* Note: like feh_unique_filename, this leaves the file in /tmp */
+static int feh_conversion_mkstemp(char *filename, char **sfn)
+{
+	char *basename, *tmpname;
+	int fd;
+
+	basename = strrchr(filename, '/');
+
+	if (basename == NULL)
+		basename = filename;
+	else
+		basename++;
+
+	tmpname = feh_unique_filename("/tmp/", basename);
+
+	if (strlen(tmpname) > (NAME_MAX-6))
+		tmpname[NAME_MAX-7] = '\0';
+
+	*sfn = estrjoin("_", tmpname, "XXXXXX", NULL);
+	free(tmpname);
+
+	if ((fd = mkstemp(*sfn)) == -1) {
+		free(*sfn);
+		*sfn = NULL;
+	}
+	return fd;
+}
+
+/*
+ * By default, ImageMagick saves (occasionally lots of) temporary files in
+ * /tmp. It doesn't remove them if it runs into a timeout and is killed by
+ * us, no matter whether we use SIGINT, SIGTERM or SIGKILL. So, unless
+ * MAGICK_TMPDIR has already been set by the user, each job gets its own
+ * temporary directory for ImageMagick whose contents are removed once the
+ * job is over.
+ */
+static void feh_conversion_remove_tempdir(feh_conversion * job)
+{
+	DIR *dir;
+	struct dirent *de;
+	char *temporary_file_name;
+
+	if (!job->tempdir[0])
+		return;
+
+	if ((dir = opendir(job->tempdir)) == NULL) {
+		weprintf("%s: Cannot remove temporary ImageMagick files from %s:",
+				job->file->filename, job->tempdir);
+	} else {
+		while ((de = readdir(dir)) != NULL) {
+			if (de->d_name[0] != '.') {
+				temporary_file_name = estrjoin("/", job->tempdir, de->d_name, NULL);
+				/*
+				 * We assume that ImageMagick only creates temporary files and
+				 * not directories.
+				 */
+				if (unlink(temporary_file_name) == -1) {
+					weprintf("unlink %s:", temporary_file_name);
+				}
+				free(temporary_file_name);
+			}
+		}
+		closedir(dir);
+		if (rmdir(job->tempdir) == -1) {
+			weprintf("rmdir %s:", job->tempdir);
+		}
+	}
+	job->tempdir[0] = '\0';
+}
+
+/*
+ * Starts converting file in the background, unless that is already under
+ * way or done. Returns 0 if the job could not be started.
+ */
+int feh_conversion_start(feh_file * file)
+{
+	feh_conversion *job;
+	char **envp = environ;
+	int pipefd[2];
+	int fd = -1, i;
+	pid_t pid;
+
+	if (feh_conversion_find(file))
+		return(1);
+
+	job = emalloc(sizeof(feh_conversion));
+	memset(job, 0, sizeof(feh_conversion));
+	job->file = file;
+	job->fd = -1;
+
+	if ((job->entry = feh_convcache_entry(file->filename)) != NULL) {
+		if (feh_convcache_lookup(job->entry)) {
+			job->sfn = job->entry;
+			job->entry = NULL;
+			job->state = CONVERSION_DONE;
+			jobs = gib_list_add_front(jobs, job);
+			return(1);
+		}
+		if ((fd = feh_convcache_mkstemp(job->entry, &job->sfn)) == -1) {
+			free(job->entry);
+			job->entry = NULL;
+		}
+	}
+
+	if ((fd == -1) && ((fd = feh_conversion_mkstemp(file->filename, &job->sfn)) == -1)) {
+		free(job);
+		return(0);
+	}
+
+	/*
+	 * We could use png:fd:(whatever mkstemp returned) as target filename
+	 * for convert, but this seems to be broken in some ImageMagick versions.
+	 * So we resort to png:(sfn) instead.
+	 */
+	job->argv_fn = estrjoin(":", "png", job->sfn, NULL);
+
+	if (getenv("MAGICK_TMPDIR") == NULL) {
+		strcpy(job->tempdir, "/tmp/.feh-magick-tmp-XXXXXX");
+		if (mkdtemp(job->tempdir) == NULL) {
+			weprintf("%s: ImageMagick may leave temporary files in /tmp. mkdtemp failed:", file->filename);
+			job->tempdir[0] = '\0';
+		} else {
+			for (i = 0; environ[i]; i++);
+			envp = emalloc((i + 2) * sizeof(char *));
+			envp[0] = estrjoin("=", "MAGICK_TMPDIR", job->tempdir, NULL);
+			memcpy(envp + 1, environ, (i + 1) * sizeof(char *));
+		}
+	}
+
+	if (!dcraw_path) {
+		dcraw_path = feh_conversion_which("dcraw");
+		convert_path = feh_conversion_which("convert");
+	}
+
+	if (pipe(pipefd) == -1) {
+		weprintf("%s: Can't convert. pipe failed:", file->filename);
+		pid = -1;
+	} else if ((pid = fork()) < 0) {
+		weprintf("%s: Can't convert. Fork failed:", file->filename);
+		close(pipefd[0]);
+		close(pipefd[1]);
+	} else if (pid == 0) {
+		setpgid(0, 0);
+		close(pipefd[0]);
+		feh_conversion_supervise(job, fd, pipefd[1], envp);
+	}
+
+	close(fd);
+	if (envp != environ) {
+		free(envp[0]);
+		free(envp);
+	}
+
+	if (pid < 0) {
+		unlink(job->sfn);
+		feh_conversion_remove_tempdir(job);
+		free(job->sfn);
+		free(job->entry);
+		free(job->argv_fn);
+		free(job);
+		return(0);
+	}
+
+	/* the child does this as well, whoever comes first avoids a race */
+	setpgid(pid, pid);
+
+	close(pipefd[1]);
+	fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+
+	D(("started conversion %d for %s\n", pid, file->filename));
+
+	job->pid = pid;
+	job->fd = pipefd[0];
+	job->state = CONVERSION_RUNNING;
+	jobs = gib_list_add_front(jobs, job);
+	return(1);
+}
+
+static void feh_conversion_finish(feh_conversion * job)
+{
+	int status = 0;
+
+	close(job->fd);
+	job->fd = -1;
+	waitpid(job->pid, &status, 0);
+	job->pid = 0;
+
+	feh_conversion_remove_tempdir(job);
+
+	if (job->timed_out || !WIFEXITED(status)) {
+		if (job->timed_out && !opt.quiet)
+			weprintf("%s: Conversion took too long, skipping", job->file->filename);
+		unlink(job->sfn);
+		free(job->sfn);
+		job->sfn = NULL;
+		job->state = CONVERSION_FAILED;
+	} else {
+		/* only results of successful conversions are kept for later */
+		if (job->entry && !WEXITSTATUS(status)
+				&& feh_convcache_store(job->entry, job->sfn)) {
+			free(job->sfn);
+			job->sfn = job->entry;
+			job->entry = NULL;
+		}
+		job->state = CONVERSION_DONE;
+	}
+
+	free(job->entry);
+	job->entry = NULL;
+
+	D(("%s: %s\n", job->file->filename,
+		job->state == CONVERSION_DONE ? "converted" : "conversion failed"));
+}
+
+static void feh_conversion_read(feh_conversion * job)
+{
+	ssize_t ret;
+	char msg;
+
+	while (job->state == CONVERSION_RUNNING) {
+		ret = read(job->fd, &msg, 1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return;
+		}
+		if (ret <= 0)
+			feh_conversion_finish(job);
+		else if (msg == CONVERSION_MSG_TIMEOUT)
+			job->timed_out = 1;
+		else
+			job->raw = (msg == CONVERSION_MSG_DCRAW);
+	}
+}
+
+static void feh_conversion_kill(feh_conversion * job)
+{
+	if ((job->state != CONVERSION_RUNNING) || job->killed)
+		return;
+	killpg(job->pid, SIGKILL);
+	kill(job->pid, SIGKILL);
+	job->killed = 1;
+}
+
+static void feh_conversion_wait(feh_conversion * job)
+{
+	fd_set fdset;
+
+	while (job->state == CONVERSION_RUNNING) {
+		/* the user wants to quit feh */
+		if (sig_exit)
+			feh_conversion_kill(job);
+		FD_ZERO(&fdset);
+		FD_SET(job->fd, &fdset);
+		if (select(job->fd + 1, &fdset, NULL, NULL, NULL) > 0)
+			feh_conversion_read(job);
+	}
+}
+
+static void feh_conversion_drop(feh_conversion * job)
+{
+	gib_list *l;
+
+	if (job->state == CONVERSION_RUNNING) {
+		feh_conversion_kill(job);
+		feh_conversion_wait(job);
+	}
+	if (job->sfn) {
+		if (!feh_convcache_owns(job->sfn))
+			unlink(job->sfn);
+		free(job->sfn);
+	}
+	free(job->entry);
+	free(job->argv_fn);
+
+	if ((l = gib_list_find_by_data(jobs, job)))
+		jobs = gib_list_remove(jobs, l);
+	free(job);
+}
+
+/*
+ * Returns 1 unless a finished conversion of file is waiting to be taken.
+ */
+int feh_conversion_pending(feh_file * file)
+{
+	feh_conversion *job = feh_conversion_find(file);
+
+	return(!job || (job->state == CONVERSION_RUNNING));
+}
+
+/*
+ * Waits for the conversion of file, starting it first if necessary, and
+ * returns the name of the converted image, which now belongs to the caller.
+ * raw is set if dcraw was used. Returns NULL if the conversion failed.
+ */
+char *feh_conversion_take(feh_file * file, int *raw)
+{
+	feh_conversion *job;
+	char *sfn;
+
+	*raw = 0;
+	if (!feh_conversion_start(file) || !(job = feh_conversion_find(file)))
+		return(NULL);
+
+	feh_conversion_wait(job);
+
+	*raw = job->raw;
+	sfn = job->sfn;
+	job->sfn = NULL;
+	feh_conversion_drop(job);
+	return(sfn);
+}
+
+void feh_conversion_cancel(feh_file * file)
+{
+	feh_conversion *job;
+
+	if ((job = feh_conversion_find(file))) {
+		D(("cancelling conversion of %s\n", file->filename));
+		feh_conversion_drop(job);
+	}
+}
+
+void feh_conversion_cancel_all(void)
+{
+	while (jobs)
+		feh_conversion_drop(jobs->data);
+}
+
+void feh_conversion_fdset(fd_set * fdset, int *fdsize)
+{
+	gib_list *l;
+	feh_conversion *job;
+
+	for (l = jobs; l; l = l->next) {
+		job = l->data;
+		if (job->state != CONVERSION_RUNNING)
+			continue;
+		FD_SET(job->fd, fdset);
+		if (job->fd >= *fdsize)
+			*fdsize = job->fd + 1;
+	}
+}
+
+/*
+ * Collects finished jobs and replaces the placeholders of slideshow windows
+ * whose conversion is over.
+ */
+void feh_conversion_handle_fdset(fd_set * fdset)
+{
+	gib_list *l;
+	feh_conversion *job;
+	int i;
+
+	for (l = jobs; l; l = l->next) {
+		job = l->data;
+		if ((job->state == CONVERSION_RUNNING) && FD_ISSET(job->fd, fdset))
+			feh_conversion_read(job);
+	}
+
+	for (i = 0; i < window_num; i++) {
+		if (windows[i]->converting && (job = feh_conversion_find(
+						FEH_FILE(windows[i]->file->data)))
+				&& (job->state != CONVERSION_RUNNING))
+			slideshow_loaded(windows[i]);
+	}
+}
@@ -0,0 +1,44 @@
+/* conversion.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+/*
+ * Files which Imlib2 cannot load are converted by dcraw or ImageMagick in
+ * background jobs. Each job is a forked supervisor process which picks the
+ * converter, runs it and enforces --conversion-timeout. It reports through
+ * a pipe whose EOF tells the main loop that the job is over.
+ */
+
+int feh_conversion_start(feh_file * file);
+int feh_conversion_pending(feh_file * file);
+char *feh_conversion_take(feh_file * file, int *raw);
+void feh_conversion_cancel(feh_file * file);
+void feh_conversion_cancel_all(void);
+void feh_conversion_fdset(fd_set * fdset, int *fdsize);
+void feh_conversion_handle_fdset(fd_set * fdset);
+
+#endif
@@ -28,10 +28,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define FEH_H
 
 /*
- * strverscmp(3) is a GNU extension. In most supporting C libraries it
- * requires _GNU_SOURCE to be defined.
+ * strverscmp(3) and memfd_create(2) are GNU extensions. In most supporting
+ * C libraries they require _GNU_SOURCE to be defined.
  */
-#ifdef HAVE_STRVERSCMP
+#if defined(HAVE_STRVERSCMP) || defined(HAVE_MEMFD_CREATE)
 #define _GNU_SOURCE
 #endif
 
@@ -92,6 +92,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define XY_IN_RECT(x, y, rx, ry, rw, rh) \
 (((x) >= (rx)) && ((y) >= (ry)) && ((x) < ((rx) + (rw))) && ((y) < ((ry) + (rh))))
 
+#define RECT_INTERSECT(ax, ay, aw, ah, bx, by, bw, bh) \
+(((ax) < ((bx) + (bw))) && ((bx) < ((ax) + (aw))) && ((ay) < ((by) + (bh))) && ((by) < ((ay) + (ah))))
+
 #define DEFAULT_FONT "yudit/11"
 #define DEFAULT_MENU_FONT "yudit/10"
 #define DEFAULT_FONT_BIG "yudit/12"
@@ -152,8 +155,19 @@ void init_magic(void);
 void feh_clean_exit(void);
 int feh_should_ignore_image(Imlib_Image * im);
 int feh_load_image(Imlib_Image * im, feh_file * file);
+int feh_load_image_nowait(Imlib_Image * im, feh_file * file, int start);
+Imlib_Image feh_load_placeholder(feh_file * file, int w, int h);
+int feh_load_image_at_least(Imlib_Image * im, feh_file * file, int min_w,
+		int min_h, int *orig_w, int *orig_h);
+int feh_load_image_partial(Imlib_Image * im, feh_file * file, int min_w,
+		int min_h);
+int feh_load_image_thumbnail(Imlib_Image * im, feh_file * file, int box_w,
+		int box_h, int *orig_w, int *orig_h);
+void feh_image_apply_orientation(Imlib_Image im, int orientation);
 void show_mini_usage(void);
 void slideshow_change_image(winwidget winwid, int change, int render);
+void slideshow_loaded(winwidget winwid);
+void slideshow_preview(winwidget winwid);
 void slideshow_pause_toggle(winwidget w);
 void init_keyevents(void);
 void init_buttonbindings(void);
@@ -221,9 +235,7 @@ extern unsigned char reset_output;
 extern feh_menu *menu_main;
 extern feh_menu *menu_close;
 extern char *mode;		/* label for the current mode */
-
-/* to terminate long-running children with SIGALRM */
-extern int childpid;
+extern gib_hash *conversion_cache;	/* converted / downloaded files by name */
 
 extern unsigned char control_via_stdin;
 
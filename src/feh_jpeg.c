@@ -0,0 +1,314 @@
+/* feh_jpeg.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "feh_jpeg.h"
+
+struct feh_jpeg_error_mgr {
+	struct jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
+
+static void feh_jpeg_error_exit(j_common_ptr cinfo)
+{
+	struct feh_jpeg_error_mgr *err = (struct feh_jpeg_error_mgr *) cinfo->err;
+	longjmp(err->setjmp_buffer, 1);
+}
+
+static void feh_jpeg_output_message(j_common_ptr cinfo)
+{
+	/* Imlib2 will complain (or not) once we fall back to it */
+	(void) cinfo;
+}
+
+static int feh_jpeg_file_is_jpeg(FILE * fp)
+{
+	unsigned char buf[3];
+
+	if (fread(buf, 1, 3, fp) != 3)
+		return 0;
+
+	return (buf[0] == 0xff) && (buf[1] == 0xd8) && (buf[2] == 0xff);
+}
+
+/*
+ * Returns the orientation tag from the EXIF APP1 marker saved by libjpeg, or
+ * 0 if there is none.
+ */
+static int feh_jpeg_exif_orientation(j_decompress_ptr cinfo)
+{
+	jpeg_saved_marker_ptr marker;
+
+	for (marker = cinfo->marker_list; marker; marker = marker->next)
+		if ((marker->marker == JPEG_APP0 + 1) && (marker->data_length >= 14)
+				&& !memcmp(marker->data, "Exif\0\0", 6))
+			return feh_exif_ifd0_orientation(marker->data,
+					marker->data_length);
+	return 0;
+}
+
+/*
+ * Reads a JPEG from fp or, if fp is NULL, from the len bytes at buf and
+ * decodes it using libjpeg's DCT scaling with the largest reduction (1/2,
+ * 1/4 or 1/8) which still yields at least min_w x min_h pixels; 0 x 0
+ * requests a full-size decode. If need_scaling is set and no reduction is
+ * possible, NULL is returned instead of a full-size decode. orig_w and orig_h
+ * are set to the full image size.
+ *
+ * If orient is set, the image is rotated according to its EXIF orientation
+ * and min_w, min_h, orig_w and orig_h all refer to the rotated image.
+ */
+static Imlib_Image feh_jpeg_decode(FILE * fp, const unsigned char *buf,
+		unsigned long len, int min_w, int min_h, int need_scaling, int orient,
+		int *orig_w, int *orig_h)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct feh_jpeg_error_mgr jerr;
+	Imlib_Image volatile im = NULL;
+	JSAMPROW volatile row = NULL;
+	DATA32 *data, *dst;
+	JSAMPLE *src;
+	unsigned int denom, x, y;
+	unsigned int r, g, b, k;
+	int orientation = 0, tmp;
+
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = feh_jpeg_error_exit;
+	jerr.pub.output_message = feh_jpeg_output_message;
+
+	if (setjmp(jerr.setjmp_buffer)) {
+		if (im) {
+			imlib_context_set_image(im);
+			imlib_free_image_and_decache();
+		}
+		free(row);
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	if (fp)
+		jpeg_stdio_src(&cinfo, fp);
+	else
+		jpeg_mem_src(&cinfo, (unsigned char *) buf, len);
+	if (orient)
+		jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xffff);
+	jpeg_read_header(&cinfo, TRUE);
+
+	if (orient)
+		orientation = feh_jpeg_exif_orientation(&cinfo);
+
+	/* orientations 5 to 8 swap width and height */
+	if (orientation >= 5) {
+		tmp = min_w;
+		min_w = min_h;
+		min_h = tmp;
+		*orig_w = cinfo.image_height;
+		*orig_h = cinfo.image_width;
+	} else {
+		*orig_w = cinfo.image_width;
+		*orig_h = cinfo.image_height;
+	}
+
+	denom = 1;
+	if ((min_w > 0) && (min_h > 0))
+		for (denom = 8; denom > 1; denom /= 2)
+			if (((cinfo.image_width + denom - 1) / denom >= (unsigned int) min_w)
+					&& ((cinfo.image_height + denom - 1) / denom >= (unsigned int) min_h))
+				break;
+
+	if (need_scaling && (denom == 1)) {
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+
+	D(("decoding %dx%d at 1/%d\n", *orig_w, *orig_h, denom));
+
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom;
+
+	if ((cinfo.jpeg_color_space == JCS_CMYK) || (cinfo.jpeg_color_space == JCS_YCCK))
+		cinfo.out_color_space = JCS_CMYK;
+	else if (cinfo.jpeg_color_space == JCS_GRAYSCALE)
+		cinfo.out_color_space = JCS_GRAYSCALE;
+	else
+		cinfo.out_color_space = JCS_RGB;
+
+	jpeg_start_decompress(&cinfo);
+
+	row = emalloc(cinfo.output_width * cinfo.output_components);
+	if (!(im = imlib_create_image(cinfo.output_width, cinfo.output_height)))
+		longjmp(jerr.setjmp_buffer, 1);
+
+	imlib_context_set_image(im);
+	imlib_image_set_has_alpha(0);
+	data = imlib_image_get_data();
+
+	for (y = 0; y < cinfo.output_height; y++) {
+		jpeg_read_scanlines(&cinfo, (JSAMPARRAY) &row, 1);
+		src = row;
+		dst = data + y * cinfo.output_width;
+		for (x = 0; x < cinfo.output_width; x++) {
+			if (cinfo.out_color_space == JCS_CMYK) {
+				/* Adobe writes inverted CMYK values */
+				k = src[3];
+				if (cinfo.saw_Adobe_marker) {
+					r = src[0] * k / 255;
+					g = src[1] * k / 255;
+					b = src[2] * k / 255;
+				} else {
+					r = (255 - src[0]) * (255 - k) / 255;
+					g = (255 - src[1]) * (255 - k) / 255;
+					b = (255 - src[2]) * (255 - k) / 255;
+				}
+			} else if (cinfo.out_color_space == JCS_GRAYSCALE) {
+				r = g = b = src[0];
+			} else {
+				r = src[0];
+				g = src[1];
+				b = src[2];
+			}
+			*dst++ = 0xff000000 | (r << 16) | (g << 8) | b;
+			src += cinfo.output_components;
+		}
+	}
+
+	imlib_image_put_back_data(data);
+	imlib_image_set_format("jpeg");
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	free(row);
+
+	feh_image_apply_orientation(im, orientation);
+
+	return im;
+}
+
+/*
+ * Decodes filename at the largest reduction which still yields at least
+ * min_w x min_h pixels. orig_w and orig_h are set to the full image size.
+ * See feh_jpeg_decode for orient.
+ *
+ * Returns NULL if filename is not a JPEG, if no reduction is possible or on
+ * errors. Callers are expected to fall back to a regular Imlib2 load then.
+ */
+Imlib_Image feh_jpeg_load_scaled(char *filename, int min_w, int min_h,
+		int orient, int *orig_w, int *orig_h)
+{
+	Imlib_Image im;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb")))
+		return NULL;
+
+	if (!feh_jpeg_file_is_jpeg(fp)) {
+		fclose(fp);
+		return NULL;
+	}
+	rewind(fp);
+
+	im = feh_jpeg_decode(fp, NULL, 0, min_w, min_h, 1, orient, orig_w, orig_h);
+	fclose(fp);
+
+	return im;
+}
+
+/*
+ * Decodes the in-memory JPEG buf (e.g. an EXIF thumbnail) at full size.
+ */
+Imlib_Image feh_jpeg_load_mem(const unsigned char *buf, unsigned long len)
+{
+	int w, h;
+
+	if ((len < 3) || (buf[0] != 0xff) || (buf[1] != 0xd8) || (buf[2] != 0xff))
+		return NULL;
+
+	return feh_jpeg_decode(NULL, buf, len, 0, 0, 0, 0, &w, &h);
+}
+
+/*
+ * Decodes the first len bytes of a JPEG which is still being downloaded.
+ * libjpeg treats the missing rest as the end of the image, so this yields
+ * the scanlines (or, for progressive JPEGs, the scans) received so far. The
+ * result is at least min_w x min_h pixels large; see feh_jpeg_decode for
+ * orient, orig_w and orig_h.
+ *
+ * Returns NULL if buf does not contain a complete JPEG header yet.
+ */
+Imlib_Image feh_jpeg_load_partial(const unsigned char *buf, unsigned long len,
+		int min_w, int min_h, int orient, int *orig_w, int *orig_h)
+{
+	if ((len < 3) || (buf[0] != 0xff) || (buf[1] != 0xd8) || (buf[2] != 0xff))
+		return NULL;
+
+	return feh_jpeg_decode(NULL, buf, len, min_w, min_h, 0, orient, orig_w, orig_h);
+}
+
+/*
+ * Sets w and h to the dimensions of the JPEG filename without decoding it.
+ * Returns 0 if filename is not a readable JPEG.
+ */
+int feh_jpeg_read_size(char *filename, int *w, int *h)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct feh_jpeg_error_mgr jerr;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb")))
+		return 0;
+
+	if (!feh_jpeg_file_is_jpeg(fp)) {
+		fclose(fp);
+		return 0;
+	}
+	rewind(fp);
+
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = feh_jpeg_error_exit;
+	jerr.pub.output_message = feh_jpeg_output_message;
+
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&cinfo);
+		fclose(fp);
+		return 0;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, fp);
+	jpeg_read_header(&cinfo, TRUE);
+
+	*w = cinfo.image_width;
+	*h = cinfo.image_height;
+
+	jpeg_destroy_decompress(&cinfo);
+	fclose(fp);
+
+	return 1;
+}
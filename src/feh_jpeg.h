@@ -0,0 +1,38 @@
+/* feh_jpeg.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef FEH_JPEG_H
+#define FEH_JPEG_H
+
+#include "feh.h"
+
+Imlib_Image feh_jpeg_load_scaled(char *filename, int min_w, int min_h,
+		int orient, int *orig_w, int *orig_h);
+Imlib_Image feh_jpeg_load_mem(const unsigned char *buf, unsigned long len);
+Imlib_Image feh_jpeg_load_partial(const unsigned char *buf, unsigned long len,
+		int min_w, int min_h, int orient, int *orig_w, int *orig_h);
+int feh_jpeg_read_size(char *filename, int *w, int *h);
+
+#endif				/* FEH_JPEG_H */
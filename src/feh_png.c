@@ -33,14 +33,51 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define FEH_PNG_COMPRESSION 3
 #define FEH_PNG_NUM_COMMENTS 4
 
-gib_hash *feh_png_read_comments(char *file)
+/*
+ * Reads the Thumb::* text chunks of a thumbnail. Returns 0 if it has none.
+ */
+static int feh_png_read_thumb_text(png_structp png_ptr, png_infop info_ptr,
+		time_t * mtime, int *orig_w, int *orig_h)
+{
+	int found = 0;
+#ifdef PNG_TEXT_SUPPORTED
+	png_textp text_ptr;
+	int i, comments = 0;
+
+	png_get_text(png_ptr, info_ptr, &text_ptr, &comments);
+	for (i = 0; i < comments; i++) {
+		if (!strcmp(text_ptr[i].key, "Thumb::MTime")) {
+			*mtime = (time_t) strtol(text_ptr[i].text, NULL, 10);
+			found = 1;
+		} else if (!strcmp(text_ptr[i].key, "Thumb::Image::Width"))
+			*orig_w = atoi(text_ptr[i].text);
+		else if (!strcmp(text_ptr[i].key, "Thumb::Image::Height"))
+			*orig_h = atoi(text_ptr[i].text);
+	}
+#endif				/* PNG_TEXT_SUPPORTED */
+	return(found);
+}
+
+/*
+ * Loads a cached thumbnail if its Thumb::MTime is mtime. The file is only
+ * opened and read once: its text chunks are checked before the pixels are
+ * decoded (unless they follow the image data), and the pixels go straight
+ * into the returned image.
+ */
+Imlib_Image feh_png_read_thumbnail(char *file, time_t mtime, int *orig_w,
+		int *orig_h)
 {
 	FILE *fp;
-	int i, sig_bytes, comments = 0;
+	int sig_bytes, has_alpha, color_type;
+	png_uint_32 w, h, i;
+	time_t thumb_mtime = 0;
+	int have_mtime;
 
 	png_structp png_ptr;
 	png_infop info_ptr;
-	png_textp text_ptr;
+	png_bytep *volatile rows = NULL;
+	Imlib_Image volatile im = NULL;
+	DATA32 *volatile data = NULL;
 
 	if (!(fp = fopen(file, "rb")))
 		return NULL;
@@ -50,7 +87,6 @@ gib_hash *feh_png_read_comments(char *file)
 		return NULL;
 	}
 
-	/* initialize data structures */
 	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (!png_ptr) {
 		fclose(fp);
@@ -65,32 +101,76 @@ gib_hash *feh_png_read_comments(char *file)
 	}
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
+		if (im) {
+			imlib_context_set_image(im);
+			imlib_image_put_back_data(data);
+			imlib_free_image_and_decache();
+		}
+		free(rows);
 		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 		fclose(fp);
 		return NULL;
 	}
 
-	/* initialize reading */
 	png_init_io(png_ptr, fp);
 	png_set_sig_bytes(png_ptr, sig_bytes);
-
 	png_read_info(png_ptr, info_ptr);
 
-	gib_hash *hash = NULL;
-
-#ifdef PNG_TEXT_SUPPORTED
-	png_get_text(png_ptr, info_ptr, &text_ptr, &comments);
-	if (comments > 0) {
-		hash = gib_hash_new();
-		for (i = 0; i < comments; i++)
-			gib_hash_set(hash, text_ptr[i].key, estrdup(text_ptr[i].text));
+	have_mtime = feh_png_read_thumb_text(png_ptr, info_ptr, &thumb_mtime,
+			orig_w, orig_h);
+	if (have_mtime && (thumb_mtime != mtime))
+		png_longjmp(png_ptr, 1);
+
+	/* decode to 8 bit ARGB in native byte order, as Imlib2 keeps it */
+	w = png_get_image_width(png_ptr, info_ptr);
+	h = png_get_image_height(png_ptr, info_ptr);
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	has_alpha = (color_type & PNG_COLOR_MASK_ALPHA)
+		|| png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS);
+
+	png_set_expand(png_ptr);
+	png_set_strip_16(png_ptr);
+	if (!(color_type & PNG_COLOR_MASK_COLOR))
+		png_set_gray_to_rgb(png_ptr);
+#ifdef WORDS_BIGENDIAN
+	png_set_swap_alpha(png_ptr);
+	if (!has_alpha)
+		png_set_filler(png_ptr, 0xff, PNG_FILLER_BEFORE);
+#else				/* !WORDS_BIGENDIAN */
+	png_set_bgr(png_ptr);
+	if (!has_alpha)
+		png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
+#endif				/* WORDS_BIGENDIAN */
+	png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+
+	if ((png_get_rowbytes(png_ptr, info_ptr) != w * sizeof(DATA32))
+			|| !(im = imlib_create_image(w, h)))
+		png_longjmp(png_ptr, 1);
+	imlib_context_set_image(im);
+	data = imlib_image_get_data();
+	rows = emalloc(h * sizeof(png_bytep));
+	for (i = 0; i < h; i++)
+		rows[i] = (png_bytep) (data + i * w);
+	png_read_image(png_ptr, rows);
+
+	/* text chunks after the image data */
+	if (!have_mtime) {
+		png_read_end(png_ptr, info_ptr);
+		if (!feh_png_read_thumb_text(png_ptr, info_ptr, &thumb_mtime,
+					orig_w, orig_h) || (thumb_mtime != mtime))
+			png_longjmp(png_ptr, 1);
 	}
-#endif				/* PNG_TEXT_SUPPORTED */
 
+	imlib_context_set_image(im);
+	imlib_image_put_back_data(data);
+	imlib_image_set_has_alpha(has_alpha);
+
+	free(rows);
 	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 	fclose(fp);
 
-	return hash;
+	return im;
 }
 
 /* grab image data from image and write info file with comments ... */
@@ -31,7 +31,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "feh.h"
 
-gib_hash *feh_png_read_comments(char *file);
+Imlib_Image feh_png_read_thumbnail(char *file, time_t mtime, int *orig_w,
+		int *orig_h);
 int feh_png_write_png_fd(Imlib_Image image, int fd, ...);
 
 int feh_png_file_is_png(FILE * fp);
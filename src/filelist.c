@@ -28,6 +28,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "filelist.h"
 #include "signals.h"
 #include "options.h"
+#include "timers.h"
+#include "winwidget.h"
+#include "prefetch.h"
+#include "imagecache.h"
+#include "conversion.h"
+#include "scan.h"
+#include "probe.h"
+#include "metacache.h"
+#include "sort.h"
+#include "arena.h"
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #ifdef HAVE_LIBCURL
 #include <curl/curl.h>
@@ -40,75 +52,232 @@ gib_list *current_file = NULL;
 
 static gib_list *rm_filelist = NULL;
 
-feh_file *feh_file_new(char *filename)
+/*
+ * Set while the filelist is built by a directory scan running in the
+ * background. The filelist is then in order as it grows instead of being
+ * built back to front and reversed by feh_prepare_filelist.
+ */
+static unsigned char filelist_streaming = 0;
+static gib_list *filelist_last = NULL;
+static double filelist_title_time = 0.0;
+
+/* seconds between window title updates while the filelist grows */
+#define FILELIST_TITLE_INTERVAL 0.5
+
+/* files stat'ed and probed at once by feh_file_info_preload */
+#define PRELOAD_BATCH 1024
+
+/*
+ * Array view of filelist: filetable[i] is its i-th node, and the index of
+ * that node's feh_file is i. This makes positional lookups (%u, jumps,
+ * random slides) O(1). The table is rebuilt on first use after the filelist
+ * was reordered or shrunk; appending extends it in place.
+ */
+static gib_list **filetable = NULL;
+static int filetable_len = 0;
+static int filetable_size = 0;
+static unsigned char filetable_valid = 0;
+
+/*
+ * Storage of the files in the filelist: their structs and paths are taken
+ * from filelist_store, and freed structs are kept in filelist_store_unused
+ * for reuse. All of it goes at once when the last of these files is freed.
+ */
+static feh_arena filelist_store;
+static feh_file *filelist_store_unused = NULL;
+static int filelist_store_files = 0;
+
+/*
+ * A --filelist pipe which is read while the slideshow is running. pipe_buf
+ * holds the incomplete line left over from the previous read.
+ */
+static int filelist_pipe_fd = -1;
+static char *filelist_pipe_buf = NULL;
+static size_t filelist_pipe_len = 0;
+static size_t filelist_pipe_size = 0;
+
+/* bytes read from a --filelist pipe at once */
+#define FILELIST_READ_SIZE (64 * 1024)
+
+static void feh_filelist_add(char *path);
+
+static void feh_file_init(feh_file * file)
 {
-	feh_file *newfile;
 	char *s;
 
-	newfile = (feh_file *) emalloc(sizeof(feh_file));
-	newfile->caption = NULL;
-	newfile->filename = estrdup(filename);
-	s = strrchr(filename, '/');
-	if (s)
-		newfile->name = estrdup(s + 1);
-	else
-		newfile->name = estrdup(filename);
-	newfile->size = -1;
-	newfile->mtime = 0;
-	newfile->info = NULL;
+	s = strrchr(file->filename, '/');
+	file->name = s ? s + 1 : file->filename;
+	file->caption = NULL;
+	file->size = -1;
+	file->mtime = 0;
+	file->index = -1;
+	file->info = NULL;
 #ifdef HAVE_LIBEXIF
-	newfile->ed = NULL;
+	file->ed = NULL;
 #endif
+}
+
+/*
+ * Creates a file which is not part of the filelist, e.g. a temporary one.
+ */
+feh_file *feh_file_new(char *filename)
+{
+	feh_file *newfile;
+	size_t len = strlen(filename);
+
+	/* the path follows the struct */
+	newfile = (feh_file *) emalloc(sizeof(feh_file) + len + 1);
+	newfile->filename = memcpy(newfile + 1, filename, len + 1);
+	newfile->in_store = 0;
+	feh_file_init(newfile);
 	return(newfile);
 }
 
-void feh_file_free(feh_file * file)
+/*
+ * Creates a file for the filelist from the len bytes at path, which need
+ * not be NUL-terminated.
+ */
+feh_file *feh_filelist_file_new(const char *path, size_t len)
 {
-	if (!file)
-		return;
-	if (file->filename)
-		free(file->filename);
-	if (file->name)
-		free(file->name);
+	feh_file *newfile;
+
+	if ((newfile = filelist_store_unused))
+		filelist_store_unused = (feh_file *) newfile->filename;
+	else
+		newfile = feh_arena_alloc(&filelist_store, sizeof(feh_file));
+	newfile->filename = feh_arena_strndup(&filelist_store, path, len);
+	newfile->in_store = 1;
+	feh_file_init(newfile);
+	filelist_store_files++;
+	return(newfile);
+}
+
+/*
+ * Releases what file refers to, but not the file itself.
+ */
+static void feh_file_release(feh_file * file)
+{
+	feh_prefetch_forget(file);
+	feh_conversion_cancel(file);
+	feh_image_cache_forget(file);
 	if (file->caption)
 		free(file->caption);
-	if (file->info)
-		feh_file_info_free(file->info);
 #ifdef HAVE_LIBEXIF
 	if (file->ed)
 		exif_data_unref(file->ed);
 #endif
-	free(file);
+}
+
+static void feh_filelist_store_free(void)
+{
+	D(("freeing filelist storage\n"));
+	feh_arena_free(&filelist_store);
+	filelist_store_unused = NULL;
+	filelist_store_files = 0;
+}
+
+void feh_file_free(feh_file * file)
+{
+	if (!file)
+		return;
+	feh_file_release(file);
+	if (!file->in_store) {
+		free(file);
+		return;
+	}
+	if (!--filelist_store_files)
+		feh_filelist_store_free();
+	else {
+		/* its path stays in the store until then */
+		file->filename = (char *) filelist_store_unused;
+		filelist_store_unused = file;
+	}
 	return;
 }
 
-feh_file_info *feh_file_info_new(void)
+/*
+ * Empties the filelist. The files' storage goes at once instead of file by
+ * file, unless some of them are still used elsewhere.
+ */
+void feh_filelist_free(void)
+{
+	gib_list *l, *next;
+
+	for (l = filelist; l; l = next) {
+		next = l->next;
+		if (FEH_FILE(l->data)->in_store) {
+			feh_file_release(FEH_FILE(l->data));
+			filelist_store_files--;
+		} else
+			feh_file_free(FEH_FILE(l->data));
+		free(l);
+	}
+	if (!filelist_store_files)
+		feh_filelist_store_free();
+	filelist = current_file = filelist_last = NULL;
+	filelist_len = 0;
+	feh_filelist_changed();
+}
+
+#ifdef HAVE_LIBEXIF
+/*
+ * Used for images which were not decoded by feh_load_image (prefetched or
+ * cached ones) to make their EXIF data available again.
+ */
+void feh_file_load_exif(feh_file * file)
 {
-	feh_file_info *info;
+	if (file->ed)
+		exif_data_unref(file->ed);
+	file->ed = exif_data_new_from_file(file->filename);
+}
+#endif
 
+/*
+ * Reports what the filelist takes per file: the files and their paths, list
+ * nodes and the index table.
+ */
+void feh_filelist_print_stats(void)
+{
+	size_t bytes;
 
-	info = (feh_file_info *) emalloc(sizeof(feh_file_info));
+	if (!filelist_len)
+		return;
 
-	info->width = 0;
-	info->height = 0;
-	info->pixels = 0;
-	info->has_alpha = 0;
-	info->format = NULL;
-	info->extension = NULL;
+	bytes = filelist_store.size + filelist_len * sizeof(gib_list)
+		+ filetable_size * sizeof(gib_list *);
+	fprintf(stderr, PACKAGE ": filelist: %d files, %zu KiB, %zu bytes per file\n",
+			filelist_len, bytes / 1024, bytes / filelist_len);
+}
 
-	return(info);
+/*
+ * Marks file's info as set and returns it, cleared.
+ */
+feh_file_info *feh_file_info_new(feh_file * file)
+{
+	file->info = &file->info_data;
+	memset(file->info, 0, sizeof(feh_file_info));
+	return(file->info);
 }
 
-void feh_file_info_free(feh_file_info * info)
+void feh_file_info_free(feh_file * file)
 {
-	if (!info)
-		return;
-	if (info->format)
-		free(info->format);
-	if (info->extension)
-		free(info->extension);
-	free(info);
-	return;
+	file->info = NULL;
+}
+
+/*
+ * Returns a copy of the format name which all files share. There are only
+ * a handful of them.
+ */
+static char *feh_file_info_format(char *format)
+{
+	static gib_list *formats = NULL;
+	gib_list *l;
+
+	for (l = formats; l; l = l->next)
+		if (!strcmp(l->data, format))
+			return(l->data);
+	formats = gib_list_add_front(formats, estrdup(format));
+	return(formats->data);
 }
 
 gib_list *feh_file_rm_and_free(gib_list * list, gib_list * l)
@@ -119,9 +288,19 @@ gib_list *feh_file_rm_and_free(gib_list * list, gib_list * l)
 
 gib_list *feh_file_remove_from_list(gib_list * list, gib_list * l)
 {
+	int index = FEH_FILE(l->data)->index;
+
+	/* Dropping the last entry keeps the table, anything else reindexes */
+	if (filetable_valid && (index == filetable_len - 1)
+			&& (filetable[index] == l))
+		filetable_len--;
+	else
+		feh_filelist_changed();
 	feh_file_free(FEH_FILE(l->data));
 	D(("filelist_len %d -> %d\n", filelist_len, filelist_len - 1));
 	filelist_len--;
+	if (l == filelist_last)
+		filelist_last = l->prev;
 	return(gib_list_remove(list, l));
 }
 
@@ -187,13 +366,332 @@ static void add_stdin_to_filelist(void)
 	}
 	fclose(outfile);
 
-	filelist = gib_list_add_front(filelist, feh_file_new(sfn));
+	feh_filelist_add(sfn);
 	add_file_to_rm_filelist(sfn);
 	free(sfn);
 }
 
 
 /* Recursive */
+static void add_scanned_file_to_filelist(char *path, int err)
+{
+	if (!path)
+		return;
+	if (err) {
+		errno = err;
+		feh_print_stat_error(path);
+		return;
+	}
+	D(("Adding regular file %s to filelist\n", path));
+	filelist = gib_list_add_front(filelist,
+			feh_filelist_file_new(path, strlen(path)));
+}
+
+static void feh_filelist_append_file(feh_file * file)
+{
+	if (!filelist_last)
+		filelist_last = gib_list_last(filelist);
+	if (filelist_last) {
+		gib_list_add_end(filelist_last, file);
+		filelist_last = filelist_last->next;
+	} else
+		filelist = filelist_last = gib_list_add_end(NULL, file);
+
+	if (filetable_valid && (filetable_len == filelist_len)) {
+		if (filetable_len == filetable_size) {
+			filetable_size = filetable_size ? filetable_size * 2 : 1024;
+			filetable = erealloc(filetable, filetable_size * sizeof(gib_list *));
+		}
+		file->index = filetable_len;
+		filetable[filetable_len++] = filelist_last;
+	}
+	filelist_len++;
+}
+
+static void feh_filelist_append(char *path)
+{
+	feh_filelist_append_file(feh_filelist_file_new(path, strlen(path)));
+}
+
+/*
+ * Lets the window title (e.g. its %l) reflect the growing filelist.
+ */
+static void feh_filelist_stream_title(int force)
+{
+	winwidget w;
+	double now = feh_get_time();
+
+	if (!force && (now - filelist_title_time < FILELIST_TITLE_INTERVAL))
+		return;
+	filelist_title_time = now;
+
+	if (opt.title && (w = winwidget_get_first_window_of_type(WIN_TYPE_SLIDESHOW))
+			&& w->file)
+		winwidget_rename(w, feh_printf(opt.title, FEH_FILE(w->file->data), w));
+}
+
+static void feh_filelist_stream_file(char *path, int err)
+{
+	if (!path) {
+		feh_filelist_stream_title(1);
+		if (!feh_scan_running())
+			feh_prefetch_update(current_file, FORWARD);
+		return;
+	}
+	if (err) {
+		errno = err;
+		feh_print_stat_error(path);
+		return;
+	}
+	D(("Appending regular file %s to filelist\n", path));
+	feh_filelist_append(path);
+	feh_filelist_stream_title(0);
+}
+
+/*
+ * Adds the regular file (or URL) path to the filelist. While streaming, it
+ * must not overtake the directories queued before it.
+ */
+static void feh_filelist_add(char *path)
+{
+	if (!filelist_streaming)
+		filelist = gib_list_add_front(filelist,
+			feh_filelist_file_new(path, strlen(path)));
+	else if (feh_scan_running())
+		feh_scan_start_file(path, feh_filelist_stream_file);
+	else
+		feh_filelist_append(path);
+}
+
+/*
+ * Called before the command line files are added. A plain slideshow does
+ * not need the whole filelist to show its first image, so directories are
+ * scanned in the background then, and the slideshow starts as soon as the
+ * first file is found. A filelist file is only read after the command line
+ * files, so it is streamed if it is a pipe and there are no such files.
+ */
+void feh_filelist_stream_begin(int have_files)
+{
+	struct stat st;
+
+	if (!opt.display || opt.index || opt.multiwindow || opt.list
+			|| opt.customlist || opt.loadables || opt.unloadables
+			|| opt.thumbs || opt.bgmode || opt.preload
+			|| (opt.sort != SORT_NONE) || opt.randomize || opt.reverse
+			|| opt.start_list_at)
+		return;
+	if (opt.filelistfile && (have_files || stat(opt.filelistfile, &st)
+				|| S_ISREG(st.st_mode)))
+		return;
+
+	D(("streaming the filelist\n"));
+	filelist_streaming = 1;
+}
+
+/*
+ * Adds the line of len bytes at line to *list, or appends it to the
+ * filelist if list is NULL.
+ */
+static void feh_filelist_parse_line(char *line, size_t len, gib_list ** list)
+{
+	feh_file *file;
+
+	if (!len)
+		return;
+	file = feh_filelist_file_new(line, len);
+	D(("Got filename %s from filelist file\n", file->filename));
+	if (list)
+		*list = gib_list_add_front(*list, file);
+	else
+		feh_filelist_append_file(file);
+}
+
+/*
+ * Adds the complete lines in the len bytes at buf, see
+ * feh_filelist_parse_line. Returns the number of bytes used, which does not
+ * include an incomplete last line.
+ */
+static size_t feh_filelist_parse(char *buf, size_t len, gib_list ** list)
+{
+	char *p = buf, *end = buf + len, *nl;
+
+	while ((p < end) && (nl = memchr(p, '\n', end - p))) {
+		feh_filelist_parse_line(p, nl - p, list);
+		p = nl + 1;
+	}
+	return(p - buf);
+}
+
+/*
+ * Reads the next chunk of the filelist file at fd and adds its complete
+ * lines. Blocks if there is nothing to read. Returns 0 at its end.
+ */
+static int feh_filelist_read_chunk(int fd, gib_list ** list)
+{
+	ssize_t count;
+	size_t start, used;
+	char *nl;
+
+	if (filelist_pipe_size - filelist_pipe_len < FILELIST_READ_SIZE) {
+		/* a line longer than the buffer makes it grow */
+		filelist_pipe_size = filelist_pipe_size * 2 > filelist_pipe_len + FILELIST_READ_SIZE
+			? filelist_pipe_size * 2 : filelist_pipe_len + FILELIST_READ_SIZE;
+		filelist_pipe_buf = erealloc(filelist_pipe_buf, filelist_pipe_size);
+	}
+
+	start = filelist_pipe_len;
+	count = read(fd, filelist_pipe_buf + start, filelist_pipe_size - start);
+	if ((count < 0) && (errno == EINTR))
+		return(1);
+	if (count <= 0) {
+		if (count < 0)
+			weprintf("cannot read filelist %s:", opt.filelistfile);
+		/* the last line need not end with a newline */
+		feh_filelist_parse_line(filelist_pipe_buf, filelist_pipe_len, list);
+		free(filelist_pipe_buf);
+		filelist_pipe_buf = NULL;
+		filelist_pipe_len = filelist_pipe_size = 0;
+		return(0);
+	}
+	filelist_pipe_len += count;
+
+	/* the leftover from the previous read has no newline */
+	if (!(nl = memchr(filelist_pipe_buf + start, '\n', count)))
+		return(1);
+	used = nl + 1 - filelist_pipe_buf;
+	feh_filelist_parse_line(filelist_pipe_buf, used - 1, list);
+	used += feh_filelist_parse(filelist_pipe_buf + used,
+			filelist_pipe_len - used, list);
+
+	filelist_pipe_len -= used;
+	memmove(filelist_pipe_buf, filelist_pipe_buf + used, filelist_pipe_len);
+	return(1);
+}
+
+/*
+ * Reads the next chunk of the streamed filelist file. Returns 0 once it
+ * was read completely.
+ */
+static int feh_filelist_pipe_step(void)
+{
+	if (filelist_pipe_fd < 0)
+		return(0);
+	if (feh_filelist_read_chunk(filelist_pipe_fd, NULL)) {
+		feh_filelist_stream_title(0);
+		return(1);
+	}
+	if (filelist_pipe_fd != STDIN_FILENO)
+		close(filelist_pipe_fd);
+	filelist_pipe_fd = -1;
+	feh_filelist_stream_title(1);
+	return(0);
+}
+
+/*
+ * Waits until the background scan added another file to the filelist.
+ * Returns 0 if there are no more files to come.
+ */
+int feh_filelist_stream_wait(void)
+{
+	int len = filelist_len;
+
+	while ((filelist_len == len) && (feh_filelist_pipe_step() || feh_scan_step(1)));
+	return(filelist_len != len);
+}
+
+/*
+ * Waits for the background scan to complete. The filelist is treated like
+ * any other from now on.
+ */
+void feh_filelist_stream_finish(void)
+{
+	while (feh_filelist_pipe_step() || feh_scan_step(1));
+	filelist_streaming = 0;
+	filelist_last = NULL;
+}
+
+/*
+ * Returns whether the filelist is still growing in the background.
+ */
+int feh_filelist_stream_running(void)
+{
+	return((filelist_pipe_fd >= 0) || feh_scan_running());
+}
+
+void feh_filelist_stream_fdset(fd_set * fdset, int *fdsize)
+{
+	if (filelist_pipe_fd < 0)
+		return;
+
+	FD_SET(filelist_pipe_fd, fdset);
+	if (filelist_pipe_fd >= *fdsize)
+		*fdsize = filelist_pipe_fd + 1;
+}
+
+void feh_filelist_stream_handle_fdset(fd_set * fdset)
+{
+	if ((filelist_pipe_fd >= 0) && FD_ISSET(filelist_pipe_fd, fdset))
+		feh_filelist_pipe_step();
+}
+
+/*
+ * Must be called whenever filelist is reordered or nodes are inserted
+ * anywhere but at its end.
+ */
+void feh_filelist_changed(void)
+{
+	filetable_valid = 0;
+}
+
+static void feh_filelist_index(void)
+{
+	gib_list *l;
+	int i = 0;
+
+	/* also catches list changes which were not announced */
+	if (filetable_valid && (filetable_len == filelist_len)
+			&& (filetable_len ? (filetable[0] == filelist) : !filelist))
+		return;
+
+	D(("indexing filelist\n"));
+	for (l = filelist; l; l = l->next) {
+		if (i == filetable_size) {
+			filetable_size = filetable_size ? filetable_size * 2 : 1024;
+			filetable = erealloc(filetable, filetable_size * sizeof(gib_list *));
+		}
+		filetable[i] = l;
+		FEH_FILE(l->data)->index = i++;
+	}
+	filetable_len = i;
+	filetable_valid = 1;
+}
+
+int feh_filelist_length(void)
+{
+	feh_filelist_index();
+	return(filetable_len);
+}
+
+/*
+ * Returns the position of file in filelist, or -1 if it is not part of it.
+ */
+int feh_filelist_num(feh_file * file)
+{
+	feh_filelist_index();
+	if (file && (file->index >= 0) && (file->index < filetable_len)
+			&& (filetable[file->index]->data == file))
+		return(file->index);
+	return(-1);
+}
+
+gib_list *feh_filelist_nth(int n)
+{
+	feh_filelist_index();
+	if ((n < 0) || (n >= filetable_len))
+		return(NULL);
+	return(filetable[n]);
+}
+
 void add_file_to_filelist_recursively(char *origpath, unsigned char level)
 {
 	struct stat st;
@@ -215,7 +713,7 @@ void add_file_to_filelist_recursively(char *origpath, unsigned char level)
 
 		if (path_is_url(path)) {
 			D(("Adding url %s to filelist\n", path));
-			filelist = gib_list_add_front(filelist, feh_file_new(path));
+			feh_filelist_add(path);
 			/* We'll download it later... */
 			free(path);
 			return;
@@ -240,52 +738,17 @@ void add_file_to_filelist_recursively(char *origpath, unsigned char level)
 	}
 
 	if ((S_ISDIR(st.st_mode)) && (level != FILELIST_LAST)) {
-		struct dirent **de;
-		DIR *dir;
-		int cnt, n;
-
 		D(("It is a directory\n"));
 
-		if ((dir = opendir(path)) == NULL) {
-			if (!opt.quiet)
-				weprintf("couldn't open directory %s:", path);
-			free(path);
-			return;
-		}
-		n = scandir(path, &de, file_selector_all, alphasort);
-		if (n < 0) {
-			switch (errno) {
-			case ENOMEM:
-				weprintf("Insufficient memory to scan directory %s:", path);
-				break;
-			default:
-				weprintf("Failed to scan directory %s:", path);
-			}
-		} else {
-			for (cnt = 0; cnt < n; cnt++) {
-				if (strcmp(de[cnt]->d_name, ".")
-						&& strcmp(de[cnt]->d_name, "..")) {
-					char *newfile;
-
-					newfile = estrjoin("", path, "/", de[cnt]->d_name, NULL);
-
-					/* This ensures we go down one level even if not fully recursive
-					   - this way "feh some_dir" expands to some_dir's contents */
-					if (opt.recursive)
-						add_file_to_filelist_recursively(newfile, FILELIST_CONTINUE);
-					else
-						add_file_to_filelist_recursively(newfile, FILELIST_LAST);
-
-					free(newfile);
-				}
-				free(de[cnt]);
-			}
-			free(de);
-		}
-		closedir(dir);
+		/* This ensures we go down one level even if not fully recursive
+		   - this way "feh some_dir" expands to some_dir's contents */
+		if (filelist_streaming)
+			feh_scan_start(path, opt.recursive, feh_filelist_stream_file);
+		else
+			feh_scan(path, opt.recursive, add_scanned_file_to_filelist);
 	} else if (S_ISREG(st.st_mode)) {
 		D(("Adding regular file %s to filelist\n", path));
-		filelist = gib_list_add_front(filelist, feh_file_new(path));
+		feh_filelist_add(path);
 	}
 	free(path);
 	return;
@@ -306,25 +769,114 @@ void delete_rm_files(void)
 	return;
 }
 
+/*
+ * Imlib2's name for each format feh_probe_image knows, learned from the
+ * first image of that format which was decoded. The names differ between
+ * Imlib2 versions ("jpeg" or "jpg"), and formats Imlib2 cannot load are
+ * never learned, so those files are still decoded (or converted).
+ */
+static gib_hash *probe_formats = NULL;
+
+/*
+ * Sets file->info from probe. Returns 0 if that is not possible (yet).
+ */
+static int feh_file_info_from_probe(feh_file * file, feh_probe * probe)
+{
+	char *format;
+
+	/* --preload promises to weed out files whose image data is damaged */
+	if (!probe->ok || (opt.preload && !(probe->cached && probe->decoded)))
+		return(0);
+	if (probe->cached)
+		format = (char *) probe->format;
+	else if (!probe_formats
+			|| !(format = gib_hash_get(probe_formats, (char *) probe->format)))
+		return(0);
+
+	feh_file_info_new(file);
+	file->info->width = probe->width;
+	file->info->height = probe->height;
+	file->info->has_alpha = probe->has_alpha;
+	file->info->pixels = probe->width * probe->height;
+	file->info->format = feh_file_info_format(format);
+	file->info->probed = !(probe->cached && probe->decoded);
+	return(1);
+}
+
+static void feh_file_info_learn_probe(feh_file * file, feh_probe * probe)
+{
+	if (!probe->ok || (file->info->width != probe->width)
+			|| (file->info->height != probe->height))
+		return;
+	if (!probe_formats)
+		probe_formats = gib_hash_new();
+	if (!gib_hash_get(probe_formats, (char *) probe->format)) {
+		D(("Imlib2 calls %s images %s\n", probe->format, file->info->format));
+		gib_hash_set(probe_formats, (char *) probe->format,
+				estrdup(file->info->format));
+	}
+}
+
+/* Returns 1 if --min-dimension or --max-dimension rule out the file */
+static int feh_file_info_filtered(feh_file * file)
+{
+	return(((unsigned int)file->info->width < opt.min_width)
+			|| ((unsigned int)file->info->width > opt.max_width)
+			|| ((unsigned int)file->info->height < opt.min_height)
+			|| ((unsigned int)file->info->height > opt.max_height));
+}
+
 gib_list *feh_file_info_preload(gib_list * list, int load_images)
 {
-	gib_list *l;
+	gib_list *l, *next;
 	feh_file *file = NULL;
 	gib_list *remove_list = NULL;
+	feh_probe *probes = NULL, *probe;
+	int probed = 0, done = 0;
+	int failed;
+
+	if (load_images) {
+		probes = emalloc(PRELOAD_BATCH * sizeof(feh_probe));
+		feh_metacache_open();
+	}
 
 	for (l = list; l; l = l->next) {
 		file = FEH_FILE(l->data);
 		D(("file %p, file->next %p, file->name %s\n", l, l->next, file->name));
 		if (load_images) {
-			if (feh_file_info_load(file, NULL)) {
+			/* headers are read ahead in parallel, a batch at a time */
+			if (done == probed) {
+				for (next = l, probed = 0; next && (probed < PRELOAD_BATCH);
+						next = next->next, probed++)
+					probes[probed].filename = FEH_FILE(next->data)->filename;
+				feh_probe_files(probes, probed);
+				done = 0;
+			}
+			probe = &probes[done++];
+
+			if (sig_exit)
+				failed = 1;
+			else if (probe->stat_err) {
+				errno = probe->stat_err;
+				feh_print_stat_error(file->filename);
+				if (probe->stat_err == ENOENT)
+					feh_metacache_forget(file->filename);
+				failed = 1;
+			} else if (feh_file_info_from_probe(file, probe)) {
+				file->mtime = probe->mtime;
+				file->size = probe->size;
+				if (!probe->cached)
+					feh_metacache_store(file, probe);
+				failed = 0;
+			} else if (!(failed = feh_file_info_load(file, NULL)))
+				feh_metacache_store(file, probe);
+
+			if (failed) {
 				D(("Failed to load file %p\n", file));
 				remove_list = gib_list_add_front(remove_list, l);
 				if (opt.verbose)
 					feh_display_status('x');
-			} else if (((unsigned int)file->info->width < opt.min_width)
-					|| ((unsigned int)file->info->width > opt.max_width)
-					|| ((unsigned int)file->info->height < opt.min_height)
-					|| ((unsigned int)file->info->height > opt.max_height)) {
+			} else if (feh_file_info_filtered(file)) {
 				remove_list = gib_list_add_front(remove_list, l);
 				if (opt.verbose)
 					feh_display_status('s');
@@ -343,11 +895,14 @@ gib_list *feh_file_info_preload(gib_list * list, int load_images)
 	}
 	if (opt.verbose)
 		feh_display_status(0);
+	if (load_images)
+		feh_metacache_save();
+	free(probes);
 
 	if (remove_list) {
 		for (l = remove_list; l; l = l->next) {
 			feh_file_free(FEH_FILE(((gib_list *) l->data)->data));
-			filelist = list = gib_list_remove(list, (gib_list *) l->data);
+			list = gib_list_remove(list, (gib_list *) l->data);
 		}
 
 		gib_list_free(remove_list);
@@ -356,6 +911,20 @@ gib_list *feh_file_info_preload(gib_list * list, int load_images)
 	return(list);
 }
 
+/*
+ * Brings the information on a file which changed on disk up to date, like
+ * feh_file_info_preload does for a whole list. Returns 1 if the file has to
+ * be dropped from the filelist.
+ */
+int feh_file_info_refresh(feh_file * file, int load_images)
+{
+	if (!load_images)
+		return(feh_file_stat(file));
+
+	feh_file_info_free(file);
+	return(feh_file_info_load(file, NULL) || feh_file_info_filtered(file));
+}
+
 int feh_file_stat(feh_file * file)
 {
 	struct stat st;
@@ -373,14 +942,26 @@ int feh_file_stat(feh_file * file)
 	return(0);
 }
 
+/*
+ * Sets file->info. Unless the image is given, its header is read if
+ * possible, and it is only decoded if that fails.
+ */
 int feh_file_info_load(feh_file * file, Imlib_Image im)
 {
 	int need_free = 1;
 	Imlib_Image im1;
+	feh_probe probe;
 
 	if (feh_file_stat(file))
 		return(1);
 
+	probe.ok = 0;
+	if (!im) {
+		probe.filename = file->filename;
+		if (feh_probe_image(&probe) && feh_file_info_from_probe(file, &probe))
+			return(0);
+	}
+
 	D(("im is %p\n", im));
 
 	if (im)
@@ -391,7 +972,7 @@ int feh_file_info_load(feh_file * file, Imlib_Image im)
 	else if (!feh_load_image(&im1, file) || !im1)
 		return(1);
 
-	file->info = feh_file_info_new();
+	feh_file_info_new(file);
 
 	file->info->width = gib_imlib_image_get_width(im1);
 	file->info->height = gib_imlib_image_get_height(im1);
@@ -400,7 +981,9 @@ int feh_file_info_load(feh_file * file, Imlib_Image im)
 
 	file->info->pixels = file->info->width * file->info->height;
 
-	file->info->format = estrdup(gib_imlib_image_format(im1));
+	file->info->format = feh_file_info_format(gib_imlib_image_format(im1));
+
+	feh_file_info_learn_probe(file, &probe);
 
 	if (need_free)
 		gib_imlib_free_image_and_decache(im1);
@@ -421,68 +1004,11 @@ void feh_file_dirname(char *dst, feh_file * f, int maxlen)
 	dst[n] = '\0';
 }
 
-static inline int strcmp_or_strverscmp(const char *s1, const char *s2)
-{
-	if (!opt.version_sort)
-		return(strcmp(s1, s2));
-	else
-		return(strverscmp(s1, s2));
-}
-
-int feh_cmp_filename(void *file1, void *file2)
-{
-	return(strcmp_or_strverscmp(FEH_FILE(file1)->filename, FEH_FILE(file2)->filename));
-}
-
-int feh_cmp_name(void *file1, void *file2)
-{
-	return(strcmp_or_strverscmp(FEH_FILE(file1)->name, FEH_FILE(file2)->name));
-}
-
-int feh_cmp_dirname(void *file1, void *file2)
-{
-	char dir1[PATH_MAX], dir2[PATH_MAX];
-	int cmp;
-	feh_file_dirname(dir1, FEH_FILE(file1), PATH_MAX);
-	feh_file_dirname(dir2, FEH_FILE(file2), PATH_MAX);
-	if ((cmp = strcmp_or_strverscmp(dir1, dir2)) != 0)
-		return(cmp);
-	return(feh_cmp_name(file1, file2));
-}
-
-/* Return -1 if file1 is _newer_ than file2 */
-int feh_cmp_mtime(void *file1, void *file2)
-{
-	/* gib_list_sort is not stable, so explicitly return 0 as -1 */
-	return(FEH_FILE(file1)->mtime >= FEH_FILE(file2)->mtime ? -1 : 1);
-}
-
-int feh_cmp_width(void *file1, void *file2)
-{
-	return((FEH_FILE(file1)->info->width - FEH_FILE(file2)->info->width));
-}
-
-int feh_cmp_height(void *file1, void *file2)
-{
-	return((FEH_FILE(file1)->info->height - FEH_FILE(file2)->info->height));
-}
-
-int feh_cmp_pixels(void *file1, void *file2)
-{
-	return((FEH_FILE(file1)->info->pixels - FEH_FILE(file2)->info->pixels));
-}
-
-int feh_cmp_size(void *file1, void *file2)
-{
-	return((FEH_FILE(file1)->size - FEH_FILE(file2)->size));
-}
-
-int feh_cmp_format(void *file1, void *file2)
-{
-	return(strcmp(FEH_FILE(file1)->info->format, FEH_FILE(file2)->info->format));
-}
-
-void feh_prepare_filelist(void)
+/*
+ * Returns 2 if the files in the filelist need to be preloaded, 1 if they
+ * only need stat(2) information and 0 if neither is the case.
+ */
+int feh_file_info_needed(void)
 {
 	/*
 	 * list and customlist mode as well as the somewhat more fancy sort modes
@@ -494,16 +1020,21 @@ void feh_prepare_filelist(void)
 	 * we can create a properly sized thumbnail list.
 	 */
 	if (opt.list || opt.preload || opt.customlist || (opt.sort >= SORT_WIDTH)
-			|| (opt.filter_by_dimensions && (opt.index || opt.thumbs || opt.bgmode))) {
-		/* For these sort options, we have to preload images */
-		filelist = feh_file_info_preload(filelist, TRUE);
-		if (!gib_list_length(filelist))
-			show_mini_usage();
-	} else if (opt.sort >= SORT_SIZE) {
-		/* For these sort options, we need stat(2) information on the files,
-		 * but there is no need to load the images. */
-		filelist = feh_file_info_preload(filelist, FALSE);
-		if (!gib_list_length(filelist))
+			|| (opt.filter_by_dimensions && (opt.index || opt.thumbs || opt.bgmode)))
+		return(2);
+	/* For the other stat-based sort options, there is no need to load the images */
+	if (opt.sort >= SORT_SIZE)
+		return(1);
+	return(0);
+}
+
+void feh_prepare_filelist(void)
+{
+	int needed = feh_file_info_needed();
+
+	if (needed) {
+		filelist = feh_file_info_preload(filelist, needed == 2);
+		if (!(filelist_len = gib_list_length(filelist)))
 			show_mini_usage();
 	}
 
@@ -513,39 +1044,13 @@ void feh_prepare_filelist(void)
 		if (opt.randomize) {
 			/* Randomize the filename order */
 			filelist = gib_list_randomize(filelist);
-		} else if (!opt.reverse) {
+		} else if (!opt.reverse && !filelist_streaming) {
 			/* Let's reverse the list. Its back-to-front right now ;) */
 			filelist = gib_list_reverse(filelist);
 		}
 		break;
-	case SORT_NAME:
-		filelist = gib_list_sort(filelist, feh_cmp_name);
-		break;
-	case SORT_FILENAME:
-		filelist = gib_list_sort(filelist, feh_cmp_filename);
-		break;
-	case SORT_DIRNAME:
-		filelist = gib_list_sort(filelist, feh_cmp_dirname);
-		break;
-	case SORT_MTIME:
-		filelist = gib_list_sort(filelist, feh_cmp_mtime);
-		break;
-	case SORT_WIDTH:
-		filelist = gib_list_sort(filelist, feh_cmp_width);
-		break;
-	case SORT_HEIGHT:
-		filelist = gib_list_sort(filelist, feh_cmp_height);
-		break;
-	case SORT_PIXELS:
-		filelist = gib_list_sort(filelist, feh_cmp_pixels);
-		break;
-	case SORT_SIZE:
-		filelist = gib_list_sort(filelist, feh_cmp_size);
-		break;
-	case SORT_FORMAT:
-		filelist = gib_list_sort(filelist, feh_cmp_format);
-		break;
 	default:
+		filelist = feh_filelist_sort(filelist, opt.sort);
 		break;
 	}
 
@@ -555,6 +1060,7 @@ void feh_prepare_filelist(void)
 		filelist = gib_list_reverse(filelist);
 	}
 
+	feh_filelist_changed();
 	return;
 }
 
@@ -580,15 +1086,21 @@ int feh_write_filelist(gib_list * list, char *filename)
 	return(1);
 }
 
+/*
+ * Reads a filelist file with one path per line. Regular files are mapped
+ * and split in place, anything else is read in chunks. While streaming, the
+ * file is read as the slideshow runs (see feh_filelist_stream_handle_fdset)
+ * and NULL is returned.
+ */
 gib_list *feh_read_filelist(char *filename)
 {
-	FILE *fp;
+	int fd;
 	gib_list *list = NULL;
-	char s[1024], s1[1024];
 	Imlib_Load_Error err = IMLIB_LOAD_ERROR_NONE;
 	Imlib_Image tmp_im;
 	struct stat st;
 	signed short tmp_conversion_timeout;
+	char *map;
 
 	if (!filename)
 		return(NULL);
@@ -613,28 +1125,36 @@ gib_list *feh_read_filelist(char *filename)
 	errno = 0;
 
 	if (!strcmp(filename, "/dev/stdin"))
-		fp = stdin;
+		fd = STDIN_FILENO;
 	else
-		fp = fopen(filename, "r");
+		fd = open(filename, O_RDONLY);
 
-	if (fp == NULL) {
+	if (fd < 0) {
 		/* return quietly, as it's okay to specify a filelist file that doesn't
 		   exist. In that case we create it on exit. */
 		return(NULL);
 	}
 
-	for (; fgets(s, sizeof(s), fp);) {
-		D(("Got line '%s'\n", s));
-		s1[0] = '\0';
-		sscanf(s, "%[^\n]", (char *) &s1);
-		if (!(*s1) || (*s1 == '\n'))
-			continue;
-		D(("Got filename %s from filelist file\n", s1));
-		/* Add it to the new list */
-		list = gib_list_add_front(list, feh_file_new(s1));
+	if (filelist_streaming) {
+		D(("Streaming filelist file %s\n", filename));
+		filelist_pipe_fd = fd;
+		return(NULL);
 	}
-	if (strcmp(filename, "/dev/stdin"))
-		fclose(fp);
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && (st.st_size > 0)
+			&& ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+				!= MAP_FAILED)) {
+		size_t used;
+
+		posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+		used = feh_filelist_parse(map, st.st_size, &list);
+		feh_filelist_parse_line(map + used, st.st_size - used, &list);
+		munmap(map, st.st_size);
+	} else
+		while (feh_filelist_read_chunk(fd, &list));
+
+	if (fd != STDIN_FILENO)
+		close(fd);
 
 	return(list);
 }
@@ -30,6 +30,20 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <libexif/exif-data.h>
 #endif
 
+struct __feh_file_info {
+	int width;
+	int height;
+	int pixels;
+	unsigned char has_alpha;
+	unsigned char probed;	/* read from the file header, not decoded */
+	char *format;		/* shared, see feh_file_info_new */
+};
+
+/*
+ * Files in the filelist are allocated from a common store (see
+ * feh_filelist_file_new) and never freed one by one; other files take a
+ * single allocation. Either way, name points into filename.
+ */
 struct __feh_file {
 	char *filename;
 	char *caption;
@@ -38,21 +52,15 @@ struct __feh_file {
 	/* info stuff */
 	time_t mtime;
 	int size;
-	feh_file_info *info;	/* only set when needed */
+	int index;		/* position in filelist, see feh_filelist_num */
+	feh_file_info *info;	/* points to info_data when set */
+	feh_file_info info_data;
+	unsigned char in_store;	/* allocated by feh_filelist_file_new */
 #ifdef HAVE_LIBEXIF
 	ExifData *ed;
 #endif
 };
 
-struct __feh_file_info {
-	int width;
-	int height;
-	int pixels;
-	unsigned char has_alpha;
-	char *format;
-	char *extension;
-};
-
 #define FEH_FILE(l) ((feh_file *) l)
 
 /*
@@ -81,15 +89,33 @@ enum sort_type {
 };
 
 feh_file *feh_file_new(char *filename);
+feh_file *feh_filelist_file_new(const char *path, size_t len);
 void feh_file_free(feh_file * file);
-feh_file_info *feh_file_info_new(void);
-void feh_file_info_free(feh_file_info * info);
+#ifdef HAVE_LIBEXIF
+void feh_file_load_exif(feh_file * file);
+#endif
+feh_file_info *feh_file_info_new(feh_file * file);
+void feh_file_info_free(feh_file * file);
 gib_list *feh_file_rm_and_free(gib_list * list, gib_list * file);
 int file_selector_all(const struct dirent *unused);
 void add_file_to_filelist_recursively(char *origpath, unsigned char level);
+void feh_filelist_stream_begin(int have_files);
+int feh_filelist_stream_wait(void);
+int feh_filelist_stream_running(void);
+void feh_filelist_stream_finish(void);
+void feh_filelist_changed(void);
+void feh_filelist_free(void);
+void feh_filelist_print_stats(void);
+void feh_filelist_stream_fdset(fd_set * fdset, int *fdsize);
+void feh_filelist_stream_handle_fdset(fd_set * fdset);
+int feh_filelist_length(void);
+int feh_filelist_num(feh_file * file);
+gib_list *feh_filelist_nth(int n);
 void add_file_to_rm_filelist(char *file);
 void delete_rm_files(void);
+int feh_file_info_needed(void);
 gib_list *feh_file_info_preload(gib_list * list, int load_images);
+int feh_file_info_refresh(feh_file * file, int load_images);
 int feh_file_stat(feh_file * file);
 int feh_file_info_load(feh_file * file, Imlib_Image im);
 void feh_file_dirname(char *dst, feh_file * f, int maxlen);
@@ -101,16 +127,6 @@ gib_list *feh_file_remove_from_list(gib_list * list, gib_list * l);
 void feh_save_filelist(void);
 char *feh_http_unescape(char * url);
 
-int feh_cmp_name(void *file1, void *file2);
-int feh_cmp_dirname(void *file1, void *file2);
-int feh_cmp_filename(void *file1, void *file2);
-int feh_cmp_mtime(void *file1, void *file2);
-int feh_cmp_width(void *file1, void *file2);
-int feh_cmp_height(void *file1, void *file2);
-int feh_cmp_pixels(void *file1, void *file2);
-int feh_cmp_size(void *file1, void *file2);
-int feh_cmp_format(void *file1, void *file2);
-
 extern gib_list *filelist;
 extern gib_list *original_file_items;
 extern int filelist_len;
@@ -0,0 +1,901 @@
+/* http.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "signals.h"
+#include "timers.h"
+#include "winwidget.h"
+#include "http.h"
+
+#ifdef HAVE_LIBCURL
+
+#include <curl/curl.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/* seconds between two partial decodes of a download which is on screen */
+#define HTTP_PREVIEW_INTERVAL 0.5
+
+#ifdef HAVE_MEMFD_CREATE
+
+/*
+ * Without --keep-http, downloads go to anonymous memory files which are
+ * passed around as /proc/self/fd/N. Each one holds a file descriptor until
+ * it is released, so beyond this many, downloads fall back to /tmp. This
+ * keeps descriptor numbers low enough for select().
+ */
+#define HTTP_MAX_MEMFDS 256
+
+static gib_list *memfds = NULL;
+#endif
+
+enum http_state { HTTP_RUNNING, HTTP_DONE, HTTP_UNCHANGED, HTTP_FAILED };
+
+typedef struct {
+	char *url;
+	char *sfn;
+	FILE *sfp;
+	CURL *curl;
+	CURLcode res;
+	char *ebuff;
+	/* conditional request headers, and the validators of the response */
+	struct curl_slist *headers;
+	char *etag;
+	char *last_modified;
+	enum http_state state;
+	/* when and at which size the partial download was last shown */
+	double preview_time;
+	off_t preview_size;
+} feh_http_job;
+
+/* validators of the last complete download of a URL */
+typedef struct {
+	char *etag;
+	char *last_modified;
+} feh_http_validators;
+
+static gib_list *jobs = NULL;
+static CURLM *multi = NULL;
+static CURLSH *share = NULL;
+static gib_hash *validators = NULL;
+
+#if LIBCURL_VERSION_NUM >= 0x072000 /* 07.32.0 */
+static int curl_quit_function(void *clientp,  curl_off_t dltotal,  curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+#else
+static int curl_quit_function(void *clientp,  double dltotal,  double dlnow, double ultotal, double ulnow)
+#endif
+{
+	// ignore "unused parameter" warnings
+	(void)clientp;
+	(void)dltotal;
+	(void)dlnow;
+	(void)ultotal;
+	(void)ulnow;
+	if (sig_exit) {
+		/*
+		 * The user wants to quit feh. Tell libcurl to abort the transfer and
+		 * return control to the main loop, where we can quit gracefully.
+		 */
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * If the header line in buf is called name, stores its value in *value.
+ */
+static void feh_http_header_value(char *buf, size_t len, char *name, char **value)
+{
+	size_t namelen = strlen(name);
+
+	if ((len <= namelen) || strncasecmp(buf, name, namelen))
+		return;
+
+	buf += namelen;
+	len -= namelen;
+	while (len && ((*buf == ' ') || (*buf == '\t'))) {
+		buf++;
+		len--;
+	}
+	while (len && ((buf[len - 1] == '\r') || (buf[len - 1] == '\n')
+				|| (buf[len - 1] == ' ')))
+		len--;
+
+	free(*value);
+	*value = emalloc(len + 1);
+	memcpy(*value, buf, len);
+	(*value)[len] = '\0';
+}
+
+static size_t feh_http_header(char *buf, size_t size, size_t nitems, void *data)
+{
+	feh_http_job *job = data;
+	size_t len = size * nitems;
+
+	/* a new response begins, e.g. after a redirect */
+	if ((len > 5) && !strncmp(buf, "HTTP/", 5)) {
+		free(job->etag);
+		free(job->last_modified);
+		job->etag = job->last_modified = NULL;
+	}
+	feh_http_header_value(buf, len, "ETag:", &job->etag);
+	feh_http_header_value(buf, len, "Last-Modified:", &job->last_modified);
+	return(len);
+}
+
+/*
+ * Remembers the validators of a complete download of url for later
+ * conditional requests.
+ */
+static void feh_http_store_validators(feh_http_job * job)
+{
+	feh_http_validators *v;
+
+	if (!validators)
+		validators = gib_hash_new();
+
+	if ((v = gib_hash_get(validators, job->url))) {
+		free(v->etag);
+		free(v->last_modified);
+	} else if (job->etag || job->last_modified) {
+		v = emalloc(sizeof(feh_http_validators));
+		gib_hash_set(validators, job->url, v);
+	} else
+		return;
+
+	v->etag = job->etag;
+	v->last_modified = job->last_modified;
+	job->etag = job->last_modified = NULL;
+}
+
+static int feh_http_init(void)
+{
+	if (multi)
+		return(1);
+
+	if (!(multi = curl_multi_init())) {
+		weprintf("open url: libcurl initialization failure");
+		return(0);
+	}
+#if LIBCURL_VERSION_NUM >= 0x071e00 /* 07.30.0 */
+	curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+			(long) opt.parallel_downloads);
+#endif
+
+	/*
+	 * The multi handle already keeps a connection pool. DNS results and TLS
+	 * sessions are kept in a share so that new connections (e.g. once the
+	 * server closed an idle one) can skip those round-trips as well.
+	 */
+	if ((share = curl_share_init())) {
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+	return(1);
+}
+
+static feh_http_job *feh_http_find(char *url)
+{
+	gib_list *l;
+
+	for (l = jobs; l; l = l->next)
+		if (!strcmp(((feh_http_job *) l->data)->url, url))
+			return(l->data);
+	return(NULL);
+}
+
+#ifdef HAVE_MEMFD_CREATE
+static gib_list *feh_http_find_memfd(char *sfn)
+{
+	gib_list *l;
+
+	for (l = memfds; l; l = l->next)
+		if (!strcmp(l->data, sfn))
+			return(l);
+	return(NULL);
+}
+
+static FILE *feh_http_memfd(char **sfn)
+{
+	char name[32];
+	FILE *sfp;
+	int fd, keep;
+
+	if (gib_list_length(memfds) >= HTTP_MAX_MEMFDS)
+		return(NULL);
+
+	if ((fd = memfd_create(PACKAGE "_curl", MFD_CLOEXEC)) == -1) {
+		D(("memfd_create failed: %s\n", strerror(errno)));
+		return(NULL);
+	}
+
+	/*
+	 * sfp is closed once the transfer is done, keep holds on to the data
+	 * until the download is released.
+	 */
+	if ((keep = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+		close(fd);
+		return(NULL);
+	}
+	if ((sfp = fdopen(fd, "w+")) == NULL) {
+		close(fd);
+		close(keep);
+		return(NULL);
+	}
+
+	snprintf(name, sizeof(name), "/proc/self/fd/%d", keep);
+	*sfn = estrdup(name);
+	memfds = gib_list_add_front(memfds, estrdup(name));
+	return(sfp);
+}
+#endif
+
+/*
+ * Creates the file url is downloaded to. With --keep-http, it goes to the
+ * output directory, otherwise to memory if possible, and to /tmp if not.
+ */
+static FILE *feh_http_mkstemp(char *url, char **sfn)
+{
+	FILE *sfp;
+	int fd = -1;
+	char *tmpname;
+	char *basename;
+	char *path = NULL;
+
+#ifdef HAVE_MEMFD_CREATE
+	if (!opt.keep_http && (sfp = feh_http_memfd(sfn)))
+		return(sfp);
+#endif
+
+	if (opt.keep_http) {
+		if (opt.output_dir)
+			path = opt.output_dir;
+		else
+			path = "";
+	} else
+		path = "/tmp/";
+
+	basename = strrchr(url, '/') + 1;
+
+#ifdef HAVE_MKSTEMPS
+	tmpname = estrjoin("_", "feh_curl_XXXXXX", basename, NULL);
+
+	if (strlen(tmpname) > NAME_MAX) {
+		tmpname[NAME_MAX] = '\0';
+	}
+#else
+	if (strlen(basename) > NAME_MAX-7) {
+		tmpname = estrdup("feh_curl_XXXXXX");
+	} else {
+		tmpname = estrjoin("_", "feh_curl", basename, "XXXXXX", NULL);
+	}
+#endif
+
+	*sfn = estrjoin("", path, tmpname, NULL);
+	free(tmpname);
+
+	D(("sfn is %s\n", *sfn))
+
+#ifdef HAVE_MKSTEMPS
+	fd = mkstemps(*sfn, strlen(basename) + 1);
+#else
+	fd = mkstemp(*sfn);
+#endif
+
+	if (fd == -1) {
+#ifdef HAVE_MKSTEMPS
+		weprintf("open url: mkstemps failed:");
+#else
+		weprintf("open url: mkstemp failed:");
+#endif
+		free(*sfn);
+		return(NULL);
+	}
+
+	if ((sfp = fdopen(fd, "w+")) == NULL) {
+		weprintf("open url: fdopen failed:");
+		unlink(*sfn);
+		free(*sfn);
+		close(fd);
+	}
+	return(sfp);
+}
+
+static void feh_http_free(feh_http_job * job)
+{
+	gib_list *l;
+
+	if ((l = gib_list_find_by_data(jobs, job)))
+		jobs = gib_list_remove(jobs, l);
+	free(job->url);
+	free(job->sfn);
+	free(job->ebuff);
+	free(job->etag);
+	free(job->last_modified);
+	free(job);
+}
+
+static void feh_http_finish(feh_http_job * job, CURLcode res)
+{
+	long code = 0;
+
+	if (res == CURLE_OK)
+		curl_easy_getinfo(job->curl, CURLINFO_RESPONSE_CODE, &code);
+
+	curl_multi_remove_handle(multi, job->curl);
+	curl_easy_cleanup(job->curl);
+	job->curl = NULL;
+	curl_slist_free_all(job->headers);
+	job->headers = NULL;
+	fclose(job->sfp);
+	job->sfp = NULL;
+
+	job->res = res;
+	if (code == 304) {
+		job->state = HTTP_UNCHANGED;
+		if (!feh_http_release(job->sfn))
+			unlink(job->sfn);
+	} else if (res == CURLE_OK) {
+		job->state = HTTP_DONE;
+		feh_http_store_validators(job);
+	} else {
+		job->state = HTTP_FAILED;
+		if (!feh_http_release(job->sfn))
+			unlink(job->sfn);
+	}
+	D(("%s: %s\n", job->url, res == CURLE_OK ? "downloaded" : job->ebuff));
+}
+
+/*
+ * Lets libcurl work on all transfers and collects the finished ones.
+ */
+static void feh_http_perform(void)
+{
+	CURLMsg *msg;
+	CURL *curl;
+	CURLcode res;
+	char *job;
+	int running, left;
+
+	while (curl_multi_perform(multi, &running) == CURLM_CALL_MULTI_PERFORM)
+		;
+
+	while ((msg = curl_multi_info_read(multi, &left))) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+		curl = msg->easy_handle;
+		res = msg->data.result;
+		curl_easy_getinfo(curl, CURLINFO_PRIVATE, &job);
+		feh_http_finish((feh_http_job *) job, res);
+	}
+}
+
+/*
+ * Starts downloading url, unless that is already under way or done. If
+ * conditional is set and url was downloaded before, the server is asked to
+ * only send it if it changed since. Returns 0 if the transfer could not be
+ * set up.
+ */
+static int feh_http_start_job(char *url, int conditional)
+{
+	feh_http_job *job;
+	feh_http_validators *v;
+	CURL *curl;
+	char *header;
+
+	if (feh_http_find(url))
+		return(1);
+
+	if (!feh_http_init())
+		return(0);
+
+	if (!(curl = curl_easy_init())) {
+		weprintf("open url: libcurl initialization failure");
+		return(0);
+	}
+
+	job = emalloc(sizeof(feh_http_job));
+	memset(job, 0, sizeof(feh_http_job));
+
+	if ((job->sfp = feh_http_mkstemp(url, &job->sfn)) == NULL) {
+		curl_easy_cleanup(curl);
+		free(job);
+		return(0);
+	}
+
+	job->url = estrdup(url);
+	job->curl = curl;
+	job->ebuff = emalloc(CURL_ERROR_SIZE);
+	job->ebuff[0] = '\0';
+	job->state = HTTP_RUNNING;
+
+#ifdef DEBUG
+	curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
+#endif
+	/*
+	 * Do not allow requests to take longer than 30 minutes.
+	 * This should be sufficiently high to accommodate use cases with
+	 * unusually high latencies, while at the same time avoiding
+	 * feh hanging indefinitely in unattended slideshows.
+	 */
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 1800);
+	curl_easy_setopt(curl, CURLOPT_URL, job->url);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, job->sfp);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, job->ebuff);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, job);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, PACKAGE "/" VERSION);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+#if LIBCURL_VERSION_NUM >= 0x072000 /* 07.32.0 */
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, curl_quit_function);
+#else
+	curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, curl_quit_function);
+#endif
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, feh_http_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, job);
+	if (conditional && validators && (v = gib_hash_get(validators, url))) {
+		if (v->etag) {
+			header = estrjoin(" ", "If-None-Match:", v->etag, NULL);
+			job->headers = curl_slist_append(job->headers, header);
+			free(header);
+		}
+		if (v->last_modified) {
+			header = estrjoin(" ", "If-Modified-Since:", v->last_modified, NULL);
+			job->headers = curl_slist_append(job->headers, header);
+			free(header);
+		}
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, job->headers);
+	}
+	if (share)
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+	if (opt.insecure_ssl) {
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+	} else if (getenv("CURL_CA_BUNDLE") != NULL) {
+		// Allow the user to specify custom CA certificates.
+		curl_easy_setopt(curl, CURLOPT_CAINFO,
+				getenv("CURL_CA_BUNDLE"));
+	}
+
+	if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+		weprintf("open url: libcurl initialization failure");
+		fclose(job->sfp);
+		if (!feh_http_release(job->sfn))
+			unlink(job->sfn);
+		curl_easy_cleanup(curl);
+		feh_http_free(job);
+		return(0);
+	}
+
+	D(("started download of %s\n", url));
+	jobs = gib_list_add_end(jobs, job);
+	return(1);
+}
+
+int feh_http_start(char *url)
+{
+	return(feh_http_start_job(url, 0));
+}
+
+static void feh_http_wait(feh_http_job * job)
+{
+	fd_set fdset, wfdset, efdset;
+	struct timeval tval;
+	int fdsize;
+	long timeout;
+
+	while (job->state == HTTP_RUNNING) {
+		FD_ZERO(&fdset);
+		FD_ZERO(&wfdset);
+		FD_ZERO(&efdset);
+		fdsize = 0;
+		feh_http_fdset(&fdset, &wfdset, &efdset, &fdsize);
+
+		timeout = feh_http_timeout();
+		if ((timeout < 0) || (timeout > 1000))
+			timeout = 1000;
+		tval.tv_sec = timeout / 1000;
+		tval.tv_usec = (timeout % 1000) * 1000;
+
+		select(fdsize, &fdset, &wfdset, &efdset, &tval);
+		feh_http_perform();
+	}
+}
+
+/*
+ * Waits for the download of url, starting it first if necessary, and
+ * returns the name of the downloaded file, which now belongs to the caller.
+ * Returns NULL if the download failed.
+ */
+char *feh_http_take(char *url)
+{
+	feh_http_job *job;
+	char *sfn;
+
+	if (!feh_http_start(url) || !(job = feh_http_find(url)))
+		return(NULL);
+
+	feh_http_wait(job);
+
+	if (job->state != HTTP_DONE) {
+		if ((job->state == HTTP_FAILED) && (job->res != CURLE_ABORTED_BY_CALLBACK))
+			weprintf("open url: %s", job->ebuff);
+		feh_http_free(job);
+		return(NULL);
+	}
+
+	sfn = job->sfn;
+	job->sfn = NULL;
+	feh_http_free(job);
+	return(sfn);
+}
+
+/*
+ * Returns 1 while url is being downloaded.
+ */
+int feh_http_pending(char *url)
+{
+	feh_http_job *job = feh_http_find(url);
+
+	return(job && (job->state == HTTP_RUNNING));
+}
+
+/*
+ * Aborts the download of url, or removes it if it is already done and
+ * nobody took it yet.
+ */
+void feh_http_cancel(char *url)
+{
+	feh_http_job *job;
+
+	if (!(job = feh_http_find(url)))
+		return;
+
+	D(("cancelling download of %s\n", url));
+	if (job->state == HTTP_RUNNING)
+		feh_http_finish(job, CURLE_ABORTED_BY_CALLBACK);
+	else if ((job->state == HTTP_DONE) && !feh_http_release(job->sfn))
+		unlink(job->sfn);
+	feh_http_free(job);
+}
+
+/*
+ * Maps what was received of url so far, for showing it before the download
+ * is complete. To keep redrawing cheap, this returns NULL unless
+ * HTTP_PREVIEW_INTERVAL passed and more data arrived since the last call.
+ * The caller must munmap the result.
+ */
+unsigned char *feh_http_map_partial(char *url, size_t * len)
+{
+	feh_http_job *job;
+	struct stat st;
+	void *data;
+	double now;
+
+	if (!(job = feh_http_find(url)) || (job->state != HTTP_RUNNING))
+		return(NULL);
+
+	now = feh_get_time();
+	if (now - job->preview_time < HTTP_PREVIEW_INTERVAL)
+		return(NULL);
+
+	fflush(job->sfp);
+	if (fstat(fileno(job->sfp), &st) || (st.st_size <= job->preview_size))
+		return(NULL);
+
+	job->preview_time = now;
+	job->preview_size = st.st_size;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(job->sfp), 0);
+	if (data == MAP_FAILED)
+		return(NULL);
+	*len = st.st_size;
+	return(data);
+}
+
+/*
+ * Asks the server whether url changed since it was last downloaded. Returns
+ * 1 if it did not. Otherwise, the new version is left for feh_http_take.
+ */
+int feh_http_unchanged(char *url)
+{
+	feh_http_job *job;
+
+	if (!validators || !gib_hash_get(validators, url) || feh_http_find(url))
+		return(0);
+
+	if (!feh_http_start_job(url, 1) || !(job = feh_http_find(url)))
+		return(0);
+
+	feh_http_wait(job);
+
+	if (job->state != HTTP_UNCHANGED)
+		return(0);
+
+	D(("%s did not change\n", url));
+	feh_http_free(job);
+	return(1);
+}
+
+/*
+ * Starts downloading the URLs among the count entries beginning at list,
+ * so that they are ready by the time they are loaded.
+ */
+void feh_http_prefetch(gib_list * list, unsigned int count)
+{
+	gib_list *l;
+	unsigned int i;
+	char *url;
+
+	for (l = list, i = 0; l && (i < count); l = l->next, i++) {
+		url = FEH_FILE(l->data)->filename;
+		if (!path_is_url(url))
+			continue;
+		/* already downloaded earlier */
+		if (opt.use_conversion_cache && conversion_cache
+				&& gib_hash_get(conversion_cache, url))
+			continue;
+		feh_http_start(url);
+	}
+}
+
+/*
+ * Aborts all downloads. Finished ones are removed as well unless the user
+ * asked to keep them.
+ */
+void feh_http_cancel_all(void)
+{
+	feh_http_job *job;
+
+	while (jobs) {
+		job = jobs->data;
+		if (job->state == HTTP_RUNNING)
+			feh_http_finish(job, CURLE_ABORTED_BY_CALLBACK);
+		else if ((job->state == HTTP_DONE) && !opt.keep_http
+				&& !feh_http_release(job->sfn))
+			unlink(job->sfn);
+		feh_http_free(job);
+	}
+
+	if (multi) {
+		curl_multi_cleanup(multi);
+		multi = NULL;
+	}
+	if (share) {
+		curl_share_cleanup(share);
+		share = NULL;
+	}
+}
+
+int feh_http_in_memory(char *sfn)
+{
+#ifdef HAVE_MEMFD_CREATE
+	return(feh_http_find_memfd(sfn) != NULL);
+#else
+	(void) sfn;
+	return(0);
+#endif
+}
+
+/*
+ * Maps the contents of a download kept in memory. Returns NULL for
+ * regular files. The caller must munmap the result.
+ */
+unsigned char *feh_http_map(char *sfn, size_t * len)
+{
+#ifdef HAVE_MEMFD_CREATE
+	struct stat st;
+	void *data;
+	int fd;
+
+	if (!feh_http_find_memfd(sfn))
+		return(NULL);
+
+	fd = atoi(strrchr(sfn, '/') + 1);
+	if (fstat(fd, &st) || (st.st_size <= 0))
+		return(NULL);
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return(NULL);
+	*len = st.st_size;
+	return(data);
+#else
+	(void) sfn;
+	(void) len;
+	return(NULL);
+#endif
+}
+
+/*
+ * Frees a download kept in memory and returns 1. Returns 0 if sfn is a
+ * regular file, which the caller has to unlink itself.
+ */
+int feh_http_release(char *sfn)
+{
+#ifdef HAVE_MEMFD_CREATE
+	gib_list *l;
+
+	if (!(l = feh_http_find_memfd(sfn)))
+		return(0);
+
+	D(("releasing %s\n", sfn));
+	close(atoi(strrchr(sfn, '/') + 1));
+	free(l->data);
+	memfds = gib_list_remove(memfds, l);
+	return(1);
+#else
+	(void) sfn;
+	return(0);
+#endif
+}
+
+void feh_http_fdset(fd_set * fdset, fd_set * wfdset, fd_set * efdset, int *fdsize)
+{
+	int maxfd = -1;
+
+	if (!multi || !jobs)
+		return;
+
+	curl_multi_fdset(multi, fdset, wfdset, efdset, &maxfd);
+	if (maxfd >= *fdsize)
+		*fdsize = maxfd + 1;
+}
+
+/*
+ * Returns after how many milliseconds libcurl needs to be called even if
+ * none of its sockets are ready, or -1 if it does not need to be.
+ */
+long feh_http_timeout(void)
+{
+	long timeout = -1;
+	gib_list *l;
+
+	for (l = jobs; l; l = l->next)
+		if (((feh_http_job *) l->data)->state == HTTP_RUNNING)
+			break;
+	if (!l)
+		return(-1);
+
+	/*
+	 * -1 means that libcurl only waits for its sockets. Poll anyway in case
+	 * it has none yet, e.g. while resolving a host name.
+	 */
+	if ((curl_multi_timeout(multi, &timeout) != CURLM_OK) || (timeout < 0))
+		return(100);
+	return(timeout);
+}
+
+/*
+ * Lets libcurl work on the transfers, then updates the slideshow windows
+ * waiting for one of them: finished downloads replace the placeholder,
+ * others show what arrived so far.
+ */
+void feh_http_handle_fdset(void)
+{
+	int i;
+
+	if (!multi || !jobs)
+		return;
+
+	feh_http_perform();
+
+	for (i = 0; i < window_num; i++) {
+		if (!windows[i]->downloading)
+			continue;
+		if (feh_http_pending(FEH_FILE(windows[i]->file->data)->filename))
+			slideshow_preview(windows[i]);
+		else
+			slideshow_loaded(windows[i]);
+	}
+}
+
+#else				/* HAVE_LIBCURL */
+
+int feh_http_start(__attribute__((unused)) char *url)
+{
+	return(0);
+}
+
+int feh_http_pending(__attribute__((unused)) char *url)
+{
+	return(0);
+}
+
+void feh_http_cancel(__attribute__((unused)) char *url)
+{
+	return;
+}
+
+unsigned char *feh_http_map_partial(__attribute__((unused)) char *url,
+		__attribute__((unused)) size_t * len)
+{
+	return(NULL);
+}
+
+int feh_http_unchanged(__attribute__((unused)) char *url)
+{
+	return(0);
+}
+
+char *feh_http_take(char *url)
+{
+	weprintf(
+		"Cannot load image %s\nPlease recompile feh with libcurl support",
+		url
+	);
+	return NULL;
+}
+
+int feh_http_in_memory(__attribute__((unused)) char *sfn)
+{
+	return(0);
+}
+
+unsigned char *feh_http_map(__attribute__((unused)) char *sfn,
+		__attribute__((unused)) size_t * len)
+{
+	return(NULL);
+}
+
+int feh_http_release(__attribute__((unused)) char *sfn)
+{
+	return(0);
+}
+
+void feh_http_prefetch(__attribute__((unused)) gib_list * list,
+		__attribute__((unused)) unsigned int count)
+{
+	return;
+}
+
+void feh_http_cancel_all(void)
+{
+	return;
+}
+
+void feh_http_fdset(__attribute__((unused)) fd_set * fdset,
+		__attribute__((unused)) fd_set * wfdset,
+		__attribute__((unused)) fd_set * efdset,
+		__attribute__((unused)) int *fdsize)
+{
+	return;
+}
+
+long feh_http_timeout(void)
+{
+	return(-1);
+}
+
+void feh_http_handle_fdset(void)
+{
+	return;
+}
+
+#endif				/* HAVE_LIBCURL */
@@ -0,0 +1,63 @@
+/* http.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#ifndef HTTP_H
+#define HTTP_H
+
+/*
+ * Remote files are downloaded by libcurl transfers on a single multi handle,
+ * so connections, DNS lookups and TLS sessions are re-used between them. Up
+ * to --parallel-downloads transfers run at once. Pending transfers progress
+ * whenever the main loop (or a caller waiting for one of them) polls their
+ * sockets.
+ *
+ * The ETag and Last-Modified headers of each download are kept, so that
+ * reloading a URL only transfers it again if the server has a new version.
+ *
+ * While a slideshow shows a file which is still being downloaded, the part
+ * which arrived so far is decoded and drawn every now and then.
+ *
+ * Unless --keep-http is used, downloads are kept in memory where possible.
+ * Their names are /proc/self/fd paths which must be passed to
+ * feh_http_release instead of unlink(2).
+ */
+
+int feh_http_start(char *url);
+int feh_http_pending(char *url);
+void feh_http_cancel(char *url);
+unsigned char *feh_http_map_partial(char *url, size_t * len);
+char *feh_http_take(char *url);
+int feh_http_unchanged(char *url);
+int feh_http_in_memory(char *sfn);
+unsigned char *feh_http_map(char *sfn, size_t * len);
+int feh_http_release(char *sfn);
+void feh_http_prefetch(gib_list * list, unsigned int count);
+void feh_http_cancel_all(void);
+void feh_http_fdset(fd_set * fdset, fd_set * wfdset, fd_set * efdset, int *fdsize);
+long feh_http_timeout(void);
+void feh_http_handle_fdset(void);
+
+#endif
@@ -0,0 +1,224 @@
+/* imagecache.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "winwidget.h"
+#include "imagecache.h"
+
+/*
+ * Decoded images which are not on screen right now, most recently used
+ * first. Windows check their image in when they move on to another one and
+ * take it out again when they return, so an image is owned either by a
+ * window or by the cache, never by both.
+ */
+typedef struct {
+	feh_image_key key;
+	Imlib_Image im;
+	size_t bytes;
+} feh_image_cache_entry;
+
+static gib_list *entries = NULL;
+static size_t cache_bytes = 0;
+
+static unsigned int cache_hits = 0;
+static unsigned int cache_misses = 0;
+static unsigned int cache_evictions = 0;
+
+#define IMAGE_CACHE_BUDGET ((size_t) opt.image_cache_size * 1024 * 1024)
+
+int feh_image_key_init(feh_image_key * key, feh_file * file)
+{
+	struct stat st;
+
+	memset(key, 0, sizeof(feh_image_key));
+
+	if (!opt.image_cache_size || path_is_url(file->filename) || stat(file->filename, &st))
+		return(0);
+
+	key->file = file;
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->size = st.st_size;
+	key->mtime = st.st_mtim;
+	return(1);
+}
+
+static int feh_image_key_equal(feh_image_key * a, feh_image_key * b)
+{
+	return((a->file == b->file) && (a->dev == b->dev) && (a->ino == b->ino)
+		&& (a->size == b->size) && (a->mtime.tv_sec == b->mtime.tv_sec)
+		&& (a->mtime.tv_nsec == b->mtime.tv_nsec));
+}
+
+static gib_list *feh_image_cache_find(feh_file * file)
+{
+	gib_list *l;
+
+	for (l = entries; l; l = l->next)
+		if (((feh_image_cache_entry *) l->data)->key.file == file)
+			return(l);
+	return(NULL);
+}
+
+static void feh_image_cache_remove(gib_list * l, int free_image)
+{
+	feh_image_cache_entry *entry = l->data;
+
+	if (free_image)
+		gib_imlib_free_image(entry->im);
+	cache_bytes -= entry->bytes;
+	entries = gib_list_remove(entries, l);
+	free(entry);
+}
+
+/*
+ * Hands out the cached image for key->file if it was decoded from the
+ * state described by key. On success, the caller owns the image and the
+ * cache entry is gone.
+ */
+int feh_image_cache_get(Imlib_Image * im, feh_image_key * key)
+{
+	gib_list *l;
+	feh_image_cache_entry *entry;
+
+	if (!opt.image_cache_size || !key->file)
+		return(0);
+
+	if (!(l = feh_image_cache_find(key->file))) {
+		cache_misses++;
+		return(0);
+	}
+
+	entry = l->data;
+	if (!feh_image_key_equal(&entry->key, key)) {
+		D(("%s changed on disk, dropping cached image\n", key->file->filename));
+		feh_image_cache_remove(l, 1);
+		cache_misses++;
+		return(0);
+	}
+
+	*im = entry->im;
+	feh_image_cache_remove(l, 0);
+	cache_hits++;
+
+#ifdef HAVE_LIBEXIF
+	feh_file_load_exif(key->file);
+#endif
+
+	D(("cache hit for %s\n", key->file->filename));
+	return(1);
+}
+
+/*
+ * Takes ownership of im. It is kept if key allows it and it fits into
+ * --image-cache-size, evicting the least recently used images as needed.
+ */
+void feh_image_cache_put(Imlib_Image im, feh_image_key * key)
+{
+	feh_image_cache_entry *entry;
+	gib_list *l;
+	size_t bytes;
+
+	if (!im)
+		return;
+
+	bytes = (size_t) gib_imlib_image_get_width(im)
+		* gib_imlib_image_get_height(im) * sizeof(DATA32);
+
+	if (!opt.image_cache_size || !key->file || (bytes > IMAGE_CACHE_BUDGET)) {
+		gib_imlib_free_image(im);
+		return;
+	}
+
+	if ((l = feh_image_cache_find(key->file)))
+		feh_image_cache_remove(l, 1);
+
+	while (entries && (cache_bytes + bytes > IMAGE_CACHE_BUDGET)) {
+		l = gib_list_last(entries);
+		D(("evicting %s\n", ((feh_image_cache_entry *) l->data)->key.file->filename));
+		feh_image_cache_remove(l, 1);
+		cache_evictions++;
+	}
+
+	entry = emalloc(sizeof(feh_image_cache_entry));
+	entry->key = *key;
+	entry->im = im;
+	entry->bytes = bytes;
+	entries = gib_list_add_front(entries, entry);
+	cache_bytes += bytes;
+}
+
+int feh_image_cache_contains(feh_file * file)
+{
+	return(feh_image_cache_find(file) != NULL);
+}
+
+/*
+ * Returns 1 if an image decoded from key is still up to date for file, i.e.
+ * reloading it would yield the same pixels. This is no cache lookup, so it
+ * does not count as a hit.
+ */
+int feh_image_cache_still_valid(feh_image_key * key, feh_file * file)
+{
+	feh_image_key current;
+
+	if (!opt.image_cache_size || !key->file || (key->file != file))
+		return(0);
+
+	if (!feh_image_key_init(&current, file) || !feh_image_key_equal(key, &current))
+		return(0);
+
+	return(1);
+}
+
+/*
+ * Called when file is about to be freed. Drops its cache entry and makes
+ * sure that no window refers to it as the origin of its image any more.
+ */
+void feh_image_cache_forget(feh_file * file)
+{
+	gib_list *l;
+	int i;
+
+	if ((l = feh_image_cache_find(file)))
+		feh_image_cache_remove(l, 1);
+
+	for (i = 0; i < window_num; i++)
+		if (windows[i]->im_key.file == file)
+			memset(&windows[i]->im_key, 0, sizeof(feh_image_key));
+}
+
+void feh_image_cache_print_stats(void)
+{
+	if (!opt.image_cache_size)
+		return;
+
+	fprintf(stderr, PACKAGE ": image cache: %u hits, %u misses, %u evictions, "
+			"%d images (%zu MiB) cached\n", cache_hits, cache_misses,
+			cache_evictions, gib_list_length(entries),
+			cache_bytes / 1024 / 1024);
+}
@@ -0,0 +1,50 @@
+/* imagecache.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+/*
+ * Identifies the on-disk state an image was decoded from. A cached image is
+ * only reused while its file still has the same inode, size and mtime.
+ * file == NULL means that the image must not be cached (e.g. remote files).
+ */
+struct __feh_image_key {
+	feh_file *file;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+};
+
+int feh_image_key_init(feh_image_key * key, feh_file * file);
+int feh_image_cache_get(Imlib_Image * im, feh_image_key * key);
+void feh_image_cache_put(Imlib_Image im, feh_image_key * key);
+int feh_image_cache_contains(feh_file * file);
+int feh_image_cache_still_valid(feh_image_key * key, feh_file * file);
+void feh_image_cache_forget(feh_file * file);
+void feh_image_cache_print_stats(void);
+
+#endif
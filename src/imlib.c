@@ -29,19 +29,25 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "signals.h"
 #include "winwidget.h"
 #include "options.h"
+#include "imagecache.h"
+#include "convcache.h"
+#include "conversion.h"
+#include "http.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-
-#ifdef HAVE_LIBCURL
-#include <curl/curl.h>
-#endif
+#include <sys/mman.h>
 
 #ifdef HAVE_LIBEXIF
 #include "exif.h"
+#include <libexif/exif-loader.h>
+#endif
+
+#ifdef HAVE_LIBJPEG
+#include "feh_jpeg.h"
 #endif
 
 #ifdef HAVE_LIBMAGIC
@@ -68,12 +74,10 @@ int num_xinerama_screens;
 
 gib_hash* conversion_cache = NULL;
 
-int childpid = 0;
-
-static int feh_file_is_raw(char *filename);
+#ifdef HAVE_LIBEXIF
+static int feh_exif_orientation(ExifData * ed);
+#endif
 static char *feh_http_load_image(char *url);
-static char *feh_dcraw_load_image(char *filename);
-static char *feh_magick_load_image(char *filename);
 
 #ifdef HAVE_LIBXINERAMA
 void init_xinerama(void)
@@ -326,13 +330,104 @@ int feh_is_image(__attribute__((unused)) feh_file * file, __attribute__((unused)
 }
 #endif
 
-int feh_load_image(Imlib_Image * im, feh_file * file)
+#ifdef HAVE_LIBEXIF
+/*
+ * Returns the EXIF orientation stored in ed, or 0 if there is none.
+ */
+static int feh_exif_orientation(ExifData * ed)
+{
+	ExifByteOrder byteOrder;
+	ExifEntry *exifEntry;
+
+	if (!ed)
+		return 0;
+
+	byteOrder = exif_data_get_byte_order(ed);
+	exifEntry = exif_data_get_entry(ed, EXIF_TAG_ORIENTATION);
+	if (!exifEntry)
+		return 0;
+
+	return exif_get_short(exifEntry->data, byteOrder);
+}
+
+/*
+ * Like exif_data_new_from_file, but parses downloads kept in memory in
+ * place.
+ */
+static ExifData *feh_exif_data_new(char *filename)
+{
+	ExifLoader *loader;
+	ExifData *ed;
+	unsigned char *data;
+	size_t len;
+
+	if ((data = feh_http_map(filename, &len)) == NULL)
+		return exif_data_new_from_file(filename);
+
+	loader = exif_loader_new();
+	exif_loader_write(loader, data, len);
+	ed = exif_loader_get_data(loader);
+	exif_loader_unref(loader);
+	munmap(data, len);
+	return ed;
+}
+#endif
+
+#ifdef HAVE_LIBJPEG
+/*
+ * Whether images which were not decoded by Imlib2 need to be rotated
+ * according to their EXIF orientation. Imlib2 >= 1.7.5 does so for
+ * everything it loads, older versions only with --auto-rotate.
+ */
+static int feh_orient_decoded_images(void)
+{
+#if defined(IMLIB2_VERSION_MAJOR) && defined(IMLIB2_VERSION_MINOR) && defined(IMLIB2_VERSION_MICRO) && (IMLIB2_VERSION_MAJOR > 1 || IMLIB2_VERSION_MINOR > 7 || IMLIB2_VERSION_MICRO >= 5)
+	return 1;
+#elif defined(HAVE_LIBEXIF)
+	return opt.auto_rotate;
+#else
+	return 0;
+#endif
+}
+#endif
+
+void feh_image_apply_orientation(Imlib_Image im, int orientation)
+{
+	if (orientation == 2)
+		gib_imlib_image_flip_horizontal(im);
+	else if (orientation == 3)
+		gib_imlib_image_orientate(im, 2);
+	else if (orientation == 4)
+		gib_imlib_image_flip_vertical(im);
+	else if (orientation == 5) {
+		gib_imlib_image_orientate(im, 3);
+		gib_imlib_image_flip_vertical(im);
+	}
+	else if (orientation == 6)
+		gib_imlib_image_orientate(im, 1);
+	else if (orientation == 7) {
+		gib_imlib_image_orientate(im, 3);
+		gib_imlib_image_flip_horizontal(im);
+	}
+	else if (orientation == 8)
+		gib_imlib_image_orientate(im, 3);
+}
+
+enum feh_conversion_mode {
+	CONVERT_WAIT,	/* convert (or download) synchronously */
+	CONVERT_START,	/* start a background conversion or download and return -1 */
+	CONVERT_DEFER	/* return -1 right away */
+};
+
+static int feh_load_image_mode(Imlib_Image * im, feh_file * file,
+		enum feh_conversion_mode mode)
 {
 	Imlib_Load_Error err = IMLIB_LOAD_ERROR_NONE;
 	enum feh_load_error feh_err = LOAD_ERROR_IMLIB;
-	enum { SRC_IMLIB, SRC_HTTP, SRC_MAGICK, SRC_DCRAW } image_source = SRC_IMLIB;
+	enum { SRC_IMLIB, SRC_HTTP, SRC_CONVERSION } image_source = SRC_IMLIB;
 	char *tmpname = NULL;
 	char *real_filename = NULL;
+	int raw;
 
 	D(("filename is %s, image is %p\n", file->filename, im));
 
@@ -342,6 +437,13 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 	if (path_is_url(file->filename)) {
 		image_source = SRC_HTTP;
 
+		if ((mode == CONVERT_START)
+				&& !(opt.use_conversion_cache && conversion_cache
+					&& gib_hash_get(conversion_cache, file->filename))
+				&& feh_http_start(file->filename)
+				&& feh_http_pending(file->filename))
+			return(-1);
+
 		if ((tmpname = feh_http_load_image(file->filename)) == NULL) {
 			feh_err = LOAD_ERROR_CURL;
 			err = IMLIB_LOAD_ERROR_FILE_DOES_NOT_EXIST;
@@ -359,24 +461,37 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 	if (opt.conversion_timeout >= 0 && (
 			(err == IMLIB_LOAD_ERROR_UNKNOWN) ||
 			(err == IMLIB_LOAD_ERROR_NO_LOADER_FOR_FILE_FORMAT))) {
-		if (feh_file_is_raw(file->filename)) {
-			image_source = SRC_DCRAW;
-			tmpname = feh_dcraw_load_image(file->filename);
-			if (!tmpname) {
-				feh_err = LOAD_ERROR_DCRAW;
-			}
+		image_source = SRC_CONVERSION;
+		if (opt.use_conversion_cache && conversion_cache
+				&& (tmpname = gib_hash_get(conversion_cache, file->filename))) {
+			feh_err = LOAD_ERROR_IMLIB;
+		} else if (mode == CONVERT_DEFER) {
+			return(-1);
+		} else if ((mode == CONVERT_START) && feh_conversion_start(file)
+				&& feh_conversion_pending(file)) {
+			return(-1);
+		} else if ((tmpname = feh_conversion_take(file, &raw)) == NULL) {
+			feh_err = raw ? LOAD_ERROR_DCRAW : LOAD_ERROR_IMAGEMAGICK;
 		} else {
-			image_source = SRC_MAGICK;
 			feh_err = LOAD_ERROR_IMLIB;
-			tmpname = feh_magick_load_image(file->filename);
-			if (!tmpname) {
-				feh_err = LOAD_ERROR_IMAGEMAGICK;
+			if (opt.use_conversion_cache) {
+				if (!conversion_cache)
+					conversion_cache = gib_hash_new();
+				gib_hash_set(conversion_cache, file->filename, tmpname);
 			}
 		}
 	}
 
 	if (tmpname) {
-		*im = imlib_load_image_with_error_return(tmpname, &err);
+		if (feh_http_in_memory(tmpname)) {
+			/*
+			 * Imlib2 would cache this by its /proc/self/fd name, which is
+			 * re-used by later downloads.
+			 */
+			if ((*im = imlib_load_image_immediately_without_cache(tmpname)) == NULL)
+				err = IMLIB_LOAD_ERROR_UNKNOWN;
+		} else
+			*im = imlib_load_image_with_error_return(tmpname, &err);
 		if (!err && im) {
 			real_filename = file->filename;
 			file->filename = tmpname;
@@ -385,12 +500,10 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 			 * feh does not associate a non-native image with its temporary
 			 * filename and may delete the temporary file right after loading.
 			 * To ensure that it is still aware of image size, dimensions, etc.,
-			 * file_info is preloaded here. To avoid a memory leak when loading
-			 * a non-native file multiple times in a slideshow, the file_info
-			 * struct is freed first. If file->info is not set, feh_file_info_free
-			 * is a no-op.
+			 * file_info is preloaded here, replacing whatever an earlier load
+			 * of the same file left there.
 			 */
-			feh_file_info_free(file->info);
+			feh_file_info_free(file);
 			feh_file_info_load(file, *im);
 
 			file->filename = real_filename;
@@ -402,13 +515,19 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 			if (file->ed) {
 				exif_data_unref(file->ed);
 			}
-			file->ed = exif_data_new_from_file(tmpname);
+			file->ed = feh_exif_data_new(tmpname);
 #endif
 		}
-		if (!opt.use_conversion_cache && ((image_source != SRC_HTTP) || !opt.keep_http))
-			unlink(tmpname);
+		// conversions in the persistent cache outlive this feh process
+		if (feh_convcache_owns(tmpname))
+			D(("%s is cached on disk\n", tmpname));
+		else if (!opt.use_conversion_cache && ((image_source != SRC_HTTP) || !opt.keep_http)) {
+			if (!feh_http_release(tmpname))
+				unlink(tmpname);
+		}
 		// keep_http already performs an add_file_to_rm_filelist call
-		else if (opt.use_conversion_cache && !opt.keep_http)
+		else if (opt.use_conversion_cache && !opt.keep_http
+				&& !feh_http_in_memory(tmpname))
 			// add_file_to_rm_filelist duplicates tmpname
 			add_file_to_rm_filelist(tmpname);
 
@@ -448,38 +567,173 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 	imlib_image_set_changes_on_disk();
 
 #ifdef HAVE_LIBEXIF
-	int orientation = 0;
-	if (file->ed) {
-		ExifByteOrder byteOrder = exif_data_get_byte_order(file->ed);
-		ExifEntry *exifEntry = exif_data_get_entry(file->ed, EXIF_TAG_ORIENTATION);
-		if (exifEntry && opt.auto_rotate) {
-			orientation = exif_get_short(exifEntry->data, byteOrder);
-		}
-	}
+	if (opt.auto_rotate)
+		feh_image_apply_orientation(*im, feh_exif_orientation(file->ed));
+#endif
 
-	if (orientation == 2)
-		gib_imlib_image_flip_horizontal(*im);
-	else if (orientation == 3)
-		gib_imlib_image_orientate(*im, 2);
-	else if (orientation == 4)
-		gib_imlib_image_flip_vertical(*im);
-	else if (orientation == 5) {
-		gib_imlib_image_orientate(*im, 3);
-		gib_imlib_image_flip_vertical(*im);
+	D(("Loaded ok\n"));
+	return(1);
+}
+
+int feh_load_image(Imlib_Image * im, feh_file * file)
+{
+	return(feh_load_image_mode(im, file, CONVERT_WAIT));
+}
+
+/*
+ * Like feh_load_image, but returns -1 instead of waiting for dcraw or
+ * ImageMagick if file needs to be converted first. With start set, the
+ * conversion is started in the background; feh_conversion_handle_fdset
+ * takes it from there. Likewise, remote files are downloaded in the
+ * background and picked up by feh_http_handle_fdset.
+ */
+int feh_load_image_nowait(Imlib_Image * im, feh_file * file, int start)
+{
+	return(feh_load_image_mode(im, file, start ? CONVERT_START : CONVERT_DEFER));
+}
+
+/*
+ * Like feh_load_image, but the image may be decoded at a reduced size as
+ * long as it is still at least min_w x min_h pixels large. This is much
+ * faster for callers which scale the result down anyway (thumbnails, index
+ * and background setting). orig_w and orig_h are set to the full image size.
+ * A min_w or min_h of 0 requests a full-size image.
+ */
+int feh_load_image_at_least(Imlib_Image * im, feh_file * file, int min_w,
+		int min_h, int *orig_w, int *orig_h)
+{
+#ifdef HAVE_LIBJPEG
+	if ((min_w > 0) && (min_h > 0) && file && file->filename
+			&& !path_is_url(file->filename)) {
+		*im = feh_jpeg_load_scaled(file->filename, min_w, min_h,
+				feh_orient_decoded_images(), orig_w, orig_h);
+		if (*im)
+			return(1);
 	}
-	else if (orientation == 6)
-		gib_imlib_image_orientate(*im, 1);
-	else if (orientation == 7) {
-		gib_imlib_image_orientate(*im, 3);
-		gib_imlib_image_flip_horizontal(*im);
+#else
+	(void) min_w;
+	(void) min_h;
+#endif
+
+	if (!feh_load_image(im, file))
+		return(0);
+
+	*orig_w = gib_imlib_image_get_width(*im);
+	*orig_h = gib_imlib_image_get_height(*im);
+	return(1);
+}
+
+/*
+ * Decodes the part of file which was downloaded so far, at a reduced size
+ * of at least min_w x min_h pixels. The result is scaled to the full image
+ * size, so that it takes up the same space as the finished image will.
+ * Returns 0 if file is no JPEG, if no new data arrived since the last call,
+ * or if there is nothing to show yet.
+ */
+int feh_load_image_partial(Imlib_Image * im, feh_file * file, int min_w,
+		int min_h)
+{
+#ifdef HAVE_LIBJPEG
+	Imlib_Image partial;
+	unsigned char *data;
+	size_t len;
+	int w, h, orig_w, orig_h;
+
+	if (!(data = feh_http_map_partial(file->filename, &len)))
+		return(0);
+
+	partial = feh_jpeg_load_partial(data, len, min_w, min_h,
+			feh_orient_decoded_images(), &orig_w, &orig_h);
+	munmap(data, len);
+	if (!partial)
+		return(0);
+
+	w = gib_imlib_image_get_width(partial);
+	h = gib_imlib_image_get_height(partial);
+	if ((w == orig_w) && (h == orig_h)) {
+		*im = partial;
+		return(1);
 	}
-	else if (orientation == 8)
-		gib_imlib_image_orientate(*im, 3);
+
+	/* no anti-aliasing, this is only shown for a moment */
+	*im = gib_imlib_create_cropped_scaled_image(partial, 0, 0, w, h,
+			orig_w, orig_h, 0);
+	gib_imlib_free_image_and_decache(partial);
+	return(*im != NULL);
+#else
+	(void) im;
+	(void) file;
+	(void) min_w;
+	(void) min_h;
+	return(0);
 #endif
+}
+
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+/*
+ * Loads the preview embedded in the EXIF data of the JPEG file if it is good
+ * enough for a box_w x box_h thumbnail: it must not need to be scaled up, and
+ * its aspect ratio must match the image (many cameras letterbox it to 4:3).
+ */
+static int feh_load_exif_thumbnail(Imlib_Image * im, feh_file * file,
+		int box_w, int box_h, int *orig_w, int *orig_h)
+{
+	ExifData *ed;
+	int w, h, tmp, orientation = 0;
+
+	if (path_is_url(file->filename)
+			|| !feh_jpeg_read_size(file->filename, orig_w, orig_h)
+			|| !(ed = exif_data_new_from_file(file->filename)))
+		return(0);
+
+	*im = NULL;
+	if (ed->data && ed->size)
+		*im = feh_jpeg_load_mem(ed->data, ed->size);
+	if (*im && feh_orient_decoded_images())
+		orientation = feh_exif_orientation(ed);
+	exif_data_unref(ed);
+
+	if (!*im)
+		return(0);
+
+	feh_image_apply_orientation(*im, orientation);
+	if (orientation >= 5) {
+		tmp = *orig_w;
+		*orig_w = *orig_h;
+		*orig_h = tmp;
+	}
+
+	w = gib_imlib_image_get_width(*im);
+	h = gib_imlib_image_get_height(*im);
+
+	if (((w < box_w) && (h < box_h) && (w < *orig_w))
+			|| (labs((long) w * *orig_h - (long) h * *orig_w) * 50 > (long) h * *orig_w)) {
+		D(("%s: EXIF preview %dx%d unsuitable for %dx%d\n",
+					file->filename, w, h, *orig_w, *orig_h));
+		gib_imlib_free_image_and_decache(*im);
+		*im = NULL;
+		return(0);
+	}
 
-	D(("Loaded ok\n"));
 	return(1);
 }
+#endif
+
+/*
+ * Loads file for a thumbnail which fits into box_w x box_h. With
+ * --exif-thumbnails, the preview embedded in the EXIF data is used if it is
+ * large enough; otherwise, this is feh_load_image_at_least.
+ */
+int feh_load_image_thumbnail(Imlib_Image * im, feh_file * file, int box_w,
+		int box_h, int *orig_w, int *orig_h)
+{
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+	if (opt.exif_thumbnails
+			&& feh_load_exif_thumbnail(im, file, box_w, box_h, orig_w, orig_h))
+		return(1);
+#endif
+	return(feh_load_image_at_least(im, file, box_w, box_h, orig_w, orig_h));
+}
 
 void feh_reload_image(winwidget w, int resize, int force_new)
 {
@@ -487,6 +741,8 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 	int len;
 	Imlib_Image tmp;
 	int old_w, old_h;
+	feh_file *file;
+	feh_image_key key;
 
 	if (!w->file) {
 		im_weprintf(w, "couldn't reload, this image has no file associated with it.");
@@ -494,10 +750,40 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 		return;
 	}
 
+	/* slideshow_loaded will load the image once it is converted or downloaded */
+	if (w->converting || w->downloading)
+		return;
+
 	D(("resize %d, force_new %d\n", resize, force_new));
 
-	free(FEH_FILE(w->file->data)->caption);
-	FEH_FILE(w->file->data)->caption = NULL;
+	file = FEH_FILE(w->file->data);
+
+	free(file->caption);
+	file->caption = NULL;
+
+	/* Nothing to do if the file did not change since it was loaded */
+	if (!force_new && feh_image_cache_still_valid(&w->im_key, file)) {
+		winwidget_render_image(w, resize, 0);
+		return;
+	}
+
+	/* A remote file is only downloaded and decoded again if it changed */
+	if (!force_new && path_is_url(file->filename)
+			&& feh_http_unchanged(file->filename)) {
+		winwidget_render_image(w, resize, 0);
+		return;
+	}
+
+	/*
+	 * If the window still shows this file, its image is outdated (or the
+	 * caller wants it to be read from disk again) and must not go back
+	 * into the cache. An image of another file (e.g. in the thumbnail
+	 * viewer) is checked in as usual.
+	 */
+	if (w->im_key.file == file)
+		memset(&w->im_key, 0, sizeof(feh_image_key));
+	if (force_new)
+		feh_image_cache_forget(file);
 
 	len = strlen(w->name) + sizeof("Reloading: ") + 1;
 	new_title = emalloc(len);
@@ -520,11 +806,13 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 	// if it's an external image, our own cache will also get in your way
 	char *sfn;
 	if (opt.use_conversion_cache && conversion_cache && (sfn = gib_hash_get(conversion_cache, FEH_FILE(w->file->data)->filename)) != NULL) {
+		feh_http_release(sfn);
 		free(sfn);
 		gib_hash_set(conversion_cache, FEH_FILE(w->file->data)->filename, NULL);
 	}
 
-	if ((feh_load_image(&tmp, FEH_FILE(w->file->data))) == 0) {
+	feh_image_key_init(&key, file);
+	if (!feh_image_cache_get(&tmp, &key) && (feh_load_image(&tmp, file) == 0)) {
 		if (force_new)
 			eprintf("failed to reload image\n");
 		else {
@@ -542,6 +830,7 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 		winwidget_free_image(w);
 
 	w->im = tmp;
+	w->im_key = key;
 	winwidget_reset_image(w);
 
 	w->mode = MODE_NORMAL;
@@ -564,279 +853,9 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 	return;
 }
 
-static int feh_file_is_raw(char *filename)
-{
-	childpid = fork();
-	if (childpid == -1) {
-		perror("fork");
-		return 0;
-	}
-
-	if (childpid == 0) {
-		int devnull = open("/dev/null", O_WRONLY);
-		dup2(devnull, 1);
-		dup2(devnull, 2);
-		execlp("dcraw", "dcraw", "-i", filename, NULL);
-		_exit(1);
-	} else {
-		int status;
-		do {
-			waitpid(childpid, &status, WUNTRACED);
-			if (WIFEXITED(status)) {
-				return !WEXITSTATUS(status);
-			}
-		} while (!WIFEXITED(status) && !WIFSIGNALED(status));
-	}
-
-	return 0;
-}
-
-static char *feh_dcraw_load_image(char *filename)
-{
-	char *basename;
-	char *tmpname;
-	char *sfn;
-	int fd = -1;
-
-	if (opt.use_conversion_cache) {
-		if (!conversion_cache)
-			conversion_cache = gib_hash_new();
-		if ((sfn = gib_hash_get(conversion_cache, filename)) != NULL)
-			return sfn;
-	}
-
-	basename = strrchr(filename, '/');
-
-	if (basename == NULL)
-		basename = filename;
-	else
-		basename++;
-
-	tmpname = feh_unique_filename("/tmp/", basename);
-
-	if (strlen(tmpname) > (NAME_MAX-6))
-		tmpname[NAME_MAX-7] = '\0';
-
-	sfn = estrjoin("_", tmpname, "XXXXXX", NULL);
-	free(tmpname);
-
-	fd = mkstemp(sfn);
-
-	if (fd == -1) {
-		free(sfn);
-		return NULL;
-	}
-
-	childpid = fork();
-	if (childpid == -1) {
-		weprintf("%s: Can't load with dcraw. Fork failed:", filename);
-		unlink(sfn);
-		free(sfn);
-		close(fd);
-		return NULL;
-	} else if (childpid == 0) {
-		dup2(fd, STDOUT_FILENO);
-		close(fd);
-
-		alarm(opt.conversion_timeout);
-		execlp("dcraw", "dcraw", "-c", "-e", filename, NULL);
-		_exit(1);
-	}
-
-	int status;
-	waitpid(-1, &status, 0);
-	if (WIFSIGNALED(status)) {
-		unlink(sfn);
-		free(sfn);
-		sfn = NULL;
-		if (!opt.quiet)
-			weprintf("%s - Conversion took too long, skipping", filename);
-	}
-
-	if ((sfn != NULL) && opt.use_conversion_cache)
-		gib_hash_set(conversion_cache, filename, sfn);
-
-	return sfn;
-}
-
-static char *feh_magick_load_image(char *filename)
-{
-	char *argv_fn;
-	char *basename;
-	char *tmpname;
-	char *sfn;
-	char tempdir[] = "/tmp/.feh-magick-tmp-XXXXXX";
-	int fd = -1, devnull = -1;
-	int status;
-	char created_tempdir = 0;
-
-	if (opt.use_conversion_cache) {
-		if (!conversion_cache)
-			conversion_cache = gib_hash_new();
-		if ((sfn = gib_hash_get(conversion_cache, filename)) != NULL)
-			return sfn;
-	}
-
-	basename = strrchr(filename, '/');
-
-	if (basename == NULL)
-		basename = filename;
-	else
-		basename++;
-
-	tmpname = feh_unique_filename("/tmp/", basename);
-
-	if (strlen(tmpname) > (NAME_MAX-6))
-		tmpname[NAME_MAX-7] = '\0';
-
-	sfn = estrjoin("_", tmpname, "XXXXXX", NULL);
-	free(tmpname);
-
-	fd = mkstemp(sfn);
-
-	if (fd == -1) {
-		free(sfn);
-		return NULL;
-	}
-
-	/*
-	 * We could use png:fd:(whatever mkstemp returned) as target filename
-	 * for convert, but this seems to be broken in some ImageMagick versions.
-	 * So we resort to png:(sfn) instead.
-	 */
-	argv_fn = estrjoin(":", "png", sfn, NULL);
-
-	/*
-	 * By default, ImageMagick saves (occasionally lots of) temporary files
-	 * in /tmp. It doesn't remove them if it runs into a timeout and is killed
-	 * by us, no matter whether we use SIGINT, SIGTERM or SIGKILL. So, unless
-	 * MAGICK_TMPDIR has already been set by the user, we create our own
-	 * temporary directory for ImageMagick and remove its contents at the end of
-	 * this function.
-	 */
-	if (getenv("MAGICK_TMPDIR") == NULL) {
-		if (mkdtemp(tempdir) == NULL) {
-			weprintf("%s: ImageMagick may leave temporary files in /tmp. mkdtemp failed:", filename);
-		} else {
-			created_tempdir = 1;
-		}
-	}
-
-	if ((childpid = fork()) < 0) {
-		weprintf("%s: Can't load with imagemagick. Fork failed:", filename);
-		unlink(sfn);
-		free(sfn);
-		sfn = NULL;
-	}
-	else if (childpid == 0) {
-
-		devnull = open("/dev/null", O_WRONLY);
-		dup2(devnull, 0);
-		if (opt.quiet) {
-			/* discard convert output */
-			dup2(devnull, 1);
-			dup2(devnull, 2);
-		}
-
-		/*
-		 * convert only accepts SIGINT via killpg, a normal kill doesn't work
-		 */
-		setpgid(0, 0);
-
-		if (created_tempdir) {
-			// no error checking - this is a best-effort code path
-			setenv("MAGICK_TMPDIR", tempdir, 0);
-		}
-
-		execlp("convert", "convert", filename, argv_fn, NULL);
-		_exit(1);
-	}
-	else {
-		alarm(opt.conversion_timeout);
-		waitpid(childpid, &status, 0);
-		kill(childpid, SIGKILL);
-		if (opt.conversion_timeout > 0 && !alarm(0)) {
-			unlink(sfn);
-			free(sfn);
-			sfn = NULL;
-
-			if (!opt.quiet) {
-				weprintf("%s: Conversion took too long, skipping", filename);
-			}
-		}
-		close(fd);
-		childpid = 0;
-	}
-
-	if (created_tempdir) {
-		DIR *dir;
-		struct dirent *de;
-		if ((dir = opendir(tempdir)) == NULL) {
-			weprintf("%s: Cannot remove temporary ImageMagick files from %s:", filename, tempdir);
-		} else {
-			while ((de = readdir(dir)) != NULL) {
-				if (de->d_name[0] != '.') {
-					char *temporary_file_name = estrjoin("/", tempdir, de->d_name, NULL);
-					/*
-					 * We assume that ImageMagick only creates temporary files and
-					 * not directories.
-					 */
-					if (unlink(temporary_file_name) == -1) {
-						weprintf("unlink %s:", temporary_file_name);
-					}
-					free(temporary_file_name);
-				}
-			}
-			if (rmdir(tempdir) == -1) {
-				weprintf("rmdir %s:", tempdir);
-			}
-		}
-		closedir(dir);
-	}
-
-	free(argv_fn);
-
-	if ((sfn != NULL) && opt.use_conversion_cache)
-		gib_hash_set(conversion_cache, filename, sfn);
-
-	return sfn;
-}
-
-#ifdef HAVE_LIBCURL
-
-#if LIBCURL_VERSION_NUM >= 0x072000 /* 07.32.0 */
-static int curl_quit_function(void *clientp,  curl_off_t dltotal,  curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
-#else
-static int curl_quit_function(void *clientp,  double dltotal,  double dlnow, double ultotal, double ulnow)
-#endif
-{
-	// ignore "unused parameter" warnings
-	(void)clientp;
-	(void)dltotal;
-	(void)dlnow;
-	(void)ultotal;
-	(void)ulnow;
-	if (sig_exit) {
-		/*
-		 * The user wants to quit feh. Tell libcurl to abort the transfer and
-		 * return control to the main loop, where we can quit gracefully.
-		 */
-		return 1;
-	}
-	return 0;
-}
-
 static char *feh_http_load_image(char *url)
 {
-	CURL *curl;
-	CURLcode res;
 	char *sfn;
-	FILE *sfp;
-	int fd = -1;
-	char *ebuff;
-	char *tmpname;
-	char *basename;
-	char *path = NULL;
 
 	if (opt.use_conversion_cache) {
 		if (!conversion_cache)
@@ -845,130 +864,12 @@ static char *feh_http_load_image(char *url)
 			return sfn;
 	}
 
-	if (opt.keep_http) {
-		if (opt.output_dir)
-			path = opt.output_dir;
-		else
-			path = "";
-	} else
-		path = "/tmp/";
-
-	curl = curl_easy_init();
-	if (!curl) {
-		weprintf("open url: libcurl initialization failure");
-		return NULL;
-	}
-
-	basename = strrchr(url, '/') + 1;
-
-#ifdef HAVE_MKSTEMPS
-	tmpname = estrjoin("_", "feh_curl_XXXXXX", basename, NULL);
-
-	if (strlen(tmpname) > NAME_MAX) {
-		tmpname[NAME_MAX] = '\0';
-	}
-#else
-	if (strlen(basename) > NAME_MAX-7) {
-		tmpname = estrdup("feh_curl_XXXXXX");
-	} else {
-		tmpname = estrjoin("_", "feh_curl", basename, "XXXXXX", NULL);
-	}
-#endif
-
-	sfn = estrjoin("", path, tmpname, NULL);
-	free(tmpname);
-
-	D(("sfn is %s\n", sfn))
-
-#ifdef HAVE_MKSTEMPS
-	fd = mkstemps(sfn, strlen(basename) + 1);
-#else
-	fd = mkstemp(sfn);
-#endif
-
-	if (fd != -1) {
-		sfp = fdopen(fd, "w+");
-		if (sfp != NULL) {
-#ifdef DEBUG
-			curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-#endif
-			/*
-			 * Do not allow requests to take longer than 30 minutes.
-			 * This should be sufficiently high to accommodate use cases with
-			 * unusually high latencies, while at the same time avoiding
-			 * feh hanging indefinitely in unattended slideshows.
-			 */
-			curl_easy_setopt(curl, CURLOPT_TIMEOUT, 1800);
-			curl_easy_setopt(curl, CURLOPT_URL, url);
-			curl_easy_setopt(curl, CURLOPT_WRITEDATA, sfp);
-			ebuff = emalloc(CURL_ERROR_SIZE);
-			curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, ebuff);
-			curl_easy_setopt(curl, CURLOPT_USERAGENT, PACKAGE "/" VERSION);
-			curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-			curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-#if LIBCURL_VERSION_NUM >= 0x072000 /* 07.32.0 */
-			curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, curl_quit_function);
-#else
-			curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, curl_quit_function);
-#endif
-			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
-			if (opt.insecure_ssl) {
-				curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-				curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-			} else if (getenv("CURL_CA_BUNDLE") != NULL) {
-				// Allow the user to specify custom CA certificates.
-				curl_easy_setopt(curl, CURLOPT_CAINFO,
-						getenv("CURL_CA_BUNDLE"));
-			}
-
-			res = curl_easy_perform(curl);
-			curl_easy_cleanup(curl);
-			if (res != CURLE_OK) {
-				if (res != CURLE_ABORTED_BY_CALLBACK) {
-					weprintf("open url: %s", ebuff);
-				}
-				unlink(sfn);
-				close(fd);
-				free(sfn);
-				sfn = NULL;
-			}
-
-			free(ebuff);
-			fclose(sfp);
-			if (opt.use_conversion_cache)
-				gib_hash_set(conversion_cache, url, sfn);
-			return sfn;
-		} else {
-			weprintf("open url: fdopen failed:");
-			unlink(sfn);
-			free(sfn);
-			close(fd);
-		}
-	} else {
-#ifdef HAVE_MKSTEMPS
-		weprintf("open url: mkstemps failed:");
-#else
-		weprintf("open url: mkstemp failed:");
-#endif
-		free(sfn);
-	}
-	curl_easy_cleanup(curl);
-	return NULL;
-}
-
-#else				/* HAVE_LIBCURL */
-
-char *feh_http_load_image(char *url)
-{
-	weprintf(
-		"Cannot load image %s\nPlease recompile feh with libcurl support",
-		url
-	);
-	return NULL;
+	sfn = feh_http_take(url);
+	if ((sfn != NULL) && opt.use_conversion_cache)
+		gib_hash_set(conversion_cache, url, sfn);
+	return sfn;
 }
 
-#endif				/* HAVE_LIBCURL */
-
 void feh_imlib_image_fill_text_bg(Imlib_Image im, int w, int h)
 {
 	gib_imlib_image_set_has_alpha(im, 1);
@@ -1092,6 +993,41 @@ void feh_draw_errstr(winwidget w)
 	gib_imlib_free_image_and_decache(im);
 }
 
+/*
+ * Shown in place of file while it is still being downloaded, or while dcraw
+ * or ImageMagick is still converting it. w and h are the size of the image it
+ * replaces, or 0 to use a default size.
+ */
+Imlib_Image feh_load_placeholder(feh_file * file, int w, int h)
+{
+	Imlib_Font fn = NULL;
+	Imlib_Image im = NULL;
+	int tw = 0, th = 0;
+	char buf[512];
+
+	if (w <= 0 || h <= 0) {
+		w = 640;
+		h = 480;
+	}
+
+	im = imlib_create_image(w, h);
+	if (!im)
+		eprintf("Couldn't create placeholder image. Out of memory?");
+
+	gib_imlib_image_fill_rectangle(im, 0, 0, w, h, 0, 0, 0, 255);
+
+	fn = feh_load_font(NULL);
+	snprintf(buf, sizeof(buf), "%s %s...",
+			path_is_url(file->filename) ? "Downloading" : "Converting", file->name);
+	gib_imlib_get_text_size(fn, buf, NULL, &tw, &th, IMLIB_TEXT_TO_RIGHT);
+	gib_imlib_text_draw(im, fn, NULL, (w - tw) / 2 + 1, (h - th) / 2 + 1,
+			buf, IMLIB_TEXT_TO_RIGHT, 0, 0, 0, 255);
+	gib_imlib_text_draw(im, fn, NULL, (w - tw) / 2, (h - th) / 2,
+			buf, IMLIB_TEXT_TO_RIGHT, 255, 255, 255, 255);
+
+	return(im);
+}
+
 void feh_draw_filename(winwidget w)
 {
 	static Imlib_Font fn = NULL;
@@ -1099,6 +1035,7 @@ void feh_draw_filename(winwidget w)
 	Imlib_Image im = NULL;
 	char *s = NULL;
 	int len = 0;
+	int num;
 
 	if ((!w->file) || (!FEH_FILE(w->file->data))
 			|| (!FEH_FILE(w->file->data)->filename))
@@ -1110,16 +1047,11 @@ void feh_draw_filename(winwidget w)
 	gib_imlib_get_text_size(fn, FEH_FILE(w->file->data)->filename, NULL, &tw,
 			&th, IMLIB_TEXT_TO_RIGHT);
 
-	if (gib_list_length(filelist) > 1) {
-		len = snprintf(NULL, 0, "%d of %d",  gib_list_length(filelist),
-				gib_list_length(filelist)) + 1;
+	if ((num = feh_filelist_length()) > 1) {
+		len = snprintf(NULL, 0, "%d of %d", num, num) + 1;
 		s = emalloc(len);
-		if (w->file)
-			snprintf(s, len, "%d of %d", gib_list_num(filelist, w->file) +
-					1, gib_list_length(filelist));
-		else
-			snprintf(s, len, "%d of %d", gib_list_num(filelist, current_file) +
-					1, gib_list_length(filelist));
+		snprintf(s, len, "%d of %d",
+				feh_filelist_num(FEH_FILE(w->file->data)) + 1, num);
 
 		gib_imlib_get_text_size(fn, s, NULL, &nw, NULL, IMLIB_TEXT_TO_RIGHT);
 
@@ -1535,6 +1467,9 @@ void feh_edit_inplace(winwidget w, int op)
 	if (!w->file || !w->file->data || !FEH_FILE(w->file->data)->filename)
 		return;
 
+	/* w->im no longer matches the file, so keep it out of the image cache */
+	memset(&w->im_key, 0, sizeof(feh_image_key));
+
 	if (!opt.edit) {
 		imlib_context_set_image(w->im);
 		if (op == INPLACE_EDIT_FLIP)
@@ -28,6 +28,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "filelist.h"
 #include "winwidget.h"
 #include "options.h"
+#include "http.h"
 #include "index.h"
 
 
@@ -54,6 +55,7 @@ void init_index_mode(void)
 	int vertical = 0;
 	int max_column_w = 0;
 	int thumbnailcount = 0;
+	int orig_w, orig_h;
 	gib_list *l = NULL, *last = NULL;
 	feh_file *file = NULL;
 	int lineno;
@@ -182,8 +184,10 @@ void init_index_mode(void)
 			filelist = feh_file_remove_from_list(filelist, last);
 			last = NULL;
 		}
+		feh_http_prefetch(l, opt.parallel_downloads);
 		D(("About to load image %s\n", file->filename));
-		if (feh_load_image(&im_temp, file) != 0) {
+		if (feh_load_image_thumbnail(&im_temp, file, opt.thumb_w, opt.thumb_h,
+					&orig_w, &orig_h) != 0) {
 			if (opt.verbose)
 				feh_display_status('.');
 			D(("Successfully loaded %s\n", file->filename));
@@ -444,7 +448,7 @@ void get_index_string_dim(feh_file *file, Imlib_Font fn, int *fw, int *fh)
 	if (file == NULL) {
 		fake_file = 1;
 		file = feh_file_new("foo");
-		file->info = feh_file_info_new();
+		feh_file_info_new(file);
 	}
 
 	line = lines = feh_wrap_string(create_index_string(file), opt.thumb_w * 3, fn, NULL);
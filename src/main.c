@@ -32,6 +32,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "events.h"
 #include "signals.h"
 #include "wallpaper.h"
+#include "prefetch.h"
+#include "conversion.h"
+#include "http.h"
+#include "scan.h"
+#include "imagecache.h"
 #include <termios.h>
 
 #ifdef HAVE_INOTIFY
@@ -138,8 +143,10 @@ int feh_main_iteration(int block)
 	static double pt = 0.0;
 	XEvent ev;
 	struct timeval tval;
-	fd_set fdset;
+	fd_set fdset, wfdset, efdset;
 	int count = 0;
+	long http_timeout;
+	int http_due = 0;
 	double t1 = 0.0, t2 = 0.0;
 	fehtimer ft;
 
@@ -203,6 +210,16 @@ int feh_main_iteration(int block)
             fdsize = opt.inotify_fd + 1;
     }
 #endif
+	feh_prefetch_fdset(&fdset, &fdsize);
+	feh_conversion_fdset(&fdset, &fdsize);
+	feh_scan_fdset(&fdset, &fdsize);
+	feh_filelist_stream_fdset(&fdset, &fdsize);
+
+	/* libcurl also waits for sockets to become writable */
+	FD_ZERO(&wfdset);
+	FD_ZERO(&efdset);
+	feh_http_fdset(&fdset, &wfdset, &efdset, &fdsize);
+	http_timeout = feh_http_timeout();
 
 	/* Timers */
 	ft = first_timer;
@@ -227,20 +244,27 @@ int feh_main_iteration(int block)
 		/* Only do a blocking select if there's a timer due, or no events
 		   waiting */
 		if (t1 == 0.0 || (block && !XPending(disp))) {
-			tval.tv_sec = (long) t1;
-			tval.tv_usec = (long) ((t1 - ((double) tval.tv_sec)) * 1000000);
+			/* wake up early if libcurl needs attention before the timer */
+			if ((http_timeout >= 0) && (http_timeout < t1 * 1000)) {
+				tval.tv_sec = http_timeout / 1000;
+				tval.tv_usec = (http_timeout % 1000) * 1000;
+				http_due = 1;
+			} else {
+				tval.tv_sec = (long) t1;
+				tval.tv_usec = (long) ((t1 - ((double) tval.tv_sec)) * 1000000);
+			}
 			if (tval.tv_sec < 0)
 				tval.tv_sec = 0;
 			if (tval.tv_usec <= 1000)
 				tval.tv_usec = 1000;
 			errno = 0;
 			D(("Performing blocking select - waiting for timer or event\n"));
-			count = select(fdsize, &fdset, NULL, NULL, &tval);
+			count = select(fdsize, &fdset, &wfdset, &efdset, &tval);
 			if ((count < 0)
 					&& ((errno == ENOMEM) || (errno == EINVAL)
 						|| (errno == EBADF)))
 				eprintf("Connection to X display lost");
-			if (count == 0) {
+			if ((count == 0) && !http_due) {
 				/* This means the timer is due to be executed. If count was > 0,
 				   that would mean an X event had woken us, we're not interested
 				   in that */
@@ -257,13 +281,26 @@ int feh_main_iteration(int block)
 			else if ((count > 0) && (FD_ISSET(opt.inotify_fd, &fdset)))
                 feh_event_handle_inotify();
 #endif
+			if (count > 0) {
+				feh_prefetch_handle_fdset(&fdset);
+				feh_conversion_handle_fdset(&fdset);
+				feh_scan_handle_fdset(&fdset);
+				feh_filelist_stream_handle_fdset(&fdset);
+			}
+			if (count >= 0)
+				feh_http_handle_fdset();
 		}
 	} else {
 		/* Don't block if there are events in the queue. That's a bit rude ;-) */
 		if (block && !XPending(disp)) {
 			errno = 0;
 			D(("Performing blocking select - no timers, or zooming\n"));
-			count = select(fdsize, &fdset, NULL, NULL, NULL);
+			if (http_timeout >= 0) {
+				tval.tv_sec = http_timeout / 1000;
+				tval.tv_usec = (http_timeout % 1000) * 1000;
+			}
+			count = select(fdsize, &fdset, &wfdset, &efdset,
+					http_timeout >= 0 ? &tval : NULL);
 			if ((count < 0)
 					&& ((errno == ENOMEM) || (errno == EINVAL)
 						|| (errno == EBADF)))
@@ -274,6 +311,14 @@ int feh_main_iteration(int block)
 			else if ((count > 0) && (FD_ISSET(opt.inotify_fd, &fdset)))
                 feh_event_handle_inotify();
 #endif
+			if (count > 0) {
+				feh_prefetch_handle_fdset(&fdset);
+				feh_conversion_handle_fdset(&fdset);
+				feh_scan_handle_fdset(&fdset);
+				feh_filelist_stream_handle_fdset(&fdset);
+			}
+			if (count >= 0)
+				feh_http_handle_fdset();
 		}
 	}
 	if (window_num == 0 || sig_exit != 0)
@@ -288,6 +333,16 @@ int feh_main_iteration(int block)
 
 void feh_clean_exit(void)
 {
+	feh_prefetch_cancel_all();
+	feh_conversion_cancel_all();
+	feh_http_cancel_all();
+	feh_scan_cancel_all();
+
+	if (opt.verbose) {
+		feh_filelist_print_stats();
+		feh_image_cache_print_stats();
+	}
+
 	delete_rm_files();
 
 	free(opt.menu_font);
@@ -30,6 +30,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "winwidget.h"
 #include "filelist.h"
 #include "options.h"
+#include "sort.h"
 
 Window menu_cover = 0;
 feh_menu *menu_root = NULL;
@@ -1273,37 +1274,49 @@ void feh_menu_cb(feh_menu * m, feh_menu_item * i, int action, unsigned short dat
 			feh_filelist_image_remove(m->fehwin, 1);
 			break;
 		case CB_SORT_FILENAME:
-			filelist = gib_list_sort(filelist, feh_cmp_filename);
+			feh_filelist_stream_finish();
+			filelist = feh_filelist_sort(filelist, SORT_FILENAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_IMAGENAME:
-			filelist = gib_list_sort(filelist, feh_cmp_name);
+			feh_filelist_stream_finish();
+			filelist = feh_filelist_sort(filelist, SORT_NAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_DIRNAME:
-			filelist = gib_list_sort(filelist, feh_cmp_dirname);
+			feh_filelist_stream_finish();
+			filelist = feh_filelist_sort(filelist, SORT_DIRNAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_MTIME:
-			filelist = gib_list_sort(filelist, feh_cmp_mtime);
+			feh_filelist_stream_finish();
+			filelist = feh_filelist_sort(filelist, SORT_MTIME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_FILESIZE:
-			filelist = gib_list_sort(filelist, feh_cmp_size);
+			feh_filelist_stream_finish();
+			filelist = feh_filelist_sort(filelist, SORT_SIZE);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_RANDOMIZE:
+			feh_filelist_stream_finish();
 			filelist = gib_list_randomize(filelist);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
@@ -0,0 +1,430 @@
+/* metacache.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "metacache.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define METACACHE_MAGIC "fehmeta1"
+
+/*
+ * The index file consists of a header, a table of buckets (each holding an
+ * entry number + 1, or 0), the entries and a pool of NUL-terminated strings.
+ * Collisions are resolved by linear probing.
+ */
+typedef struct {
+	char magic[8];
+	/* see feh_metacache_key */
+	uint32_t key;
+	uint32_t count;
+	uint32_t buckets;
+	uint32_t entry_size;
+	uint64_t strings;
+} feh_metacache_header;
+
+typedef struct {
+	uint64_t hash;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	int64_t size;
+	/* offsets into the string pool */
+	uint32_t path;
+	uint32_t format;
+	int32_t width;
+	int32_t height;
+	uint8_t has_alpha;
+	/* whether the image was decoded, or only its header read */
+	uint8_t decoded;
+	uint8_t pad[6];
+} feh_metacache_entry;
+
+typedef struct {
+	uint32_t *table;
+	uint32_t buckets;
+	feh_metacache_entry *entries;
+	uint32_t count;
+	char *strings;
+	uint64_t strings_size;
+} feh_metacache_view;
+
+/* an entry added or removed in this run */
+typedef struct {
+	char *path;
+	feh_metacache_entry entry;
+	char *format;
+	unsigned char removed;
+} feh_metacache_change;
+
+static char *cache_file = NULL;
+static int cache_open = 0;
+
+/* the index as of feh_metacache_open */
+static void *map = NULL;
+static size_t map_size = 0;
+static feh_metacache_view index_view;
+
+static feh_metacache_change *changes = NULL;
+static unsigned int change_count = 0;
+static unsigned int change_size = 0;
+
+/*
+ * Index files written for a different Imlib2 version or --auto-rotate
+ * setting may hold other format names or sizes, so they are not used.
+ */
+static uint32_t feh_metacache_key(void)
+{
+	uint32_t key = 0;
+
+#if defined(IMLIB2_VERSION_MAJOR) && defined(IMLIB2_VERSION_MINOR) && defined(IMLIB2_VERSION_MICRO)
+	key = (IMLIB2_VERSION_MAJOR << 16) | (IMLIB2_VERSION_MINOR << 8)
+		| IMLIB2_VERSION_MICRO;
+#endif
+#ifdef HAVE_LIBEXIF
+	if (opt.auto_rotate)
+		key |= 1U << 31;
+#endif
+	return key;
+}
+
+static feh_metacache_entry *feh_metacache_find(feh_metacache_view * view,
+		char *path, uint64_t hash)
+{
+	uint32_t i, n;
+	feh_metacache_entry *entry;
+
+	if (!view->buckets)
+		return NULL;
+
+	for (i = hash & (view->buckets - 1); (n = view->table[i]);
+			i = (i + 1) & (view->buckets - 1)) {
+		if (n > view->count)
+			return NULL;
+		entry = &view->entries[n - 1];
+		if ((entry->hash == hash) && (entry->path < view->strings_size)
+				&& !strcmp(view->strings + entry->path, path))
+			return entry;
+	}
+	return NULL;
+}
+
+void feh_metacache_open(void)
+{
+	char *dir;
+	int fd;
+	struct stat st;
+	feh_metacache_header *header;
+	uint64_t size;
+
+	if (cache_open || !opt.cache_metadata)
+		return;
+	cache_open = 1;
+	/* before the probe threads look up paths */
+	feh_full_path_init();
+
+	if (!(dir = feh_cache_dir("metadata")))
+		return;
+	cache_file = estrjoin("/", dir, "index", NULL);
+	free(dir);
+
+	if ((fd = open(cache_file, O_RDONLY | O_CLOEXEC)) == -1)
+		return;
+	if (!fstat(fd, &st) && (st.st_size >= (off_t) sizeof(feh_metacache_header)))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!map || (map == MAP_FAILED)) {
+		map = NULL;
+		return;
+	}
+	map_size = st.st_size;
+
+	header = map;
+	size = sizeof(feh_metacache_header)
+		+ (uint64_t) header->buckets * sizeof(uint32_t)
+		+ (uint64_t) header->count * sizeof(feh_metacache_entry)
+		+ header->strings;
+	if (memcmp(header->magic, METACACHE_MAGIC, 8)
+			|| (header->key != feh_metacache_key())
+			|| (header->entry_size != sizeof(feh_metacache_entry))
+			|| (header->buckets & (header->buckets - 1))
+			|| (header->count >= header->buckets)
+			|| (size != map_size) || !header->strings
+			|| ((char *) map)[map_size - 1]) {
+		D(("ignoring invalid metadata index %s\n", cache_file));
+		munmap(map, map_size);
+		map = NULL;
+		return;
+	}
+
+	index_view.table = (uint32_t *) (header + 1);
+	index_view.buckets = header->buckets;
+	index_view.entries = (feh_metacache_entry *) (index_view.table + header->buckets);
+	index_view.count = header->count;
+	index_view.strings = (char *) (index_view.entries + header->count);
+	index_view.strings_size = header->strings;
+	D(("metadata index %s has %u entries\n", cache_file, header->count));
+}
+
+/*
+ * Fills in probe from the index if probe->mtime and probe->size still match.
+ * Only reads the mmap'ed index, so it is safe to call from several threads.
+ */
+int feh_metacache_lookup(feh_probe * probe)
+{
+	char buf[PATH_MAX];
+	char *path;
+	feh_metacache_entry *entry;
+
+	if (!map || !(path = feh_full_path(probe->filename, buf, sizeof(buf))))
+		return 0;
+
+	entry = feh_metacache_find(&index_view, path, feh_hash64(path));
+	if (!entry || (entry->mtime != probe->mtime)
+			|| (entry->mtime_nsec != probe->mtime_nsec)
+			|| (entry->size != probe->size)
+			|| (entry->format >= index_view.strings_size))
+		return 0;
+
+	probe->width = entry->width;
+	probe->height = entry->height;
+	probe->has_alpha = entry->has_alpha;
+	probe->format = index_view.strings + entry->format;
+	probe->decoded = entry->decoded;
+	probe->cached = 1;
+	probe->ok = 1;
+	return 1;
+}
+
+static void feh_metacache_change_add(char *filename, feh_file_info * info,
+		feh_probe * probe)
+{
+	char buf[PATH_MAX];
+	char *path;
+	feh_metacache_change *change;
+
+	if (!cache_file || !(path = feh_full_path(filename, buf, sizeof(buf))))
+		return;
+
+	if (change_count == change_size) {
+		change_size = change_size ? change_size * 2 : 1024;
+		changes = erealloc(changes, change_size * sizeof(feh_metacache_change));
+	}
+	change = &changes[change_count++];
+	memset(change, 0, sizeof(feh_metacache_change));
+	change->path = estrdup(path);
+	change->entry.hash = feh_hash64(path);
+	if (!info) {
+		change->removed = 1;
+		return;
+	}
+	change->entry.mtime = probe->mtime;
+	change->entry.mtime_nsec = probe->mtime_nsec;
+	change->entry.size = probe->size;
+	change->entry.width = info->width;
+	change->entry.height = info->height;
+	change->entry.has_alpha = info->has_alpha;
+	change->entry.decoded = !info->probed;
+	change->format = estrdup(info->format);
+}
+
+/*
+ * Records the info of a file which was not in the index (or had changed).
+ * probe holds the stat(2) data it was read with.
+ */
+void feh_metacache_store(feh_file * file, feh_probe * probe)
+{
+	if (file->info && file->info->format)
+		feh_metacache_change_add(file->filename, file->info, probe);
+}
+
+/*
+ * Drops the entry of a file which no longer exists.
+ */
+void feh_metacache_forget(char *filename)
+{
+	char buf[PATH_MAX];
+	char *path;
+
+	if (map && (path = feh_full_path(filename, buf, sizeof(buf)))
+			&& feh_metacache_find(&index_view, path, feh_hash64(path)))
+		feh_metacache_change_add(filename, NULL, NULL);
+}
+
+static uint32_t feh_metacache_intern(char **pool, uint64_t * pool_len,
+		uint64_t * pool_size, char *str)
+{
+	uint64_t len = strlen(str) + 1, offset = *pool_len;
+
+	if (*pool_len + len > *pool_size) {
+		while (*pool_len + len > *pool_size)
+			*pool_size = *pool_size ? *pool_size * 2 : 65536;
+		*pool = erealloc(*pool, *pool_size);
+	}
+	memcpy(*pool + offset, str, len);
+	*pool_len += len;
+	return offset;
+}
+
+/*
+ * Adds entry to view unless its path is already there. Newer entries are
+ * added first, so they win.
+ */
+static void feh_metacache_insert(feh_metacache_view * view, uint64_t * pool_size,
+		char *path, feh_metacache_entry * entry, char *format, char **formats,
+		uint32_t * format_offsets, int *format_count)
+{
+	uint32_t i;
+	int f;
+
+	if (feh_metacache_find(view, path, entry->hash))
+		return;
+
+	for (f = 0; (f < *format_count) && strcmp(formats[f], format); f++);
+	if (f == *format_count) {
+		if (f == 64)
+			return;
+		formats[f] = format;
+		format_offsets[f] = feh_metacache_intern(&view->strings,
+				&view->strings_size, pool_size, format);
+		(*format_count)++;
+	}
+
+	view->entries[view->count] = *entry;
+	view->entries[view->count].path = feh_metacache_intern(&view->strings,
+			&view->strings_size, pool_size, path);
+	view->entries[view->count].format = format_offsets[f];
+	view->count++;
+
+	for (i = entry->hash & (view->buckets - 1); view->table[i];
+			i = (i + 1) & (view->buckets - 1));
+	view->table[i] = view->count;
+}
+
+/*
+ * Writes the index with this run's changes merged in, if there are any.
+ */
+void feh_metacache_save(void)
+{
+	feh_metacache_view view;
+	feh_metacache_header header;
+	uint64_t pool_size = 0, total;
+	char *formats[64];
+	uint32_t format_offsets[64];
+	int format_count = 0;
+	char *tmpname;
+	unsigned int i;
+	int fd, err;
+	FILE *fp;
+	char empty[1] = "";
+
+	if (!change_count)
+		return;
+
+	total = change_count + index_view.count;
+	memset(&view, 0, sizeof(view));
+	for (view.buckets = 1024; view.buckets < 2 * total; view.buckets *= 2);
+	view.table = emalloc(view.buckets * sizeof(uint32_t));
+	memset(view.table, 0, view.buckets * sizeof(uint32_t));
+	view.entries = emalloc(total * sizeof(feh_metacache_entry));
+
+	/* format offset 0 marks removed files */
+	formats[0] = empty;
+	format_offsets[0] = feh_metacache_intern(&view.strings, &view.strings_size,
+			&pool_size, empty);
+	format_count = 1;
+
+	for (i = change_count; i-- > 0;)
+		feh_metacache_insert(&view, &pool_size, changes[i].path,
+				&changes[i].entry, changes[i].removed ? empty : changes[i].format,
+				formats, format_offsets, &format_count);
+	for (i = 0; i < index_view.count; i++)
+		if (index_view.entries[i].path < index_view.strings_size
+				&& index_view.entries[i].format < index_view.strings_size)
+			feh_metacache_insert(&view, &pool_size,
+					index_view.strings + index_view.entries[i].path,
+					&index_view.entries[i],
+					index_view.strings + index_view.entries[i].format,
+					formats, format_offsets, &format_count);
+
+	/*
+	 * Removed files got an entry (and bucket) above, so that older entries
+	 * with their path were skipped. They are dropped by rebuilding the table.
+	 */
+	total = view.count;
+	view.count = 0;
+	memset(view.table, 0, view.buckets * sizeof(uint32_t));
+	for (i = 0; i < total; i++) {
+		uint32_t b;
+
+		if (view.entries[i].format == 0)
+			continue;
+		view.entries[view.count] = view.entries[i];
+		for (b = view.entries[i].hash & (view.buckets - 1); view.table[b];
+				b = (b + 1) & (view.buckets - 1));
+		view.table[b] = ++view.count;
+	}
+
+	memcpy(header.magic, METACACHE_MAGIC, 8);
+	header.key = feh_metacache_key();
+	header.count = view.count;
+	header.buckets = view.buckets;
+	header.entry_size = sizeof(feh_metacache_entry);
+	header.strings = view.strings_size;
+
+	tmpname = estrjoin(".", cache_file, "XXXXXX", NULL);
+	if ((fd = mkstemp(tmpname)) == -1 || !(fp = fdopen(fd, "w"))) {
+		weprintf("cannot write metadata index %s:", tmpname);
+		if (fd != -1)
+			close(fd);
+	} else {
+		fwrite(&header, sizeof(header), 1, fp);
+		fwrite(view.table, sizeof(uint32_t), view.buckets, fp);
+		fwrite(view.entries, sizeof(feh_metacache_entry), view.count, fp);
+		fwrite(view.strings, 1, view.strings_size, fp);
+		err = ferror(fp);
+		if (fclose(fp))
+			err = 1;
+		if (err || rename(tmpname, cache_file)) {
+			weprintf("cannot write metadata index %s:", cache_file);
+			unlink(tmpname);
+		} else {
+			D(("wrote %u entries to %s\n", view.count, cache_file));
+		}
+	}
+
+	free(tmpname);
+	free(view.table);
+	free(view.entries);
+	free(view.strings);
+	for (i = 0; i < change_count; i++) {
+		free(changes[i].path);
+		free(changes[i].format);
+	}
+	change_count = 0;
+}
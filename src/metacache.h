@@ -0,0 +1,45 @@
+/* metacache.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef METACACHE_H
+#define METACACHE_H
+
+#include "probe.h"
+
+/*
+ * With --cache-metadata, the size, alpha channel and format of preloaded
+ * images are kept in $XDG_CACHE_HOME/feh/metadata/index, keyed by absolute
+ * path and checked against size and mtime of the file. The index is a hash
+ * table which is mmap'ed and searched in place, so a warm start only costs
+ * a stat(2) per file. It is rewritten after a preload run which changed it.
+ */
+
+void feh_metacache_open(void);
+int feh_metacache_lookup(feh_probe * probe);
+void feh_metacache_store(feh_file * file, feh_probe * probe);
+void feh_metacache_forget(char *filename);
+void feh_metacache_save(void);
+
+#endif
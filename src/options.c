@@ -28,6 +28,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "feh.h"
 #include "filelist.h"
 #include "options.h"
+#include "prefetch.h"
+#include "refresh.h"
 
 static void check_options(void);
 static void feh_getopt_theme(int argc, char **argv);
@@ -82,6 +84,7 @@ void init_parse_options(int argc, char **argv)
 	opt.auto_reload = 1;
 #endif				/* HAVE_INOTIFY */
 	opt.use_conversion_cache = 1;
+	opt.parallel_downloads = 4;
 
 	feh_getopt_theme(argc, argv);
 
@@ -103,6 +106,10 @@ void init_parse_options(int argc, char **argv)
 
 	D(("Options parsed\n"));
 
+	/* The directory scan may still be looking for the first file */
+	if (!filelist)
+		feh_filelist_stream_wait();
+
 	filelist_len = gib_list_length(filelist);
 	if (!filelist_len)
 		show_mini_usage();
@@ -421,6 +428,9 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 #ifdef HAVE_LIBEXIF
 		{"draw-exif"     , 0, 0, OPTION_draw_exif},
 		{"auto-rotate"   , 0, 0, OPTION_auto_rotate},
+#endif
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+		{"exif-thumbnails", 0, 0, OPTION_exif_thumbnails},
 #endif
 		{"no-xinerama"   , 0, 0, OPTION_no_xinerama},
 		{"draw-tinted"   , 0, 0, OPTION_draw_tinted},
@@ -444,6 +454,13 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 		{"class"         , 1, 0, OPTION_class},
 		{"no-conversion-cache", 0, 0, OPTION_no_conversion_cache},
 		{"window-id", 1, 0, OPTION_window_id},
+		{"prefetch"      , 1, 0, OPTION_prefetch},
+		{"image-cache-size", 1, 0, OPTION_image_cache_size},
+		{"conversion-cache-size", 1, 0, OPTION_conversion_cache_size},
+		{"parallel-downloads", 1, 0, OPTION_parallel_downloads},
+		{"cache-metadata", 0, 0, OPTION_cache_metadata},
+		{"cache-atlas", 0, 0, OPTION_cache_atlas},
+		{"thumb-cache-size", 1, 0, OPTION_thumb_cache_size},
 		{0, 0, 0, 0}
 	};
 	int optch = 0, cmdx = 0;
@@ -879,6 +896,46 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 		case OPTION_window_id:
 			opt.x11_windowid = strtol(optarg, NULL, 0);
 			break;
+		case OPTION_prefetch:
+			{
+				int ahead, behind = opt.prefetch_behind;
+
+				if ((sscanf(optarg, "%d,%d", &ahead, &behind) < 1)
+						|| (ahead < 0) || (ahead > PREFETCH_MAX)
+						|| (behind < 0) || (behind > PREFETCH_MAX))
+					weprintf("--prefetch: expected AHEAD[,BEHIND] between 0 and %d, got \"%s\"",
+							PREFETCH_MAX, optarg);
+				else {
+					opt.prefetch_ahead = ahead;
+					opt.prefetch_behind = behind;
+				}
+			}
+			break;
+		case OPTION_image_cache_size:
+			opt.image_cache_size = strtoul(optarg, NULL, 10);
+			break;
+		case OPTION_conversion_cache_size:
+			opt.conversion_cache_size = strtoul(optarg, NULL, 10);
+			break;
+		case OPTION_parallel_downloads:
+			opt.parallel_downloads = strtoul(optarg, NULL, 10);
+			if (!opt.parallel_downloads)
+				opt.parallel_downloads = 1;
+			break;
+		case OPTION_cache_metadata:
+			opt.cache_metadata = 1;
+			break;
+		case OPTION_cache_atlas:
+			opt.cache_atlas = 1;
+			break;
+		case OPTION_thumb_cache_size:
+			opt.thumb_cache_size = strtoul(optarg, NULL, 10);
+			break;
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+		case OPTION_exif_thumbnails:
+			opt.exif_thumbnails = 1;
+			break;
+#endif
 		case OPTION_zoom_step:
 			opt.zoom_rate = atof(optarg);
 			if ((opt.zoom_rate <= 0)) {
@@ -893,6 +950,13 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 		}
 	}
 
+	/* With the options known, decide how the filelist is built */
+	if (finalrun) {
+		feh_filelist_stream_begin(optind < argc);
+		if (opt.reload)
+			feh_filelist_watch();
+	}
+
 	/* Now the leftovers, which must be files */
 	if (optind < argc) {
 		while (optind < argc) {
@@ -1010,10 +1074,22 @@ static void show_version(void)
 		"help "
 #endif
 
+#ifdef HAVE_LIBJPEG
+		"jpeg "
+#endif
+
 #ifdef HAVE_LIBMAGIC
 		"magic "
 #endif
 
+#ifdef HAVE_MEMFD_CREATE
+		"memfd "
+#endif
+
+#ifdef HAVE_PTHREAD
+		"pthread "
+#endif
+
 #if _FILE_OFFSET_BITS == 64
 		"stat64 "
 #endif
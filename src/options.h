@@ -70,6 +70,9 @@ struct __fehoptions {
 	unsigned char draw_exif;
 	unsigned char auto_rotate;
 #endif
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+	unsigned char exif_thumbnails;
+#endif
 #ifdef HAVE_INOTIFY
 	unsigned char auto_reload;
     int inotify_fd;
@@ -89,6 +92,8 @@ struct __fehoptions {
 	unsigned char draw_actions;
 	unsigned char draw_info;
 	unsigned char cache_thumbnails;
+	unsigned char cache_metadata;
+	unsigned char cache_atlas;
 	unsigned char on_last_slide;
 	unsigned char hold_actions[10];
 	unsigned char text_bg;
@@ -151,6 +156,20 @@ struct __fehoptions {
 	// imlib cache size in mebibytes
 	int cache_size;
 
+	// decoded image cache size in mebibytes
+	unsigned int image_cache_size;
+	unsigned int thumb_cache_size;
+
+	// size limit of the on-disk conversion cache in mebibytes
+	unsigned int conversion_cache_size;
+
+	// number of slides to decode in the background
+	unsigned int prefetch_ahead;
+	unsigned int prefetch_behind;
+
+	// number of simultaneous HTTP(S) downloads
+	unsigned int parallel_downloads;
+
 	unsigned int min_width, min_height, max_width, max_height;
 
 	unsigned char mode;
@@ -270,6 +289,14 @@ OPTION_window_id,
 OPTION_transition,
 OPTION_transition_steps,
 OPTION_transition_duration,
+OPTION_prefetch,
+OPTION_image_cache_size,
+OPTION_exif_thumbnails,
+OPTION_conversion_cache_size,
+OPTION_parallel_downloads,
+OPTION_cache_metadata,
+OPTION_cache_atlas,
+OPTION_thumb_cache_size,
 };
 
 //typedef enum __fehoption fehoption;
@@ -0,0 +1,419 @@
+/* prefetch.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "prefetch.h"
+#include "conversion.h"
+#include "scan.h"
+
+#include <fcntl.h>
+
+enum prefetch_state { PREFETCH_RUNNING, PREFETCH_DONE, PREFETCH_FAILED };
+
+typedef struct {
+	feh_file *file;
+	pid_t pid;
+	int fd;
+	enum prefetch_state state;
+	feh_prefetch_header header;
+	size_t received;
+	Imlib_Image im;
+	DATA32 *data;
+	/* the worker found that file needs dcraw / convert, which we started */
+	unsigned char converting;
+} feh_prefetch_slot;
+
+static gib_list *slots = NULL;
+
+static feh_prefetch_slot *feh_prefetch_find(feh_file * file)
+{
+	gib_list *l;
+
+	for (l = slots; l; l = l->next)
+		if (((feh_prefetch_slot *) l->data)->file == file)
+			return(l->data);
+	return(NULL);
+}
+
+/*
+ * Runs in the forked child. It must never return, since returning would run
+ * the atexit handlers (and thus XCloseDisplay and friends) of the parent.
+ */
+static void feh_prefetch_worker(feh_file * file, int fd)
+{
+	Imlib_Image im = NULL;
+	feh_prefetch_header header;
+	DATA32 *data;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+
+	/*
+	 * Errors are reported by the fallback in the parent. Files which need
+	 * dcraw or ImageMagick are reported back with ok = -1, the parent then
+	 * runs the conversion itself since its jobs are tracked in parent-only
+	 * state.
+	 */
+	opt.quiet = 1;
+	opt.verbose = 0;
+
+	memset(&header, 0, sizeof(header));
+	feh_image_key_init(&header.key, file);
+
+	if ((header.ok = feh_load_image_nowait(&im, file, 0)) > 0) {
+		imlib_context_set_image(im);
+		header.ok = 1;
+		header.width = imlib_image_get_width();
+		header.height = imlib_image_get_height();
+		header.has_alpha = imlib_image_has_alpha();
+		if (imlib_image_format())
+			strncpy(header.format, imlib_image_format(),
+					sizeof(header.format) - 1);
+	}
+
+	if (!feh_io_all(fd, &header, sizeof(header), -1, 0))
+		_exit(1);
+
+	if (header.ok > 0) {
+		data = imlib_image_get_data_for_reading_only();
+		if (!feh_io_all(fd, data,
+				(size_t) header.width * header.height * sizeof(DATA32), -1, 0))
+			_exit(1);
+	}
+	_exit(0);
+}
+
+static void feh_prefetch_start(feh_file * file)
+{
+	feh_prefetch_slot *slot;
+	int pipefd[2];
+	pid_t pid;
+
+	if (pipe(pipefd) == -1) {
+		D(("pipe failed: %s\n", strerror(errno)));
+		return;
+	}
+
+	if ((pid = fork()) < 0) {
+		D(("fork failed: %s\n", strerror(errno)));
+		close(pipefd[0]);
+		close(pipefd[1]);
+		return;
+	} else if (pid == 0) {
+		close(pipefd[0]);
+		feh_prefetch_worker(file, pipefd[1]);
+	}
+
+	close(pipefd[1]);
+	fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+
+	D(("started worker %d for %s\n", pid, file->filename));
+
+	slot = emalloc(sizeof(feh_prefetch_slot));
+	memset(slot, 0, sizeof(feh_prefetch_slot));
+	slot->file = file;
+	slot->pid = pid;
+	slot->fd = pipefd[0];
+	slot->state = PREFETCH_RUNNING;
+	slots = gib_list_add_front(slots, slot);
+}
+
+static void feh_prefetch_finish(feh_prefetch_slot * slot, enum prefetch_state state)
+{
+	if (slot->data) {
+		imlib_context_set_image(slot->im);
+		imlib_image_put_back_data(slot->data);
+		slot->data = NULL;
+	}
+	if (state == PREFETCH_DONE) {
+		imlib_context_set_image(slot->im);
+		imlib_image_set_format(slot->header.format);
+	} else if (slot->im) {
+		gib_imlib_free_image_and_decache(slot->im);
+		slot->im = NULL;
+	}
+	close(slot->fd);
+	slot->fd = -1;
+	waitpid(slot->pid, NULL, 0);
+	slot->pid = 0;
+	slot->state = state;
+	D(("%s: %s\n", slot->file->filename,
+		state == PREFETCH_DONE ? "prefetched" : "prefetch failed"));
+}
+
+/*
+ * Reads whatever the worker has written so far. Returns once the pipe
+ * would block (or, for a blocking fd, once the transfer is complete).
+ */
+static void feh_prefetch_read(feh_prefetch_slot * slot)
+{
+	size_t total = sizeof(feh_prefetch_header);
+	ssize_t ret;
+	char *dst;
+
+	while (slot->state == PREFETCH_RUNNING) {
+		if (slot->received < sizeof(feh_prefetch_header))
+			dst = (char *) &slot->header + slot->received;
+		else
+			dst = (char *) slot->data
+				+ (slot->received - sizeof(feh_prefetch_header));
+
+		if (slot->im)
+			total = sizeof(feh_prefetch_header) + (size_t) slot->header.width
+				* slot->header.height * sizeof(DATA32);
+
+		ret = read(slot->fd, dst, total - slot->received);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				feh_prefetch_finish(slot, PREFETCH_FAILED);
+			return;
+		} else if (ret == 0) {
+			feh_prefetch_finish(slot, PREFETCH_FAILED);
+			return;
+		}
+		slot->received += ret;
+
+		if (slot->received < total)
+			continue;
+		if (slot->im) {
+			feh_prefetch_finish(slot, PREFETCH_DONE);
+			return;
+		}
+
+		/* header complete, set up the image the pixels are read into */
+		if (slot->header.ok < 0) {
+			slot->converting = feh_conversion_start(slot->file);
+			feh_prefetch_finish(slot, PREFETCH_FAILED);
+			return;
+		}
+		if (!slot->header.ok || (slot->header.width <= 0)
+				|| (slot->header.height <= 0)) {
+			feh_prefetch_finish(slot, PREFETCH_FAILED);
+			return;
+		}
+		slot->header.format[sizeof(slot->header.format) - 1] = '\0';
+		if (!(slot->im = imlib_create_image(slot->header.width,
+						slot->header.height))) {
+			feh_prefetch_finish(slot, PREFETCH_FAILED);
+			return;
+		}
+		imlib_context_set_image(slot->im);
+		imlib_image_set_has_alpha(slot->header.has_alpha);
+		slot->data = imlib_image_get_data();
+	}
+}
+
+/*
+ * Removes slot. If keep is set, a finished image is passed on to the image
+ * cache instead of being thrown away.
+ */
+static void feh_prefetch_drop(feh_prefetch_slot * slot, int keep)
+{
+	gib_list *l;
+
+	if (slot->state == PREFETCH_RUNNING) {
+		kill(slot->pid, SIGKILL);
+		feh_prefetch_finish(slot, PREFETCH_FAILED);
+	} else if (slot->im && keep) {
+		feh_image_cache_put(slot->im, &slot->header.key);
+	} else if (slot->im) {
+		gib_imlib_free_image_and_decache(slot->im);
+	}
+
+	if (slot->converting)
+		feh_conversion_cancel(slot->file);
+
+	if ((l = gib_list_find_by_data(slots, slot)))
+		slots = gib_list_remove(slots, l);
+	free(slot);
+}
+
+/*
+ * Returns the next entry in the given direction, or NULL if
+ * feh_list_jump would not simply wrap around to it.
+ */
+static gib_list *feh_prefetch_step(gib_list * l, int direction)
+{
+	if (direction == FORWARD) {
+		if (l->next)
+			return(l->next);
+		if (opt.on_last_slide == ON_LAST_SLIDE_RESUME && !opt.randomize)
+			return(filelist);
+		return(NULL);
+	}
+	if (l->prev)
+		return(l->prev);
+	if (opt.on_last_slide != ON_LAST_SLIDE_HOLD)
+		return(feh_filelist_nth(feh_filelist_length() - 1));
+	return(NULL);
+}
+
+static void feh_prefetch_collect(gib_list ** targets, gib_list * current,
+		int direction, unsigned int count)
+{
+	gib_list *l = current;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!(l = feh_prefetch_step(l, direction)) || (l == current))
+			return;
+		if (path_is_url(FEH_FILE(l->data)->filename))
+			continue;
+		if (!gib_list_find_by_data(*targets, l->data))
+			*targets = gib_list_add_end(*targets, l->data);
+	}
+}
+
+/*
+ * Called whenever the slideshow settles on a new image. direction is the
+ * direction of travel; --prefetch AHEAD entries are decoded in that
+ * direction and BEHIND entries in the opposite one. Workers for files which
+ * are no longer within reach are killed and their results discarded.
+ */
+void feh_prefetch_update(gib_list * current, int direction)
+{
+	gib_list *targets = NULL;
+	gib_list *l, *next;
+	feh_prefetch_slot *slot;
+
+	if (!current || (!opt.prefetch_ahead && !opt.prefetch_behind))
+		return;
+
+	/*
+	 * A child forked while the scan threads run may inherit locks they
+	 * hold, so it could not safely decode anything. The filelist calls
+	 * this again once the scan is done.
+	 */
+	if (feh_scan_running())
+		return;
+
+	feh_prefetch_collect(&targets, current, direction, opt.prefetch_ahead);
+	feh_prefetch_collect(&targets, current, direction == FORWARD ? BACK : FORWARD,
+			opt.prefetch_behind);
+
+	for (l = slots; l; l = next) {
+		next = l->next;
+		slot = l->data;
+		if (!gib_list_find_by_data(targets, slot->file))
+			feh_prefetch_drop(slot, 1);
+	}
+
+	for (l = targets; l; l = l->next)
+		if (!feh_prefetch_find(l->data) && !feh_image_cache_contains(l->data))
+			feh_prefetch_start(l->data);
+
+	gib_list_free(targets);
+}
+
+/*
+ * Hands over the prefetched image for file, waiting for its worker if it
+ * is still running. key is set to the file state the image was decoded from.
+ * Returns 0 if there is no usable result, in which case the caller should
+ * fall back to feh_load_image.
+ */
+int feh_prefetch_take(Imlib_Image * im, feh_file * file, feh_image_key * key)
+{
+	feh_prefetch_slot *slot = feh_prefetch_find(file);
+
+	if (!slot)
+		return(0);
+
+	if (slot->state == PREFETCH_RUNNING) {
+		fcntl(slot->fd, F_SETFL, fcntl(slot->fd, F_GETFL) & ~O_NONBLOCK);
+		feh_prefetch_read(slot);
+	}
+
+	if (slot->state != PREFETCH_DONE) {
+		/* a conversion we started is picked up by feh_load_image_nowait */
+		slot->converting = 0;
+		feh_prefetch_drop(slot, 0);
+		return(0);
+	}
+
+	*im = slot->im;
+	*key = slot->header.key;
+	slot->im = NULL;
+	feh_prefetch_drop(slot, 0);
+
+#ifdef HAVE_LIBEXIF
+	/*
+	 * The worker already applied --auto-rotate, but the EXIF data itself
+	 * is needed for --draw-exif and friends.
+	 */
+	feh_file_load_exif(file);
+#endif
+
+	D(("using prefetched image for %s\n", file->filename));
+	return(1);
+}
+
+void feh_prefetch_forget(feh_file * file)
+{
+	feh_prefetch_slot *slot;
+
+	if ((slot = feh_prefetch_find(file)))
+		feh_prefetch_drop(slot, 0);
+}
+
+void feh_prefetch_cancel_all(void)
+{
+	while (slots)
+		feh_prefetch_drop(slots->data, 0);
+}
+
+void feh_prefetch_fdset(fd_set * fdset, int *fdsize)
+{
+	gib_list *l;
+	feh_prefetch_slot *slot;
+
+	for (l = slots; l; l = l->next) {
+		slot = l->data;
+		if (slot->state != PREFETCH_RUNNING)
+			continue;
+		FD_SET(slot->fd, fdset);
+		if (slot->fd >= *fdsize)
+			*fdsize = slot->fd + 1;
+	}
+}
+
+void feh_prefetch_handle_fdset(fd_set * fdset)
+{
+	gib_list *l;
+	feh_prefetch_slot *slot;
+
+	for (l = slots; l; l = l->next) {
+		slot = l->data;
+		if ((slot->state == PREFETCH_RUNNING) && FD_ISSET(slot->fd, fdset))
+			feh_prefetch_read(slot);
+	}
+}
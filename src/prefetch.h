@@ -0,0 +1,57 @@
+/* prefetch.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "imagecache.h"
+
+/*
+ * Imlib2 is not thread-safe, so upcoming slides are decoded by forked
+ * worker processes. Each worker sends a feh_prefetch_header followed by
+ * width * height ARGB pixels through a pipe which is read from the main loop.
+ */
+struct __feh_prefetch_header {
+	feh_image_key key;
+	int ok;
+	int width;
+	int height;
+	int has_alpha;
+	char format[16];
+};
+
+typedef struct __feh_prefetch_header feh_prefetch_header;
+
+/* upper limit for either count of --prefetch, each image is one process */
+#define PREFETCH_MAX 32
+
+void feh_prefetch_update(gib_list * current, int direction);
+int feh_prefetch_take(Imlib_Image * im, feh_file * file, feh_image_key * key);
+void feh_prefetch_forget(feh_file * file);
+void feh_prefetch_cancel_all(void);
+void feh_prefetch_fdset(fd_set * fdset, int *fdsize);
+void feh_prefetch_handle_fdset(fd_set * fdset);
+
+#endif
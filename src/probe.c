@@ -0,0 +1,431 @@
+/* probe.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "options.h"
+#include "signals.h"
+#include "probe.h"
+#include "metacache.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* Probing mostly means waiting for the first few kilobytes of each file */
+#define PROBE_THREADS_PER_CPU 2
+#define PROBE_MAX_THREADS 16
+
+/*
+ * Larger images may be rejected by Imlib2, so they are left to a real
+ * decode.
+ */
+#define PROBE_MAX_DIM 32767
+#define PROBE_MAX_PIXELS ((1 << 29) - 1)
+
+/* how much of an EXIF APP1 marker is searched for the orientation tag */
+#define PROBE_EXIF_MAX 4096
+
+/* chunks skipped while looking for a PNG tRNS chunk */
+#define PROBE_PNG_MAX_CHUNKS 256
+
+/*
+ * Whether loaded images are rotated according to their EXIF orientation,
+ * either by Imlib2 or by --auto-rotate.
+ */
+static int feh_probe_oriented(void)
+{
+#if defined(IMLIB2_VERSION_MAJOR) && defined(IMLIB2_VERSION_MINOR) && defined(IMLIB2_VERSION_MICRO) && (IMLIB2_VERSION_MAJOR > 1 || IMLIB2_VERSION_MINOR > 7 || IMLIB2_VERSION_MICRO >= 5)
+	return 1;
+#elif defined(HAVE_LIBEXIF)
+	return opt.auto_rotate;
+#else
+	return 0;
+#endif
+}
+
+static int feh_probe_jpeg(FILE * fp, feh_probe * probe)
+{
+	unsigned char buf[PROBE_EXIF_MAX];
+	int c, marker, len, tmp;
+	int orientation = 0;
+
+	if (fseek(fp, 2, SEEK_SET))
+		return 0;
+
+	for (;;) {
+		if (getc(fp) != 0xff)
+			return 0;
+		while ((c = getc(fp)) == 0xff);
+		if (c == EOF)
+			return 0;
+		marker = c;
+
+		/* markers without a length */
+		if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd8)))
+			continue;
+		/* image data or its end before any frame header */
+		if ((marker == 0xd9) || (marker == 0xda))
+			return 0;
+
+		if (fread(buf, 1, 2, fp) != 2)
+			return 0;
+		len = feh_get16(buf, 1) - 2;
+		if (len < 0)
+			return 0;
+
+		/* SOFn, except for DHT, JPG and DAC which share the range */
+		if ((marker >= 0xc0) && (marker <= 0xcf) && (marker != 0xc4)
+				&& (marker != 0xc8) && (marker != 0xcc)) {
+			if ((len < 5) || (fread(buf, 1, 5, fp) != 5))
+				return 0;
+			probe->height = feh_get16(buf + 1, 1);
+			probe->width = feh_get16(buf + 3, 1);
+			if ((orientation >= 5) && feh_probe_oriented()) {
+				tmp = probe->width;
+				probe->width = probe->height;
+				probe->height = tmp;
+			}
+			probe->has_alpha = 0;
+			probe->format = "jpeg";
+			return 1;
+		}
+
+		if ((marker == 0xe1) && !orientation) {
+			c = (len < PROBE_EXIF_MAX) ? len : PROBE_EXIF_MAX;
+			if (fread(buf, 1, c, fp) != (size_t) c)
+				return 0;
+			orientation = feh_exif_ifd0_orientation(buf, c);
+			len -= c;
+		}
+		if (fseek(fp, len, SEEK_CUR))
+			return 0;
+	}
+}
+
+static int feh_probe_png(FILE * fp, feh_probe * probe)
+{
+	unsigned char buf[33];
+	int i;
+
+	/* signature, IHDR (length, type, 13 bytes of data, CRC) */
+	if ((fread(buf, 1, 33, fp) != 33) || memcmp(buf + 12, "IHDR", 4))
+		return 0;
+	probe->width = feh_get32(buf + 16, 1);
+	probe->height = feh_get32(buf + 20, 1);
+	probe->format = "png";
+
+	/* color types with an alpha channel */
+	if (buf[25] & 4) {
+		probe->has_alpha = 1;
+		return 1;
+	}
+
+	/* otherwise, a tRNS chunk before the image data adds one */
+	probe->has_alpha = 0;
+	for (i = 0; i < PROBE_PNG_MAX_CHUNKS; i++) {
+		if (fread(buf, 1, 8, fp) != 8)
+			return 0;
+		if (!memcmp(buf + 4, "tRNS", 4)) {
+			probe->has_alpha = 1;
+			return 1;
+		}
+		if (!memcmp(buf + 4, "IDAT", 4) || !memcmp(buf + 4, "IEND", 4))
+			return 1;
+		if (fseek(fp, (long) feh_get32(buf, 1) + 4, SEEK_CUR))
+			return 0;
+	}
+	return 0;
+}
+
+static int feh_probe_gif(FILE * fp, feh_probe * probe)
+{
+	unsigned char buf[13];
+	int c, size, label, first;
+	int transparent = 0;
+
+	/* header and logical screen descriptor */
+	if (fread(buf, 1, 13, fp) != 13)
+		return 0;
+	probe->width = feh_get16(buf + 6, 0);
+	probe->height = feh_get16(buf + 8, 0);
+	if ((buf[10] & 0x80) && fseek(fp, 3 << ((buf[10] & 7) + 1), SEEK_CUR))
+		return 0;
+
+	for (;;) {
+		c = getc(fp);
+		if (c == 0x21) {
+			/* extension, only a graphic control one is of interest */
+			if ((label = getc(fp)) == EOF)
+				return 0;
+			for (first = 1; (size = getc(fp)) > 0; first = 0) {
+				if (first && (label == 0xf9)) {
+					if ((c = getc(fp)) == EOF)
+						return 0;
+					transparent = c & 1;
+					size--;
+				}
+				if (fseek(fp, size, SEEK_CUR))
+					return 0;
+			}
+			if (size == EOF)
+				return 0;
+		} else if (c == 0x2c) {
+			/*
+			 * Depending on its version, Imlib2 uses the size of the
+			 * first frame or that of the screen, so they must match.
+			 */
+			if ((fread(buf, 1, 8, fp) != 8)
+					|| feh_get16(buf, 0) || feh_get16(buf + 2, 0)
+					|| ((int) feh_get16(buf + 4, 0) != probe->width)
+					|| ((int) feh_get16(buf + 6, 0) != probe->height))
+				return 0;
+			probe->has_alpha = transparent;
+			probe->format = "gif";
+			return 1;
+		} else
+			return 0;
+	}
+}
+
+static int feh_probe_webp(FILE * fp, feh_probe * probe)
+{
+	unsigned char buf[30];
+	unsigned int bits;
+
+	/* RIFF header, first chunk header and up to 10 bytes of its data */
+	if (fread(buf, 1, 30, fp) != 30)
+		return 0;
+	probe->format = "webp";
+
+	if (!memcmp(buf + 12, "VP8 ", 4)) {
+		if (memcmp(buf + 23, "\x9d\x01\x2a", 3))
+			return 0;
+		probe->width = feh_get16(buf + 26, 0) & 0x3fff;
+		probe->height = feh_get16(buf + 28, 0) & 0x3fff;
+		probe->has_alpha = 0;
+		return 1;
+	} else if (!memcmp(buf + 12, "VP8L", 4)) {
+		if (buf[20] != 0x2f)
+			return 0;
+		bits = feh_get32(buf + 21, 0);
+		probe->width = (bits & 0x3fff) + 1;
+		probe->height = ((bits >> 14) & 0x3fff) + 1;
+		probe->has_alpha = (bits >> 28) & 1;
+		return 1;
+	} else if (!memcmp(buf + 12, "VP8X", 4)) {
+		/* leave animations to Imlib2 */
+		if (buf[20] & 0x02)
+			return 0;
+		probe->width = (buf[24] | (buf[25] << 8) | (buf[26] << 16)) + 1;
+		probe->height = (buf[27] | (buf[28] << 8) | (buf[29] << 16)) + 1;
+		probe->has_alpha = (buf[20] & 0x10) ? 1 : 0;
+		return 1;
+	}
+	return 0;
+}
+
+static int feh_probe_bmp(FILE * fp, feh_probe * probe)
+{
+	unsigned char buf[30];
+	int bpp;
+
+	/* file header, then at least the 12 byte OS/2 info header */
+	if (fread(buf, 1, 26, fp) != 26)
+		return 0;
+	if (feh_get32(buf + 14, 0) == 12) {
+		probe->width = feh_get16(buf + 18, 0);
+		probe->height = feh_get16(buf + 20, 0);
+		bpp = feh_get16(buf + 24, 0);
+	} else {
+		if (fread(buf + 26, 1, 4, fp) != 4)
+			return 0;
+		probe->width = (int) feh_get32(buf + 18, 0);
+		probe->height = (int) feh_get32(buf + 22, 0);
+		/* negative for top-down bitmaps */
+		if ((probe->height < 0) && (probe->height > -PROBE_MAX_DIM))
+			probe->height = -probe->height;
+		bpp = feh_get16(buf + 28, 0);
+	}
+
+	/* whether deeper bitmaps have alpha depends on the Imlib2 version */
+	if ((bpp != 1) && (bpp != 4) && (bpp != 8) && (bpp != 24))
+		return 0;
+	probe->has_alpha = 0;
+	probe->format = "bmp";
+	return 1;
+}
+
+/*
+ * Reads one decimal number from a PNM header, skipping whitespace and
+ * comments before it. Returns -1 on errors.
+ */
+static int feh_probe_pnm_number(FILE * fp)
+{
+	int c, num = 0;
+
+	while (((c = getc(fp)) == '#') || isspace(c))
+		if (c == '#')
+			while (((c = getc(fp)) != '\n') && (c != EOF));
+
+	if (!isdigit(c))
+		return -1;
+	for (; isdigit(c); c = getc(fp)) {
+		if (num > PROBE_MAX_DIM)
+			return -1;
+		num = num * 10 + (c - '0');
+	}
+	return num;
+}
+
+static int feh_probe_pnm(FILE * fp, feh_probe * probe)
+{
+	if (fseek(fp, 2, SEEK_SET))
+		return 0;
+	probe->width = feh_probe_pnm_number(fp);
+	probe->height = feh_probe_pnm_number(fp);
+	probe->has_alpha = 0;
+	probe->format = "pnm";
+	return 1;
+}
+
+int feh_probe_image(feh_probe * probe)
+{
+	FILE *fp;
+	unsigned char magic[12];
+	int ok = 0;
+
+	probe->ok = 0;
+	probe->cached = 0;
+	if (path_is_url(probe->filename) || !(fp = fopen(probe->filename, "rb")))
+		return 0;
+
+	if (fread(magic, 1, 12, fp) == 12 && !fseek(fp, 0, SEEK_SET)) {
+		if (!memcmp(magic, "\xff\xd8\xff", 3))
+			ok = feh_probe_jpeg(fp, probe);
+		else if (!memcmp(magic, "\x89PNG\r\n\x1a\n", 8))
+			ok = feh_probe_png(fp, probe);
+		else if (!memcmp(magic, "GIF87a", 6) || !memcmp(magic, "GIF89a", 6))
+			ok = feh_probe_gif(fp, probe);
+		else if (!memcmp(magic, "RIFF", 4) && !memcmp(magic + 8, "WEBP", 4))
+			ok = feh_probe_webp(fp, probe);
+		else if (!memcmp(magic, "BM", 2))
+			ok = feh_probe_bmp(fp, probe);
+		else if ((magic[0] == 'P') && (magic[1] >= '1') && (magic[1] <= '6'))
+			ok = feh_probe_pnm(fp, probe);
+	}
+	fclose(fp);
+
+	if (!ok || (probe->width <= 0) || (probe->height <= 0)
+			|| (probe->width > PROBE_MAX_DIM) || (probe->height > PROBE_MAX_DIM)
+			|| ((long long) probe->width * probe->height > PROBE_MAX_PIXELS))
+		return 0;
+
+	D(("%s: %dx%d %s%s\n", probe->filename, probe->width, probe->height,
+				probe->format, probe->has_alpha ? " with alpha" : ""));
+	probe->ok = 1;
+	return 1;
+}
+
+static void feh_probe_file(feh_probe * probe)
+{
+	struct stat st;
+
+	probe->ok = 0;
+	probe->cached = 0;
+	if (stat(probe->filename, &st)) {
+		probe->stat_err = errno;
+		return;
+	}
+	probe->stat_err = 0;
+	probe->mtime = st.st_mtim.tv_sec;
+	probe->mtime_nsec = st.st_mtim.tv_nsec;
+	probe->size = st.st_size;
+	if (!feh_metacache_lookup(probe))
+		feh_probe_image(probe);
+}
+
+#ifdef HAVE_PTHREAD
+typedef struct {
+	feh_probe *probes;
+	int count;
+	int next;
+	pthread_mutex_t mutex;
+} feh_probe_batch;
+
+static void *feh_probe_worker(void *arg)
+{
+	feh_probe_batch *batch = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->mutex);
+		i = batch->next++;
+		pthread_mutex_unlock(&batch->mutex);
+		if ((i >= batch->count) || sig_exit)
+			return(NULL);
+		feh_probe_file(&batch->probes[i]);
+	}
+}
+#endif
+
+void feh_probe_files(feh_probe * probes, int count)
+{
+	int i;
+#ifdef HAVE_PTHREAD
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	feh_probe_batch batch;
+	pthread_t *threads;
+	int thread_count;
+
+	if (cpus < 1)
+		cpus = 1;
+	thread_count = cpus * PROBE_THREADS_PER_CPU;
+	if (thread_count > PROBE_MAX_THREADS)
+		thread_count = PROBE_MAX_THREADS;
+	if (thread_count > count)
+		thread_count = count;
+
+	if (thread_count > 1) {
+		batch.probes = probes;
+		batch.count = count;
+		batch.next = 0;
+		pthread_mutex_init(&batch.mutex, NULL);
+		threads = emalloc(thread_count * sizeof(pthread_t));
+		for (i = 0; i < thread_count; i++)
+			if (pthread_create(&threads[i], NULL, feh_probe_worker, &batch))
+				break;
+		thread_count = i;
+		/* the calling thread helps out, and does everything if none started */
+		feh_probe_worker(&batch);
+		for (i = 0; i < thread_count; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		pthread_mutex_destroy(&batch.mutex);
+		return;
+	}
+#endif
+	for (i = 0; (i < count) && !sig_exit; i++)
+		feh_probe_file(&probes[i]);
+}
@@ -0,0 +1,73 @@
+/* probe.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef PROBE_H
+#define PROBE_H
+
+/*
+ * Reads the size, alpha channel and format of an image from its header
+ * without decoding it. Only formats whose headers say what Imlib2 would
+ * report are handled (JPEG, PNG, GIF, WebP, BMP and PNM); for anything
+ * else, or files the header does not fully describe, the caller has to
+ * decode the image instead.
+ */
+struct __feh_probe {
+	/* input */
+	char *filename;
+
+	/* errno of a failed stat(2), 0 otherwise */
+	int stat_err;
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+
+	/* set if the header was understood */
+	unsigned char ok;
+	int width;
+	int height;
+	unsigned char has_alpha;
+	const char *format;
+
+	/*
+	 * set if the values came from the metadata index, format is Imlib2's
+	 * name for it then
+	 */
+	unsigned char cached;
+	/* with cached, whether the image had been decoded to get them */
+	unsigned char decoded;
+};
+
+typedef struct __feh_probe feh_probe;
+
+/* Only parses the header, returns 1 if probe->width etc. were set */
+int feh_probe_image(feh_probe * probe);
+
+/*
+ * Stats count files and probes those which are not in the metadata index,
+ * on a pool of worker threads
+ */
+void feh_probe_files(feh_probe * probes, int count);
+
+#endif
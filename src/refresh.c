@@ -0,0 +1,529 @@
+/* refresh.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* for d_type */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "scan.h"
+#include "sort.h"
+#include "refresh.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+
+/*
+ * A directory whose mtime is this close to the time it was read may still
+ * have changed within the same timestamp afterwards, so it is read again.
+ */
+#define REFRESH_RACY_SECS 2
+
+typedef struct {
+	char *path;
+	int len;
+	time_t mtime;
+	long mtime_nsec;
+	unsigned char racy;
+	/* set by feh_filelist_refresh for the current reload */
+	unsigned char changed;
+	unsigned char gone;
+} feh_watched_dir;
+
+/* a regular file found in a changed directory */
+typedef struct {
+	char *path;
+	int dir;
+	/* its node in the filelist, once known */
+	gib_list *node;
+} feh_refresh_entry;
+
+/* open addressing index on paths, -1 marks a free slot */
+typedef struct {
+	int *slots;
+	int size;
+} feh_refresh_index;
+
+static feh_watched_dir *dirs = NULL;
+static int dir_count = 0;
+static int dir_size = 0;
+static feh_refresh_index dir_index = { NULL, 0 };
+
+static feh_refresh_entry *entries = NULL;
+static int entry_count = 0;
+static int entry_size = 0;
+static feh_refresh_index entry_index = { NULL, 0 };
+
+/* files found below new subdirectories */
+static gib_list *scanned = NULL;
+
+static time_t filelistfile_mtime = 0;
+static long filelistfile_mtime_nsec = 0;
+
+/*
+ * Returns the slot for path (of length len) in index. It is either free or
+ * holds n with path(n) matching.
+ */
+static int feh_refresh_slot(feh_refresh_index * index, const char *path,
+		int len, char *(*path_of) (int, int *))
+{
+	int i, n, n_len;
+	char *n_path;
+
+	for (i = feh_hash32(path, len) & (index->size - 1);
+			(n = index->slots[i]) >= 0; i = (i + 1) & (index->size - 1)) {
+		n_path = path_of(n, &n_len);
+		if ((n_len == len) && !memcmp(n_path, path, len))
+			break;
+	}
+	return(i);
+}
+
+/* Rebuilds index for count items, growing it to keep it at most half full */
+static void feh_refresh_reindex(feh_refresh_index * index, int count,
+		char *(*path_of) (int, int *))
+{
+	int n, len;
+	char *path;
+
+	if (!index->size || (count * 2 > index->size)) {
+		if (!index->size)
+			index->size = 64;
+		while (count * 2 > index->size)
+			index->size *= 2;
+		index->slots = erealloc(index->slots, index->size * sizeof(int));
+	}
+	memset(index->slots, -1, index->size * sizeof(int));
+	for (n = 0; n < count; n++) {
+		path = path_of(n, &len);
+		index->slots[feh_refresh_slot(index, path, len, path_of)] = n;
+	}
+}
+
+static char *feh_watched_dir_path(int n, int *len)
+{
+	*len = dirs[n].len;
+	return(dirs[n].path);
+}
+
+static char *feh_refresh_entry_path(int n, int *len)
+{
+	*len = strlen(entries[n].path);
+	return(entries[n].path);
+}
+
+static int feh_watched_dir_find(const char *path, int len)
+{
+	if (!dir_count)
+		return(-1);
+	return(dir_index.slots[feh_refresh_slot(&dir_index, path, len,
+				feh_watched_dir_path)]);
+}
+
+static int feh_refresh_entry_find(const char *path)
+{
+	if (!entry_count)
+		return(-1);
+	return(entry_index.slots[feh_refresh_slot(&entry_index, path, strlen(path),
+				feh_refresh_entry_path)]);
+}
+
+static void feh_watched_dir_set_mtime(int n, struct stat *st)
+{
+	dirs[n].mtime = st->st_mtim.tv_sec;
+	dirs[n].mtime_nsec = st->st_mtim.tv_nsec;
+	dirs[n].racy = (st->st_mtim.tv_sec + REFRESH_RACY_SECS > time(NULL));
+}
+
+/* Called for each directory scanned while --reload is in effect */
+static void feh_filelist_watch_dir(char *path, struct stat *st)
+{
+	int len = strlen(path);
+	int n = feh_watched_dir_find(path, len);
+
+	if (n < 0) {
+		if (dir_count == dir_size) {
+			dir_size = dir_size ? dir_size * 2 : 64;
+			dirs = erealloc(dirs, dir_size * sizeof(feh_watched_dir));
+		}
+		n = dir_count++;
+		dirs[n].path = estrdup(path);
+		dirs[n].len = len;
+		dirs[n].changed = 0;
+		dirs[n].gone = 0;
+		if (dir_count * 2 > dir_index.size)
+			feh_refresh_reindex(&dir_index, dir_count, feh_watched_dir_path);
+		else
+			dir_index.slots[feh_refresh_slot(&dir_index, path, len,
+					feh_watched_dir_path)] = n;
+	}
+	feh_watched_dir_set_mtime(n, st);
+}
+
+void feh_filelist_watch(void)
+{
+	struct stat st;
+
+	feh_scan_watch(feh_filelist_watch_dir);
+	if (opt.filelistfile && !stat(opt.filelistfile, &st)) {
+		filelistfile_mtime = st.st_mtim.tv_sec;
+		filelistfile_mtime_nsec = st.st_mtim.tv_nsec;
+	}
+}
+
+static void feh_refresh_found(char *path, int err)
+{
+	if (path && !err)
+		scanned = gib_list_add_front(scanned,
+			feh_filelist_file_new(path, strlen(path)));
+}
+
+/* a name and type as reported by readdir */
+typedef struct {
+	char *name;
+	unsigned char type;
+} feh_refresh_dirent;
+
+static int feh_refresh_compare(const void *a, const void *b)
+{
+	return(strcoll(((const feh_refresh_dirent *) a)->name,
+				((const feh_refresh_dirent *) b)->name));
+}
+
+/*
+ * Returns 1 if ent is a directory, 0 if it is a regular file and -1
+ * otherwise. Symlinks are followed.
+ */
+static int feh_refresh_type(DIR * d, feh_refresh_dirent * ent)
+{
+	struct stat st;
+
+#ifdef DT_UNKNOWN
+	if (ent->type == DT_REG)
+		return(0);
+	if (ent->type == DT_DIR)
+		return(1);
+#endif
+	if (fstatat(dirfd(d), ent->name, &st, 0))
+		return(-1);
+	if (S_ISDIR(st.st_mode))
+		return(1);
+	if (S_ISREG(st.st_mode))
+		return(0);
+	return(-1);
+}
+
+/*
+ * Reads the changed directory dirs[n] like feh_scan does. Its regular files
+ * are added to entries, and with --recursive, subdirectories which are not
+ * watched yet are scanned for new files.
+ */
+static void feh_refresh_read_dir(int n)
+{
+	feh_refresh_dirent *ents = NULL;
+	struct dirent *de;
+	struct stat st;
+	char *path;
+	int fd, i, count = 0, size = 0, isdir;
+	DIR *d;
+
+	if (((fd = open(dirs[n].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+			|| fstat(fd, &st) || !(d = fdopendir(fd))) {
+		if (fd >= 0)
+			close(fd);
+		D(("%s is gone\n", dirs[n].path));
+		dirs[n].gone = 1;
+		return;
+	}
+	feh_watched_dir_set_mtime(n, &st);
+
+	while ((de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			ents = erealloc(ents, size * sizeof(feh_refresh_dirent));
+		}
+		ents[count].name = estrdup(de->d_name);
+#ifdef DT_UNKNOWN
+		ents[count].type = de->d_type;
+#else
+		ents[count].type = 0;
+#endif
+		count++;
+	}
+	qsort(ents, count, sizeof(feh_refresh_dirent), feh_refresh_compare);
+
+	for (i = 0; i < count; i++) {
+		isdir = feh_refresh_type(d, &ents[i]);
+		path = NULL;
+		if (isdir >= 0)
+			path = estrjoin("", dirs[n].path, "/", ents[i].name, NULL);
+
+		if (isdir == 0) {
+			if (entry_count == entry_size) {
+				entry_size = entry_size ? entry_size * 2 : 1024;
+				entries = erealloc(entries, entry_size * sizeof(feh_refresh_entry));
+			}
+			entries[entry_count].path = path;
+			entries[entry_count].dir = n;
+			entries[entry_count].node = NULL;
+			entry_count++;
+			path = NULL;
+		} else if ((isdir == 1) && opt.recursive
+				&& (feh_watched_dir_find(path, strlen(path)) < 0)) {
+			D(("new directory %s\n", path));
+			feh_scan(path, opt.recursive, feh_refresh_found);
+		}
+		free(path);
+		free(ents[i].name);
+	}
+	free(ents);
+	closedir(d);
+}
+
+/* Removes l from the filelist, moving on to another file if it is current */
+static void feh_refresh_remove(gib_list * l)
+{
+	D(("removing %s\n", FEH_FILE(l->data)->filename));
+	if (l == current_file)
+		current_file = l->next ? l->next : l->prev;
+	filelist = feh_file_remove_from_list(filelist, l);
+}
+
+/* Links the unlinked node l into the filelist after prev, or first */
+static void feh_refresh_link(gib_list * l, gib_list * prev)
+{
+	l->prev = prev;
+	l->next = prev ? prev->next : filelist;
+	if (l->next)
+		l->next->prev = l;
+	if (prev)
+		prev->next = l;
+	else
+		filelist = l;
+	filelist_len++;
+}
+
+static int feh_refresh_compare_pos(const void *a, const void *b)
+{
+	return(*(const int *) a - *(const int *) b);
+}
+
+/* Inserts the new files at random positions, for --randomize */
+static void feh_refresh_insert_random(gib_list * added)
+{
+	gib_list *l = filelist, *prev = NULL, *next;
+	int count = gib_list_length(added);
+	int *pos = emalloc(count * sizeof(int));
+	int i, passed = 0;
+
+	for (i = 0; i < count; i++)
+		pos[i] = random() % (filelist_len + 1);
+	qsort(pos, count, sizeof(int), feh_refresh_compare_pos);
+
+	for (i = 0; added; added = next, i++) {
+		next = added->next;
+		while (l && (passed < pos[i])) {
+			prev = l;
+			l = l->next;
+			passed++;
+		}
+		feh_refresh_link(added, prev);
+		prev = added;
+	}
+	free(pos);
+}
+
+/*
+ * Inserts the new files where a full rebuild would have put them: next to
+ * the files which precede or follow them in their directory. Files without
+ * such a neighbour go to the end.
+ */
+static void feh_refresh_insert_in_place(gib_list * added)
+{
+	gib_list *last = gib_list_last(filelist), *next;
+	int i, k;
+
+	for (; added; added = next) {
+		next = added->next;
+		k = FEH_FILE(added->data)->index;
+		if (k < 0) {
+			feh_refresh_link(added, last);
+			last = added;
+			continue;
+		}
+		for (i = k - 1; (i >= 0) && (entries[i].dir == entries[k].dir)
+				&& !entries[i].node; i--);
+		if ((i >= 0) && (entries[i].dir == entries[k].dir))
+			feh_refresh_link(added, entries[i].node);
+		else {
+			for (i = k + 1; (i < entry_count) && (entries[i].dir == entries[k].dir)
+					&& !entries[i].node; i++);
+			if ((i < entry_count) && (entries[i].dir == entries[k].dir))
+				feh_refresh_link(added, entries[i].node->prev);
+			else
+				feh_refresh_link(added, last);
+		}
+		if (added->prev == last)
+			last = added;
+		entries[k].node = added;
+	}
+}
+
+int feh_filelist_refresh(void)
+{
+	gib_list *l, *next, *added = NULL;
+	feh_file *file;
+	struct stat st;
+	int needed = feh_file_info_needed();
+	int i, n, len, changed = 0, resort = 0;
+
+	if (opt.filelistfile && !stat(opt.filelistfile, &st)
+			&& ((st.st_mtim.tv_sec != filelistfile_mtime)
+				|| (st.st_mtim.tv_nsec != filelistfile_mtime_nsec))) {
+		filelistfile_mtime = st.st_mtim.tv_sec;
+		filelistfile_mtime_nsec = st.st_mtim.tv_nsec;
+		return(0);
+	}
+
+	for (n = 0; n < dir_count; n++) {
+		dirs[n].changed = 0;
+		dirs[n].gone = 0;
+		if (stat(dirs[n].path, &st) || !S_ISDIR(st.st_mode))
+			dirs[n].gone = 1;
+		else if (dirs[n].racy || (st.st_mtim.tv_sec != dirs[n].mtime)
+				|| (st.st_mtim.tv_nsec != dirs[n].mtime_nsec))
+			dirs[n].changed = 1;
+		changed += dirs[n].changed + dirs[n].gone;
+	}
+	if (!changed && !needed)
+		return(1);
+
+	/* directories may be added while others are read */
+	for (n = 0, len = dir_count; n < len; n++)
+		if (dirs[n].changed)
+			feh_refresh_read_dir(n);
+	if (entry_count)
+		feh_refresh_reindex(&entry_index, entry_count, feh_refresh_entry_path);
+
+	for (l = filelist; l; l = next) {
+		next = l->next;
+		file = FEH_FILE(l->data);
+		if (path_is_url(file->filename))
+			continue;
+
+		i = -1;
+		len = strlen(file->filename) - strlen(file->name) - 1;
+		if (changed && (len > 0)
+				&& ((n = feh_watched_dir_find(file->filename, len)) >= 0)
+				&& (dirs[n].changed || dirs[n].gone)
+				&& (dirs[n].gone || ((i = feh_refresh_entry_find(file->filename)) < 0))) {
+			feh_refresh_remove(l);
+			continue;
+		}
+
+		/* the sizes of files which were not stat'ed are -1 */
+		if (needed && (file->size >= 0)) {
+			if (stat(file->filename, &st)) {
+				feh_refresh_remove(l);
+				continue;
+			}
+			if ((st.st_mtime != file->mtime) || (st.st_size != file->size)) {
+				D(("%s changed\n", file->filename));
+				if (feh_file_info_refresh(file, needed == 2)) {
+					feh_refresh_remove(l);
+					continue;
+				}
+				resort = 1;
+			}
+		}
+		if (i >= 0)
+			entries[i].node = l;
+	}
+
+	for (i = entry_count - 1; i >= 0; i--) {
+		if (!entries[i].node) {
+			file = feh_filelist_file_new(entries[i].path,
+					strlen(entries[i].path));
+			file->index = i;
+			added = gib_list_add_front(added, file);
+		}
+	}
+	added = gib_list_cat(added, gib_list_reverse(scanned));
+	scanned = NULL;
+	if (added && needed)
+		added = feh_file_info_preload(added, needed == 2);
+
+	if (added) {
+		D(("adding %d files\n", gib_list_length(added)));
+		if (opt.sort != SORT_NONE) {
+			for (l = added; l; l = l->next)
+				filelist_len++;
+			resort = 1;
+			filelist = gib_list_cat(filelist, added);
+		} else if (opt.randomize)
+			feh_refresh_insert_random(added);
+		else
+			feh_refresh_insert_in_place(added);
+	}
+
+	if (resort && (opt.sort >= (added ? SORT_NAME : SORT_SIZE))) {
+		/*
+		 * feh_filelist_sort expects a back-to-front list, and
+		 * feh_prepare_filelist reverses the sorted one for --reverse
+		 */
+		if (!opt.reverse)
+			filelist = gib_list_reverse(filelist);
+		filelist = feh_filelist_sort(filelist, opt.sort);
+		if (opt.reverse)
+			filelist = gib_list_reverse(filelist);
+	}
+
+	for (i = 0; i < entry_count; i++)
+		free(entries[i].path);
+	entry_count = 0;
+
+	for (n = 0, i = 0; n < dir_count; n++) {
+		if (dirs[n].gone)
+			free(dirs[n].path);
+		else
+			dirs[i++] = dirs[n];
+	}
+	if (i < dir_count) {
+		dir_count = i;
+		feh_refresh_reindex(&dir_index, dir_count, feh_watched_dir_path);
+	}
+
+	feh_filelist_changed();
+	if (!filelist)
+		eprintf("No files found to reload.");
+	if (!current_file)
+		current_file = filelist;
+	return(1);
+}
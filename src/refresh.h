@@ -0,0 +1,43 @@
+/* refresh.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef REFRESH_H
+#define REFRESH_H
+
+/*
+ * With --reload, the directories the filelist was read from are remembered
+ * with their mtime. On each reload, only those whose mtime changed are read
+ * again, and the files added to or removed from them are added to or
+ * removed from the filelist in place. If the filelist carries stat(2) or
+ * image information, files changed in place are picked up as well.
+ *
+ * feh_filelist_watch must be called before the filelist is built.
+ * feh_filelist_refresh returns 0 if the filelist has to be rebuilt from
+ * scratch instead, which is the case when the --filelist file changed.
+ */
+void feh_filelist_watch(void);
+int feh_filelist_refresh(void);
+
+#endif
@@ -0,0 +1,653 @@
+/* scan.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* for d_type */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "feh.h"
+#include "options.h"
+#include "signals.h"
+#include "timers.h"
+#include "scan.h"
+
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/*
+ * Reading a directory mostly means waiting for the file system (possibly a
+ * network file system), so more threads than CPUs are used.
+ */
+#define SCAN_THREADS_PER_CPU 2
+#define SCAN_MAX_THREADS 16
+
+/*
+ * Directories stay open until all their subdirectories were opened
+ * relative to them, which saves path lookups. Beyond this many, the full
+ * path is used instead.
+ */
+#define SCAN_MAX_OPEN_DIRS 64
+
+/* seconds feh_scan_step may spend before returning to the main loop */
+#define SCAN_STEP_TIME 0.02
+
+enum scan_state { SCAN_QUEUED, SCAN_READING, SCAN_DONE };
+
+typedef struct __feh_scan_dir feh_scan_dir;
+
+/* a directory or file queued by feh_scan_start or feh_scan_start_file */
+typedef struct {
+	char *path;
+	feh_scan_fn *found;
+	/* the top directory, NULL for a single file */
+	feh_scan_dir *dir;
+	int recursive;
+	double start;
+	unsigned long scanned;
+} feh_scan_root;
+
+typedef struct {
+	char *path;
+	/* errno of a failed stat, 0 for regular files */
+	int err;
+	/* set for subdirectories which are descended into */
+	feh_scan_dir *dir;
+} feh_scan_entry;
+
+struct __feh_scan_dir {
+	char *path;
+	char *name;
+	feh_scan_dir *parent;
+	feh_scan_root *root;
+	gib_list *node;
+	enum scan_state state;
+	/* fd is kept for openat(2) while users subdirectories still need it */
+	int fd;
+	int users;
+	/* errno of a failed open or read, and which of the two failed */
+	int err;
+	unsigned char open_failed;
+	/* taken before reading, for the feh_scan_watch callback */
+	struct stat st;
+	unsigned char have_st;
+	feh_scan_entry *entries;
+	int entry_count;
+	/* entries already passed on by feh_scan_step */
+	int emitted;
+};
+
+/* a name and type as reported by readdir */
+typedef struct {
+	char *name;
+	unsigned char type;
+} feh_scan_dirent;
+
+/* roots in the order their contents are passed on */
+static gib_list *roots = NULL;
+static gib_list *roots_last = NULL;
+/* directories being passed on, the innermost one first */
+static gib_list *frames = NULL;
+/* directories waiting to be read, the next one first */
+static gib_list *queue = NULL;
+static int open_dirs = 0;
+/* written to whenever feh_scan_step has something to do */
+static int wake_fd[2] = { -1, -1 };
+static feh_scan_dir_fn *watch_fn = NULL;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *threads = NULL;
+static int thread_count = 0;
+static int scan_quit = 0;
+
+#define SCAN_LOCK() pthread_mutex_lock(&scan_mutex)
+#define SCAN_UNLOCK() pthread_mutex_unlock(&scan_mutex)
+#define SCAN_WAIT() pthread_cond_wait(&scan_cond, &scan_mutex)
+#define SCAN_BROADCAST() pthread_cond_broadcast(&scan_cond)
+#else
+#define SCAN_LOCK()
+#define SCAN_UNLOCK()
+#define SCAN_WAIT()
+#define SCAN_BROADCAST()
+
+static const int thread_count = 0;
+#endif
+
+static void feh_scan_wake(void)
+{
+	ssize_t ret;
+
+	if (wake_fd[1] >= 0) {
+		ret = write(wake_fd[1], "", 1);
+		(void) ret;
+	}
+}
+
+static feh_scan_dir *feh_scan_dir_new(char *path, char *name,
+		feh_scan_dir * parent, feh_scan_root * root)
+{
+	feh_scan_dir *dir = emalloc(sizeof(feh_scan_dir));
+
+	memset(dir, 0, sizeof(feh_scan_dir));
+	dir->path = path;
+	dir->name = name;
+	dir->parent = parent;
+	dir->root = root;
+	dir->state = SCAN_QUEUED;
+	dir->fd = -1;
+	return(dir);
+}
+
+static int feh_scan_compare(const void *a, const void *b)
+{
+	return(strcoll(((const feh_scan_dirent *) a)->name,
+				((const feh_scan_dirent *) b)->name));
+}
+
+/*
+ * Drops the reference a subdirectory of dir held on its file descriptor.
+ * Must be called with the lock held.
+ */
+static void feh_scan_release(feh_scan_dir * dir)
+{
+	if (!dir || (--dir->users > 0) || (dir->fd < 0))
+		return;
+	close(dir->fd);
+	dir->fd = -1;
+	open_dirs--;
+}
+
+static int feh_scan_open(feh_scan_dir * dir)
+{
+	int fd;
+
+	/* the user wants to quit, skip the rest of the tree */
+	if (sig_exit)
+		fd = -1;
+	else if (dir->parent && (dir->parent->fd >= 0))
+		fd = openat(dir->parent->fd, dir->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	else
+		fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 && !sig_exit) {
+		dir->err = errno;
+		dir->open_failed = 1;
+	}
+
+	SCAN_LOCK();
+	feh_scan_release(dir->parent);
+	SCAN_UNLOCK();
+	return(fd);
+}
+
+/*
+ * Returns 1 if ent is a directory, 0 if it is a regular file (or could not
+ * be stat'ed, err is set then) and -1 otherwise. Symlinks are followed.
+ */
+static int feh_scan_type(DIR * d, feh_scan_dirent * ent, int *err)
+{
+	struct stat st;
+
+#ifdef DT_UNKNOWN
+	if (ent->type == DT_REG)
+		return(0);
+	if (ent->type == DT_DIR)
+		return(1);
+#endif
+	if (fstatat(dirfd(d), ent->name, &st, 0)) {
+		*err = errno;
+		return(0);
+	}
+	if (S_ISDIR(st.st_mode))
+		return(1);
+	if (S_ISREG(st.st_mode))
+		return(0);
+	return(-1);
+}
+
+/*
+ * Reads dir and queues its subdirectories. Called without the lock held by
+ * whichever thread took dir off the queue.
+ */
+static void feh_scan_read(feh_scan_dir * dir)
+{
+	feh_scan_dirent *ents = NULL;
+	feh_scan_entry *entry;
+	gib_list *subdirs = NULL, *l;
+	struct dirent *de;
+	DIR *d = NULL;
+	int fd, i, n = 0, size = 0, nsub = 0, isdir;
+
+	if (((fd = feh_scan_open(dir)) >= 0) && !(d = fdopendir(fd))) {
+		dir->err = errno;
+		dir->open_failed = 1;
+		close(fd);
+	}
+	if (d && watch_fn)
+		dir->have_st = !fstat(dirfd(d), &dir->st);
+
+	if (d) {
+		errno = 0;
+		while ((de = readdir(d))) {
+			if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+				errno = 0;
+				continue;
+			}
+			if (n == size) {
+				size = size ? size * 2 : 64;
+				ents = erealloc(ents, size * sizeof(feh_scan_dirent));
+			}
+			ents[n].name = estrdup(de->d_name);
+#ifdef DT_UNKNOWN
+			ents[n].type = de->d_type;
+#else
+			ents[n].type = 0;
+#endif
+			n++;
+			errno = 0;
+		}
+		if (errno) {
+			/* like scandir, a failed read means no entries at all */
+			dir->err = errno;
+			for (i = 0; i < n; i++)
+				free(ents[i].name);
+			n = 0;
+		}
+	}
+
+	if (n) {
+		qsort(ents, n, sizeof(feh_scan_dirent), feh_scan_compare);
+		dir->entries = emalloc(n * sizeof(feh_scan_entry));
+	}
+
+	for (i = 0; i < n; i++) {
+		entry = &dir->entries[dir->entry_count];
+		entry->path = estrjoin("", dir->path, "/", ents[i].name, NULL);
+		entry->err = 0;
+		entry->dir = NULL;
+
+		isdir = feh_scan_type(d, &ents[i], &entry->err);
+
+		if ((isdir < 0) || (isdir && !dir->root->recursive)) {
+			free(entry->path);
+			free(ents[i].name);
+			continue;
+		}
+		if (isdir) {
+			entry->dir = feh_scan_dir_new(entry->path, ents[i].name, dir,
+					dir->root);
+			subdirs = gib_list_add_front(subdirs, entry->dir);
+			nsub++;
+			entry->path = NULL;
+		} else
+			free(ents[i].name);
+		dir->entry_count++;
+	}
+	free(ents);
+
+	SCAN_LOCK();
+	if (nsub && (open_dirs < SCAN_MAX_OPEN_DIRS)
+			&& ((dir->fd = fcntl(dirfd(d), F_DUPFD_CLOEXEC, 0)) >= 0)) {
+		dir->users = nsub;
+		open_dirs++;
+	}
+	/* subdirs is in reverse order, so the first one ends up on top */
+	for (l = subdirs; l; l = l->next) {
+		queue = gib_list_add_front(queue, l->data);
+		((feh_scan_dir *) l->data)->node = queue;
+	}
+	dir->root->scanned += dir->entry_count;
+	dir->state = SCAN_DONE;
+	SCAN_BROADCAST();
+	SCAN_UNLOCK();
+
+	gib_list_free(subdirs);
+	if (d)
+		closedir(d);
+	feh_scan_wake();
+}
+
+#ifdef HAVE_PTHREAD
+static void *feh_scan_worker(__attribute__((unused)) void *data)
+{
+	feh_scan_dir *dir;
+
+	SCAN_LOCK();
+	while (!scan_quit) {
+		if (!queue) {
+			SCAN_WAIT();
+			continue;
+		}
+		dir = queue->data;
+		queue = gib_list_remove(queue, queue);
+		dir->node = NULL;
+		dir->state = SCAN_READING;
+		SCAN_UNLOCK();
+		feh_scan_read(dir);
+		SCAN_LOCK();
+	}
+	SCAN_UNLOCK();
+	return(NULL);
+}
+
+static void feh_scan_start_threads(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i, count;
+
+	if (threads)
+		return;
+
+	if (cpus < 1)
+		cpus = 1;
+	count = cpus * SCAN_THREADS_PER_CPU;
+	if (count > SCAN_MAX_THREADS)
+		count = SCAN_MAX_THREADS;
+
+	scan_quit = 0;
+	threads = emalloc(count * sizeof(pthread_t));
+	for (i = 0; i < count; i++)
+		if (pthread_create(&threads[i], NULL, feh_scan_worker, NULL))
+			break;
+	thread_count = i;
+	D(("started %d scan threads\n", thread_count));
+}
+
+static void feh_scan_stop_threads(void)
+{
+	int i;
+
+	if (!threads)
+		return;
+
+	SCAN_LOCK();
+	scan_quit = 1;
+	SCAN_BROADCAST();
+	SCAN_UNLOCK();
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	threads = NULL;
+	thread_count = 0;
+}
+#endif
+
+static void feh_scan_add_root(feh_scan_root * root)
+{
+	if (wake_fd[0] < 0) {
+		if (pipe(wake_fd) == -1)
+			eprintf("Cannot scan directories: pipe:");
+		fcntl(wake_fd[0], F_SETFL, fcntl(wake_fd[0], F_GETFL) | O_NONBLOCK);
+		fcntl(wake_fd[1], F_SETFL, fcntl(wake_fd[1], F_GETFL) | O_NONBLOCK);
+		fcntl(wake_fd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(wake_fd[1], F_SETFD, FD_CLOEXEC);
+	}
+
+	root->start = feh_get_time();
+	roots_last = gib_list_add_end(roots_last, root);
+	if (!roots)
+		roots = roots_last;
+	else
+		roots_last = roots_last->next;
+	feh_scan_wake();
+}
+
+/*
+ * Queues the directory path. Its regular files (and with recursive set,
+ * those in its subdirectories) are passed to found by feh_scan_step.
+ */
+void feh_scan_start(char *path, int recursive, feh_scan_fn found)
+{
+	feh_scan_root *root = emalloc(sizeof(feh_scan_root));
+
+	D(("queueing %s\n", path));
+
+	root->path = estrdup(path);
+	root->found = found;
+	root->recursive = recursive;
+	root->scanned = 0;
+	root->dir = feh_scan_dir_new(estrdup(path), NULL, NULL, root);
+
+#ifdef HAVE_PTHREAD
+	/* without subdirectories there is nothing to share */
+	if (recursive)
+		feh_scan_start_threads();
+#endif
+	if (thread_count) {
+		SCAN_LOCK();
+		queue = gib_list_add_end(queue, root->dir);
+		root->dir->node = gib_list_last(queue);
+		SCAN_BROADCAST();
+		SCAN_UNLOCK();
+	}
+	feh_scan_add_root(root);
+}
+
+/*
+ * Queues the regular file path, to be passed to found once everything
+ * queued before it was.
+ */
+void feh_scan_start_file(char *path, feh_scan_fn found)
+{
+	feh_scan_root *root = emalloc(sizeof(feh_scan_root));
+
+	root->path = estrdup(path);
+	root->found = found;
+	root->recursive = 0;
+	root->scanned = 0;
+	root->dir = NULL;
+	feh_scan_add_root(root);
+}
+
+/*
+ * Returns 1 once dir was read. If steal is set (or no worker is going to
+ * read dir) and no worker got to dir yet, it is read right away. If block
+ * is set, this waits for the worker reading dir.
+ */
+static int feh_scan_ready(feh_scan_dir * dir, int steal, int block)
+{
+	int ready;
+
+	SCAN_LOCK();
+	if ((dir->state == SCAN_QUEUED) && (steal || block || !dir->node)) {
+		if (dir->node)
+			queue = gib_list_remove(queue, dir->node);
+		dir->node = NULL;
+		dir->state = SCAN_READING;
+		SCAN_UNLOCK();
+		feh_scan_read(dir);
+		SCAN_LOCK();
+	}
+	while (block && (dir->state != SCAN_DONE))
+		SCAN_WAIT();
+	ready = (dir->state == SCAN_DONE);
+	SCAN_UNLOCK();
+
+	if (ready && dir->err) {
+		errno = dir->err;
+		if (dir->open_failed) {
+			if (!opt.quiet)
+				weprintf("couldn't open directory %s:", dir->path);
+		} else if (errno == ENOMEM)
+			weprintf("Insufficient memory to scan directory %s:", dir->path);
+		else
+			weprintf("Failed to scan directory %s:", dir->path);
+		dir->err = 0;
+	}
+	return(ready);
+}
+
+static void feh_scan_root_done(void)
+{
+	feh_scan_root *root = roots->data;
+	double secs;
+
+	if (opt.verbose && root->scanned) {
+		secs = feh_get_time() - root->start;
+		fprintf(stderr, PACKAGE ": scanned %s: %lu entries in %.2fs (%.0f entries/s)\n",
+				root->path, root->scanned, secs,
+				secs > 0 ? root->scanned / secs : 0.0);
+	}
+
+	roots = gib_list_remove(roots, roots);
+	if (!roots) {
+		roots_last = NULL;
+#ifdef HAVE_PTHREAD
+		feh_scan_stop_threads();
+#endif
+	}
+
+	root->found(NULL, 0);
+	free(root->path);
+	free(root);
+}
+
+/*
+ * Passes on the files found so far, in order. Without block, this returns
+ * after SCAN_STEP_TIME or as soon as it would have to wait for a worker. With
+ * block, it first waits until there is at least one file. Returns 0 once
+ * everything queued was passed on.
+ */
+int feh_scan_step(int block)
+{
+	double start = feh_get_time();
+	feh_scan_root *root;
+	feh_scan_dir *dir;
+	feh_scan_entry *entry;
+	int found = 0;
+
+	while (roots) {
+		if (feh_get_time() - start > SCAN_STEP_TIME) {
+			if (found || !block) {
+				feh_scan_wake();
+				return(1);
+			}
+		}
+
+		root = roots->data;
+		if (!root->dir) {
+			root->found(root->path, 0);
+			found++;
+			feh_scan_root_done();
+			continue;
+		}
+		if (!frames)
+			frames = gib_list_add_front(frames, root->dir);
+
+		dir = frames->data;
+		if ((dir->emitted == 0)
+				&& !feh_scan_ready(dir, !thread_count, block && !found))
+			return(1);
+		if (dir->have_st && watch_fn) {
+			watch_fn(dir->path, &dir->st);
+			dir->have_st = 0;
+		}
+
+		while (dir->emitted < dir->entry_count) {
+			entry = &dir->entries[dir->emitted++];
+			if (entry->dir) {
+				frames = gib_list_add_front(frames, entry->dir);
+				break;
+			}
+			root->found(entry->path, entry->err);
+			free(entry->path);
+			found++;
+		}
+		if (frames->data != dir)
+			continue;
+
+		/* dir is done */
+		frames = gib_list_remove(frames, frames);
+		free(dir->entries);
+		free(dir->path);
+		free(dir->name);
+		free(dir);
+		if (!frames) {
+			root->dir = NULL;
+			feh_scan_root_done();
+		}
+	}
+	return(0);
+}
+
+/*
+ * Passes the regular files in the directory path to found, descending into
+ * subdirectories if recursive is set, and returns once they all were.
+ */
+void feh_scan(char *path, int recursive, feh_scan_fn found)
+{
+	feh_scan_start(path, recursive, found);
+	while (feh_scan_step(1));
+}
+
+/*
+ * Has fn called with the path and stat(2) data of every directory read from
+ * now on. The data is taken before the directory is read, so any later
+ * change to its entries shows in its mtime.
+ */
+void feh_scan_watch(feh_scan_dir_fn fn)
+{
+	watch_fn = fn;
+}
+
+int feh_scan_running(void)
+{
+	return(roots != NULL);
+}
+
+/*
+ * Stops the worker threads. Whatever was not passed on yet is lost.
+ */
+void feh_scan_cancel_all(void)
+{
+#ifdef HAVE_PTHREAD
+	feh_scan_stop_threads();
+#endif
+}
+
+void feh_scan_fdset(fd_set * fdset, int *fdsize)
+{
+	if (!roots)
+		return;
+
+	FD_SET(wake_fd[0], fdset);
+	if (wake_fd[0] >= *fdsize)
+		*fdsize = wake_fd[0] + 1;
+}
+
+void feh_scan_handle_fdset(fd_set * fdset)
+{
+	char buf[64];
+
+	if ((wake_fd[0] < 0) || !FD_ISSET(wake_fd[0], fdset))
+		return;
+
+	while (read(wake_fd[0], buf, sizeof(buf)) > 0);
+	if (roots)
+		feh_scan_step(0);
+}
@@ -0,0 +1,63 @@
+/* scan.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+ * Walks directory trees on a pool of worker threads. Each thread reads
+ * whole directories, sorts their entries like alphasort(3) and only stats
+ * those whose type readdir(3) does not report. The caller gets the results
+ * in depth-first order regardless of which thread read what, so the order
+ * is the same as that of a sequential walk.
+ *
+ * Directories (and single files which must stay behind them in the order)
+ * are queued with feh_scan_start and feh_scan_start_file. Their contents are
+ * passed on by feh_scan_step, which the main loop calls whenever the file
+ * descriptor set up by feh_scan_fdset becomes readable.
+ */
+
+/*
+ * Called for each regular file found, with err = 0, and for each entry
+ * which could not be stat'ed, with err set to the errno of the failure.
+ * After the last file of a queued directory (or the queued file itself), it
+ * is called with path NULL.
+ */
+typedef void (feh_scan_fn) (char *path, int err);
+
+/* see feh_scan_watch */
+typedef void (feh_scan_dir_fn) (char *path, struct stat * st);
+
+void feh_scan(char *path, int recursive, feh_scan_fn found);
+void feh_scan_start(char *path, int recursive, feh_scan_fn found);
+void feh_scan_start_file(char *path, feh_scan_fn found);
+int feh_scan_step(int block);
+void feh_scan_watch(feh_scan_dir_fn fn);
+int feh_scan_running(void);
+void feh_scan_cancel_all(void);
+void feh_scan_fdset(fd_set * fdset, int *fdsize);
+void feh_scan_handle_fdset(fd_set * fdset);
+
+#endif
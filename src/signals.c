@@ -74,8 +74,6 @@ void feh_handle_signal(int signo)
 {
 	switch (signo) {
 		case SIGALRM:
-			if (childpid)
-				killpg(childpid, SIGINT);
 			return;
 		case SIGTTIN:
 			// we were probably backgrounded while we were running
@@ -84,8 +82,6 @@ void feh_handle_signal(int signo)
 		case SIGINT:
 		case SIGTERM:
 		case SIGQUIT:
-			if (childpid)
-				killpg(childpid, SIGINT);
 			sig_exit = 128 + signo;
 			return;
 	}
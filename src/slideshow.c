@@ -28,8 +28,13 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "filelist.h"
 #include "timers.h"
 #include "winwidget.h"
+#include "prefetch.h"
 #include "options.h"
 #include "signals.h"
+#include "conversion.h"
+#include "http.h"
+#include "scan.h"
+#include "refresh.h"
 
 void init_slideshow_mode(void)
 {
@@ -106,6 +111,7 @@ void init_slideshow_mode(void)
 			last = NULL;
 		}
 		current_file = l;
+		feh_http_prefetch(l, opt.parallel_downloads);
 		if ((w = winwidget_create_from_file(l, WIN_TYPE_SLIDESHOW)) != NULL) {
 			success = 1;
 			winwidget_show(w);
@@ -113,10 +119,13 @@ void init_slideshow_mode(void)
 				feh_add_timer(cb_slide_timer, w, opt.slideshow_delay, "SLIDE_CHANGE");
 			if (opt.reload > 0)
 				feh_add_unique_timer(cb_reload_timer, w, opt.reload);
+			feh_prefetch_update(current_file, FORWARD);
 			break;
 		} else {
 			last = l;
 		}
+		if (!l->next)
+			feh_filelist_stream_wait();
 	}
 	if (!success)
 		show_mini_usage();
@@ -127,6 +136,10 @@ void init_slideshow_mode(void)
 void cb_slide_timer(void *data)
 {
     winwidget winwid = (winwidget) data;
+
+    /* slideshow_loaded restarts the timer once the image is shown */
+    if (winwid->converting || winwid->downloading)
+        return;
     
     /* If in transition, continue transition */
     if (winwid->in_transition) {
@@ -156,23 +169,28 @@ void cb_reload_timer(void *data)
 
 	winwidget w = (winwidget) data;
 
+	/*
+	 * Rebuilding the filelist would cancel the running conversion, and
+	 * there is nothing to reload before the first directory scan is done.
+	 */
+	if (w->converting || w->downloading || feh_filelist_stream_running()) {
+		feh_add_unique_timer(cb_reload_timer, w, opt.reload);
+		return;
+	}
+	feh_filelist_stream_finish();
+
 	/*
 	 * multi-window mode has no concept of a "current file" and
 	 * dynamically adding/removing windows is not implemented at the moment.
 	 * So don't reload filelists in multi-window mode.
 	 */
-	if (current_file != NULL) {
+	if ((current_file != NULL) && feh_filelist_refresh())
+		w->file = current_file;
+	else if (current_file != NULL) {
 		/* save the current filename for refinding it in new list */
 		current_filename = estrdup(FEH_FILE(current_file->data)->filename);
 
-		for (l = filelist; l; l = l->next) {
-			feh_file_free(l->data);
-			l->data = NULL;
-		}
-		gib_list_free_and_data(filelist);
-		filelist = NULL;
-		filelist_len = 0;
-		current_file = NULL;
+		feh_filelist_free();
 
 		/* rebuild filelist from original_file_items */
 		if (gib_list_length(original_file_items) > 0)
@@ -216,6 +234,8 @@ void slideshow_change_image(winwidget winwid, int change, int render)
     gib_list *previous_file = current_file;
     int i = 0;
     int jmp = 1;
+    int res;
+    int wrap = 0;
     int our_filelist_len = filelist_len;
 	
     /* If in transition, cancel it */
@@ -242,17 +262,26 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 
 	/* Without this, clicking a one-image slideshow reloads it. Not very *
 	   intelligent behaviour :-) */
-	if (filelist_len < 2 && opt.on_last_slide != ON_LAST_SLIDE_QUIT)
+	if (filelist_len < 2 && opt.on_last_slide != ON_LAST_SLIDE_QUIT
+			&& !feh_filelist_stream_wait())
 		return;
+	our_filelist_len = filelist_len;
+
+	/* Leaving a slide which is still being converted cancels its conversion */
+	if (winwid->converting)
+		feh_conversion_cancel(FEH_FILE(winwid->file->data));
+	else if (winwid->downloading)
+		feh_http_cancel(FEH_FILE(winwid->file->data)->filename);
 
 	/* Ok. I do this in such an odd way to ensure that if the last or first *
 	   image is not loadable, it will go through in the right direction to *
 	   find the correct one. Otherwise SLIDE_LAST would try the last file, *
 	   then loop forward to find a loadable one. */
 	if (change == SLIDE_FIRST) {
-		current_file = gib_list_last(filelist);
+		current_file = feh_filelist_nth(feh_filelist_length() - 1);
 		change = SLIDE_NEXT;
 		previous_file = NULL;
+		wrap = 1;
 	} else if (change == SLIDE_LAST) {
 		current_file = filelist;
 		change = SLIDE_PREV;
@@ -276,6 +305,10 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 #endif
 		switch (change) {
 		case SLIDE_NEXT:
+			/* Don't wrap around while the directory scan may find more */
+			if (!wrap && !current_file->next)
+				feh_filelist_stream_wait();
+			wrap = 0;
 			current_file = feh_list_jump(filelist, current_file, FORWARD, 1);
 			break;
 		case SLIDE_PREV:
@@ -370,10 +403,10 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 				current_file = previous_file;
 		}
 
-		if (winwidget_loadimage(winwid, FEH_FILE(current_file->data))) {
+		if ((res = winwidget_loadimage(winwid, FEH_FILE(current_file->data)))) {
 			int w = gib_imlib_image_get_width(winwid->im);
 			int h = gib_imlib_image_get_height(winwid->im);
-			if (feh_should_ignore_image(winwid->im)) {
+			if ((res > 0) && feh_should_ignore_image(winwid->im)) {
 				last = current_file;
 				continue;
 			}
@@ -396,6 +429,9 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 
 	if (filelist_len == 0)
 		eprintf("No more slides in show");
+
+	feh_prefetch_update(current_file, change == SLIDE_PREV ? BACK : FORWARD);
+	feh_http_prefetch(current_file->next, opt.parallel_downloads - 1);
     
 	/* If in transition, start transition timer */
 	if (winwid->in_transition && render) {
@@ -410,6 +446,77 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 	return;
 }
 
+/*
+ * Called from feh_conversion_handle_fdset and feh_http_handle_fdset once
+ * the file winwid shows a placeholder for is converted or downloaded.
+ */
+void slideshow_loaded(winwidget winwid)
+{
+	gib_list *failed = winwid->file;
+	int w, h;
+
+	if (winwid->in_transition) {
+		if (winwid->old_im) {
+			gib_imlib_free_image_and_decache(winwid->old_im);
+			winwid->old_im = NULL;
+		}
+		winwid->in_transition = 0;
+		winwid->transition_step = 0;
+	}
+
+	winwidget_free_image(winwid);
+	if (winwidget_loadimage(winwid, FEH_FILE(winwid->file->data)) > 0
+			&& !feh_should_ignore_image(winwid->im)) {
+		w = gib_imlib_image_get_width(winwid->im);
+		h = gib_imlib_image_get_height(winwid->im);
+		if ((winwid->im_w != w) || (winwid->im_h != h))
+			winwid->had_resize = 1;
+		winwidget_reset_image(winwid);
+		winwid->im_w = w;
+		winwid->im_h = h;
+		winwidget_render_image(winwid, 1, 0);
+		if (opt.slideshow_delay > 0.0)
+			feh_add_timer(cb_slide_timer, winwid, opt.slideshow_delay, "SLIDE_CHANGE");
+		return;
+	}
+
+	/* Conversion or download failed, move on as if the file had failed to load */
+	winwidget_free_image(winwid);
+	if (filelist_len > 1)
+		slideshow_change_image(winwid, SLIDE_NEXT, 1);
+	filelist = feh_file_remove_from_list(filelist, failed);
+	if (filelist_len == 0 || winwid->file == failed)
+		eprintf("No more slides in show");
+}
+
+/*
+ * Called from feh_http_handle_fdset while winwid is waiting for a download.
+ * Replaces the placeholder with what arrived so far.
+ */
+void slideshow_preview(winwidget winwid)
+{
+	Imlib_Image im;
+	int w, h;
+
+	if (winwid->in_transition
+			|| !feh_load_image_partial(&im, FEH_FILE(winwid->file->data),
+				winwid->w, winwid->h))
+		return;
+
+	w = gib_imlib_image_get_width(im);
+	h = gib_imlib_image_get_height(im);
+	gib_imlib_free_image(winwid->im);
+	winwid->im = im;
+	if ((winwid->im_w != w) || (winwid->im_h != h)) {
+		winwid->had_resize = 1;
+		winwidget_reset_image(winwid);
+		winwid->im_w = w;
+		winwid->im_h = h;
+		winwidget_render_image(winwid, 1, 0);
+	} else
+		winwidget_render_image(winwid, 0, 0);
+}
+
 void slideshow_pause_toggle(winwidget w)
 {
 	if (!opt.paused) {
@@ -458,7 +565,6 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 
 	ret[0] = '\0';
 	filelist_tmppath = NULL;
-	gib_list *f;
 
 	for (c = str; *c != '\0'; c++) {
 		if ((*c == '%') && (*(c+1) != '\0')) {
@@ -493,7 +599,7 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 				}
 				break;
 			case 'l':
-				snprintf(buf, sizeof(buf), "%d", gib_list_length(filelist));
+				snprintf(buf, sizeof(buf), "%d", feh_filelist_length());
 				strncat(ret, buf, sizeof(ret) - strlen(ret) - 1);
 				break;
 			case 'L':
@@ -557,8 +663,8 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 				}
 				break;
 			case 'u':
-				f = current_file ? current_file : gib_list_find_by_data(filelist, file);
-				snprintf(buf, sizeof(buf), "%d", f ? gib_list_num(filelist, f) + 1 : 0);
+				snprintf(buf, sizeof(buf), "%d", feh_filelist_num(current_file
+						? FEH_FILE(current_file->data) : file) + 1);
 				strncat(ret, buf, sizeof(ret) - strlen(ret) - 1);
 				break;
 			case 'v':
@@ -700,7 +806,7 @@ void slideshow_save_image(winwidget win)
 
 gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num)
 {
-	int i;
+	int i, len;
 	gib_list *ret = NULL;
 
 	if (!root)
@@ -708,6 +814,29 @@ gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num)
 	if (!l)
 		return (root);
 
+	/* Plain steps do not need the file table, which may have to be rebuilt */
+	if ((num == 1) && (direction == FORWARD ? l->next : l->prev))
+		return (direction == FORWARD ? l->next : l->prev);
+
+	if ((root == filelist) && ((i = feh_filelist_num(FEH_FILE(l->data))) >= 0)) {
+		len = feh_filelist_length();
+		if (direction == BACK)
+			return (feh_filelist_nth((((i - num) % len) + len) % len));
+		while (i + num >= len) {
+			num -= len - i;
+			i = 0;
+			if (opt.on_last_slide == ON_LAST_SLIDE_QUIT) {
+				exit(0);
+			}
+			if (opt.randomize) {
+				/* Randomize the filename order */
+				filelist = gib_list_randomize(filelist);
+				feh_filelist_changed();
+			}
+		}
+		return (feh_filelist_nth(i + num));
+	}
+
 	ret = l;
 
 	for (i = 0; i < num; i++) {
@@ -721,6 +850,7 @@ gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num)
 				if (opt.randomize) {
 					/* Randomize the filename order */
 					filelist = gib_list_randomize(filelist);
+					feh_filelist_changed();
 					ret = filelist;
 				} else {
 					ret = root;
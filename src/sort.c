@@ -0,0 +1,419 @@
+/* sort.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "sort.h"
+
+#include <stdint.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* Below this, starting threads costs more than it saves */
+#define SORT_PARALLEL_MIN 32768
+#define SORT_MAX_THREADS 16
+
+/* Longer digit runs are left to strverscmp */
+#define SORT_MAX_RUN 18
+
+typedef struct {
+	gib_list *node;
+	const char *str;	/* name, filename or format, if compared */
+	uint64_t prefix;	/* the first bytes of str, big-endian */
+	uint64_t run;		/* value of the digit run starting at digit */
+	long long num;		/* directory rank, mtime, size, ... */
+	int index;		/* position in the unsorted list */
+	unsigned char digit;	/* offset of the first digit in prefix, or 8 */
+	unsigned char run_len;	/* 0 if the run was too long to be stored */
+	unsigned char run_zero;	/* the run has leading zeroes */
+} feh_sort_key;
+
+typedef struct {
+	char *dir;
+	int len;
+	int rank;
+} feh_sort_dir;
+
+/* compare strings with strverscmp; set before sorting, read-only after */
+static int sort_version = 0;
+
+static void feh_sort_key_str(feh_sort_key * key, const char *str)
+{
+	unsigned char c;
+	int i;
+
+	key->str = str;
+	key->prefix = 0;
+	key->run = 0;
+	key->digit = 8;
+	key->run_len = 0;
+	key->run_zero = 0;
+	for (i = 0; i < 8; i++) {
+		c = str[i];
+		key->prefix |= (uint64_t) c << (56 - 8 * i);
+		if (!c)
+			return;
+		/*
+		 * strverscmp treats everything from the first digit on differently,
+		 * so the prefix stops there
+		 */
+		if (sort_version && isdigit(c)) {
+			key->digit = i;
+			break;
+		}
+	}
+	if (key->digit == 8)
+		return;
+
+	key->run_zero = (str[i] == '0');
+	for (; isdigit((unsigned char) str[i]); i++) {
+		if (++key->run_len > SORT_MAX_RUN) {
+			key->run_len = 0;
+			return;
+		}
+		key->run = key->run * 10 + (str[i] - '0');
+	}
+}
+
+static int feh_sort_cmp_str(const feh_sort_key * k1, const feh_sort_key * k2)
+{
+	int digit = k1->digit < k2->digit ? k1->digit : k2->digit;
+
+	/*
+	 * If the prefixes differ before either of them reaches a digit, both
+	 * strcmp and strverscmp come down to the first differing byte.
+	 */
+	if (k1->prefix != k2->prefix) {
+		if ((digit == 8)
+				|| (digit && ((k1->prefix ^ k2->prefix) >> (64 - 8 * digit))))
+			return(k1->prefix < k2->prefix ? -1 : 1);
+	} else if ((digit == 8) && !(k1->prefix & 0xff))
+		return(0);
+
+	/*
+	 * Otherwise, with the same text in front of the first digit run, two
+	 * runs of the same length or without leading zeroes compare like the
+	 * numbers they spell -- in any strverscmp implementation.
+	 */
+	if (sort_version && (k1->digit == k2->digit) && (digit < 8)
+			&& k1->run_len && k2->run_len) {
+		if ((k1->run == k2->run) && (k1->run_len == k2->run_len)) {
+			/* identical up to the end of the run, which ends in both */
+			digit += k1->run_len;
+			return(strverscmp(k1->str + digit, k2->str + digit));
+		}
+		if ((k1->run_len == k2->run_len) || (!k1->run_zero && !k2->run_zero))
+			return(k1->run < k2->run ? -1 : 1);
+	}
+
+	if (sort_version)
+		return(strverscmp(k1->str, k2->str));
+	return(strcmp(k1->str, k2->str));
+}
+
+static int feh_sort_cmp(const void *key1, const void *key2)
+{
+	const feh_sort_key *k1 = key1, *k2 = key2;
+	int cmp;
+
+	if (k1->num != k2->num)
+		return(k1->num < k2->num ? -1 : 1);
+	if (k1->str && (cmp = feh_sort_cmp_str(k1, k2)))
+		return(cmp);
+	/*
+	 * The filelist is still back-to-front when it is sorted, so equal
+	 * files end up in command line order like with gib_list_sort.
+	 */
+	return(k2->index - k1->index);
+}
+
+static int feh_sort_cmp_dir(const void *dir1, const void *dir2)
+{
+	const feh_sort_dir *d1 = *(feh_sort_dir * const *) dir1;
+	const feh_sort_dir *d2 = *(feh_sort_dir * const *) dir2;
+
+	if (sort_version)
+		return(strverscmp(d1->dir, d2->dir));
+	return(strcmp(d1->dir, d2->dir));
+}
+
+/*
+ * Replaces the directory of each file by its rank among all directories in
+ * keys[].num, so that they need not be compared while sorting. Each
+ * directory is copied once and found again through a hash table; files from
+ * one directory usually follow each other and skip even that.
+ */
+static void feh_sort_dir_ranks(feh_sort_key * keys, int count)
+{
+	feh_sort_dir *dirs, **sorted;
+	feh_file *file;
+	int *table;
+	int table_size = 1024, dir_count = 0, dir = -1;
+	int i, j, k, len;
+	uint32_t hash;
+
+	dirs = emalloc(count * sizeof(feh_sort_dir));
+	table = emalloc(table_size * sizeof(int));
+	memset(table, -1, table_size * sizeof(int));
+
+	for (i = 0; i < count; i++) {
+		file = FEH_FILE(keys[i].node->data);
+		/* same rules as feh_file_dirname */
+		len = strlen(file->filename) - strlen(file->name);
+		if ((len <= 0) || (len >= PATH_MAX))
+			len = 0;
+		if ((dir >= 0) && (len == dirs[dir].len)
+				&& !memcmp(dirs[dir].dir, file->filename, len)) {
+			keys[i].num = dir;
+			continue;
+		}
+
+		hash = feh_hash32(file->filename, len);
+		for (j = hash & (table_size - 1); (dir = table[j]) >= 0;
+				j = (j + 1) & (table_size - 1))
+			if ((len == dirs[dir].len) && !memcmp(dirs[dir].dir, file->filename, len))
+				break;
+		if (dir < 0) {
+			dir = dir_count++;
+			dirs[dir].dir = emalloc(len + 1);
+			memcpy(dirs[dir].dir, file->filename, len);
+			dirs[dir].dir[len] = '\0';
+			dirs[dir].len = len;
+			table[j] = dir;
+			if (dir_count * 2 > table_size) {
+				table_size *= 2;
+				table = erealloc(table, table_size * sizeof(int));
+				memset(table, -1, table_size * sizeof(int));
+				for (j = 0; j < dir_count; j++) {
+					hash = feh_hash32(dirs[j].dir, dirs[j].len);
+					for (k = hash & (table_size - 1); table[k] >= 0;
+							k = (k + 1) & (table_size - 1));
+					table[k] = j;
+				}
+			}
+		}
+		keys[i].num = dir;
+	}
+	free(table);
+
+	sorted = emalloc(dir_count * sizeof(feh_sort_dir *));
+	for (i = 0; i < dir_count; i++)
+		sorted[i] = &dirs[i];
+	qsort(sorted, dir_count, sizeof(feh_sort_dir *), feh_sort_cmp_dir);
+	for (i = 0; i < dir_count; i++)
+		sorted[i]->rank = i;
+
+	for (i = 0; i < count; i++)
+		keys[i].num = dirs[keys[i].num].rank;
+
+	for (i = 0; i < dir_count; i++)
+		free(dirs[i].dir);
+	free(sorted);
+	free(dirs);
+}
+
+#ifdef HAVE_PTHREAD
+typedef struct {
+	feh_sort_key *src;
+	feh_sort_key *dst;
+	int start;
+	int mid;
+	int end;
+} feh_sort_job;
+
+static void *feh_sort_chunk(void *arg)
+{
+	feh_sort_job *job = arg;
+
+	qsort(job->src + job->start, job->end - job->start,
+			sizeof(feh_sort_key), feh_sort_cmp);
+	return(NULL);
+}
+
+static void *feh_sort_merge(void *arg)
+{
+	feh_sort_job *job = arg;
+	feh_sort_key *src = job->src;
+	feh_sort_key *dst = job->dst + job->start;
+	int i = job->start, j = job->mid;
+
+	while ((i < job->mid) && (j < job->end)) {
+		if (feh_sort_cmp(&src[j], &src[i]) < 0)
+			*dst++ = src[j++];
+		else
+			*dst++ = src[i++];
+	}
+	memcpy(dst, &src[i], (job->mid - i) * sizeof(feh_sort_key));
+	dst += job->mid - i;
+	memcpy(dst, &src[j], (job->end - j) * sizeof(feh_sort_key));
+	return(NULL);
+}
+
+/* Runs fn on all jobs, each but the first one on a thread of its own */
+static void feh_sort_run(void *(*fn)(void *), feh_sort_job * jobs, int count)
+{
+	pthread_t threads[SORT_MAX_THREADS];
+	int started[SORT_MAX_THREADS];
+	int i;
+
+	for (i = 1; i < count; i++)
+		started[i] = !pthread_create(&threads[i], NULL, fn, &jobs[i]);
+	fn(&jobs[0]);
+	for (i = 1; i < count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			fn(&jobs[i]);
+	}
+}
+
+/*
+ * Sorts one chunk of keys per CPU, and then merges pairs of adjacent chunks
+ * until a single one is left
+ */
+static void feh_sort_keys_parallel(feh_sort_key * keys, int count, int chunks)
+{
+	feh_sort_job jobs[SORT_MAX_THREADS];
+	int bounds[SORT_MAX_THREADS + 1];
+	feh_sort_key *src = keys, *dst, *tmp;
+	int i, width, job_count;
+
+	for (i = 0; i <= chunks; i++)
+		bounds[i] = (long long) count * i / chunks;
+	for (i = 0; i < chunks; i++) {
+		jobs[i].src = keys;
+		jobs[i].start = bounds[i];
+		jobs[i].end = bounds[i + 1];
+	}
+	feh_sort_run(feh_sort_chunk, jobs, chunks);
+
+	dst = emalloc(count * sizeof(feh_sort_key));
+	tmp = dst;
+	for (width = 1; width < chunks; width *= 2) {
+		job_count = 0;
+		for (i = 0; i < chunks; i += 2 * width) {
+			jobs[job_count].src = src;
+			jobs[job_count].dst = dst;
+			jobs[job_count].start = bounds[i];
+			jobs[job_count].mid = bounds[i + width < chunks ? i + width : chunks];
+			jobs[job_count].end = bounds[i + 2 * width < chunks ? i + 2 * width : chunks];
+			job_count++;
+		}
+		feh_sort_run(feh_sort_merge, jobs, job_count);
+		dst = src;
+		src = jobs[0].dst;
+	}
+	if (src != keys)
+		memcpy(keys, src, count * sizeof(feh_sort_key));
+	free(tmp);
+}
+#endif
+
+static void feh_sort_keys(feh_sort_key * keys, int count)
+{
+#ifdef HAVE_PTHREAD
+	long chunks = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (chunks > SORT_MAX_THREADS)
+		chunks = SORT_MAX_THREADS;
+	if ((chunks > 1) && (count >= SORT_PARALLEL_MIN)) {
+		feh_sort_keys_parallel(keys, count, chunks);
+		return;
+	}
+#endif
+	qsort(keys, count, sizeof(feh_sort_key), feh_sort_cmp);
+}
+
+gib_list *feh_filelist_sort(gib_list * list, enum sort_type sort)
+{
+	feh_sort_key *keys;
+	feh_file *file;
+	gib_list *l;
+	int count, i;
+
+	if ((sort == SORT_NONE) || !list || !list->next)
+		return(list);
+
+	count = gib_list_length(list);
+	D(("sorting %d files by %d\n", count, sort));
+
+	/* formats are always compared with strcmp */
+	sort_version = opt.version_sort && (sort != SORT_FORMAT);
+
+	keys = emalloc(count * sizeof(feh_sort_key));
+	for (l = list, i = 0; l; l = l->next, i++) {
+		file = FEH_FILE(l->data);
+		keys[i].node = l;
+		keys[i].str = NULL;
+		keys[i].num = 0;
+		keys[i].index = i;
+		switch (sort) {
+		case SORT_NAME:
+		case SORT_DIRNAME:
+			feh_sort_key_str(&keys[i], file->name);
+			break;
+		case SORT_FILENAME:
+			feh_sort_key_str(&keys[i], file->filename);
+			break;
+		case SORT_SIZE:
+			keys[i].num = file->size;
+			break;
+		case SORT_MTIME:
+			/* newest first */
+			keys[i].num = -(long long) file->mtime;
+			break;
+		case SORT_WIDTH:
+			keys[i].num = file->info->width;
+			break;
+		case SORT_HEIGHT:
+			keys[i].num = file->info->height;
+			break;
+		case SORT_PIXELS:
+			keys[i].num = file->info->pixels;
+			break;
+		case SORT_FORMAT:
+			feh_sort_key_str(&keys[i], file->info->format ? file->info->format : "");
+			break;
+		default:
+			break;
+		}
+	}
+	if (sort == SORT_DIRNAME)
+		feh_sort_dir_ranks(keys, count);
+
+	feh_sort_keys(keys, count);
+
+	for (i = 0; i < count; i++) {
+		l = keys[i].node;
+		l->prev = i ? keys[i - 1].node : NULL;
+		l->next = (i + 1 < count) ? keys[i + 1].node : NULL;
+	}
+	list = keys[0].node;
+	free(keys);
+	return(list);
+}
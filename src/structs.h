@@ -31,6 +31,7 @@ typedef struct __fehtimer _fehtimer;
 typedef _fehtimer *fehtimer;
 typedef struct __feh_file feh_file;
 typedef struct __feh_file_info feh_file_info;
+typedef struct __feh_image_key feh_image_key;
 typedef struct __winwidget _winwidget;
 typedef _winwidget *winwidget;
 typedef struct __fehoptions fehoptions;
@@ -0,0 +1,761 @@
+/* thumbatlas.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "thumbatlas.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define THUMBATLAS_MAGIC "fehatls1"
+
+/*
+ * An atlas consists of a header, the entries sorted by name, a pool of
+ * NUL-terminated strings starting with the path of the directory, and the
+ * uncompressed ARGB pixels of the thumbnails, each starting at a multiple
+ * of 16 bytes.
+ */
+typedef struct {
+	char magic[8];
+	/* see feh_thumbatlas_key */
+	uint32_t key;
+	/* the size thumbnails were scaled to fit into */
+	uint32_t dim;
+	uint32_t count;
+	uint32_t entry_size;
+	uint64_t strings;
+	/* of the whole file */
+	uint64_t size;
+} feh_thumbatlas_header;
+
+typedef struct {
+	int64_t mtime;
+	int64_t mtime_nsec;
+	int64_t size;
+	/* offset of the pixels in the file (in the spool file until saved) */
+	uint64_t pixels;
+	/* offset into the string pool */
+	uint32_t name;
+	int32_t orig_width;
+	int32_t orig_height;
+	int32_t width;
+	int32_t height;
+	uint8_t has_alpha;
+	uint8_t pad[3];
+} feh_thumbatlas_entry;
+
+typedef struct {
+	void *map;
+	size_t map_size;
+	feh_thumbatlas_entry *entries;
+	uint32_t count;
+	char *strings;
+	uint64_t strings_size;
+} feh_thumbatlas_view;
+
+/* a thumbnail created in this run, its pixels are in the spool file fd */
+typedef struct {
+	char *name;
+	feh_thumbatlas_entry entry;
+	int fd;
+} feh_thumbatlas_added;
+
+/*
+ * A thumbnail worker writes each thumbnail to its spool file as a record:
+ * this header, the directory and the name of the file (NUL-terminated) and
+ * the pixels, which start at entry.pixels.
+ */
+typedef struct {
+	feh_thumbatlas_entry entry;
+	uint32_t dir_len;
+	uint32_t name_len;
+} feh_thumbatlas_record;
+
+typedef struct {
+	char *path;
+	uint64_t hash;
+	char *cache_file;
+	/* the atlas as of the first file looked up in this directory */
+	feh_thumbatlas_view view;
+	feh_thumbatlas_added *added;
+	unsigned int added_count;
+	unsigned int added_size;
+} feh_thumbatlas_dir;
+
+/* an entry of an atlas being written, and where its pixels come from */
+typedef struct {
+	char *name;
+	feh_thumbatlas_entry entry;
+	/* in the old atlas, or NULL if they are at spool_offset of spool_fd */
+	char *pixels;
+	int spool_fd;
+	uint64_t spool_offset;
+	unsigned int order;
+} feh_thumbatlas_source;
+
+static char *atlas_dir = NULL;
+static uint32_t atlas_dim = 0;
+
+/* the directories seen so far, dir_table holds their number + 1, or 0 */
+static feh_thumbatlas_dir **dirs = NULL;
+static unsigned int dir_count = 0;
+static unsigned int dir_size = 0;
+static uint32_t *dir_table = NULL;
+static uint32_t dir_buckets = 0;
+static feh_thumbatlas_dir *last_dir = NULL;
+
+/*
+ * The pixels of new thumbnails are kept in an unlinked file until they are
+ * saved. A forked process must not use the one of its parent; thumbnail
+ * workers are handed their own, see feh_thumbatlas_spool_to.
+ */
+static int spool_fd = -1;
+static int spool_failed = 0;
+static uint64_t spool_len = 0;
+static pid_t spool_pid = 0;
+static int spool_records = 0;
+
+/* spool files of thumbnail workers, see feh_thumbatlas_collect */
+static int *worker_spools = NULL;
+static unsigned int worker_spool_count = 0;
+
+/*
+ * Atlases written with a different --auto-rotate setting hold differently
+ * oriented thumbnails, so they are not used.
+ */
+static uint32_t feh_thumbatlas_key(void)
+{
+	uint32_t key = 0;
+
+#ifdef HAVE_LIBEXIF
+	if (opt.auto_rotate)
+		key |= 1U << 31;
+#endif
+	return(key);
+}
+
+/*
+ * Creates $XDG_CACHE_HOME/feh/thumbnails/<size_dir> for thumbnails of up to
+ * dim x dim pixels. Returns 0 if the atlases cannot be used.
+ */
+int feh_thumbatlas_init(char *size_dir, int dim)
+{
+	char *subdir;
+
+	if (atlas_dir)
+		return(1);
+
+	subdir = estrjoin("/", "thumbnails", size_dir, NULL);
+	atlas_dir = feh_cache_dir(subdir);
+	free(subdir);
+	atlas_dim = dim;
+	spool_pid = getpid();
+	feh_full_path_init();
+	return(atlas_dir != NULL);
+}
+
+/*
+ * Writes the absolute path of filename to buf and splits it into directory
+ * and name. Returns the name, or NULL for URLs and paths which do not fit.
+ */
+static char *feh_thumbatlas_split(char *filename, char *buf, size_t size)
+{
+	char *name;
+
+	if (path_is_url(filename) || !(filename = feh_full_path(filename, buf, size)))
+		return(NULL);
+	if ((filename != buf) && (snprintf(buf, size, "%s", filename) >= (int) size))
+		return(NULL);
+
+	name = strrchr(buf, '/');
+	*name = '\0';
+	return(name + 1);
+}
+
+static int feh_thumbatlas_view_check(feh_thumbatlas_view * view, char *path)
+{
+	feh_thumbatlas_header *header = view->map;
+	feh_thumbatlas_entry *entry;
+	uint64_t size;
+	uint32_t i;
+
+	size = sizeof(feh_thumbatlas_header)
+		+ (uint64_t) header->count * sizeof(feh_thumbatlas_entry)
+		+ header->strings;
+	if (memcmp(header->magic, THUMBATLAS_MAGIC, 8)
+			|| (header->key != feh_thumbatlas_key())
+			|| (header->dim != atlas_dim)
+			|| (header->entry_size != sizeof(feh_thumbatlas_entry))
+			|| (header->size != view->map_size)
+			|| (size > view->map_size) || !header->strings)
+		return(0);
+
+	view->entries = (feh_thumbatlas_entry *) (header + 1);
+	view->count = header->count;
+	view->strings = (char *) (view->entries + header->count);
+	view->strings_size = header->strings;
+	if (view->strings[view->strings_size - 1] || strcmp(view->strings, path))
+		return(0);
+
+	for (i = 0; i < view->count; i++) {
+		entry = &view->entries[i];
+		if ((entry->name >= view->strings_size)
+				|| (entry->width <= 0) || (entry->height <= 0)
+				|| ((uint32_t) entry->width > atlas_dim)
+				|| ((uint32_t) entry->height > atlas_dim)
+				|| (entry->pixels & 15) || (entry->pixels < size)
+				|| (entry->pixels + (uint64_t) entry->width * entry->height
+					* sizeof(DATA32) > view->map_size))
+			return(0);
+	}
+	return(1);
+}
+
+/*
+ * Maps the atlas of the directory path from file. Returns 0 if there is none
+ * or it cannot be used.
+ */
+static int feh_thumbatlas_view_open(feh_thumbatlas_view * view, char *file,
+		char *path)
+{
+	int fd;
+	struct stat st;
+
+	memset(view, 0, sizeof(feh_thumbatlas_view));
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) == -1)
+		return(0);
+	if (!fstat(fd, &st) && (st.st_size >= (off_t) sizeof(feh_thumbatlas_header)))
+		view->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (!view->map || (view->map == MAP_FAILED)) {
+		view->map = NULL;
+		return(0);
+	}
+	view->map_size = st.st_size;
+
+	if (!feh_thumbatlas_view_check(view, path)) {
+		D(("ignoring invalid thumbnail atlas %s\n", file));
+		munmap(view->map, view->map_size);
+		memset(view, 0, sizeof(feh_thumbatlas_view));
+		return(0);
+	}
+	D(("thumbnail atlas %s has %u entries\n", file, view->count));
+	return(1);
+}
+
+static feh_thumbatlas_entry *feh_thumbatlas_find(feh_thumbatlas_view * view,
+		char *name)
+{
+	uint32_t lo = 0, hi = view->count, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, view->strings + view->entries[mid].name);
+		if (!cmp)
+			return(&view->entries[mid]);
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return(NULL);
+}
+
+static void feh_thumbatlas_table_add(uint32_t n)
+{
+	uint32_t i;
+
+	for (i = dirs[n - 1]->hash & (dir_buckets - 1); dir_table[i];
+			i = (i + 1) & (dir_buckets - 1));
+	dir_table[i] = n;
+}
+
+/*
+ * Returns the directory path, mapping its atlas if it is new.
+ */
+static feh_thumbatlas_dir *feh_thumbatlas_get_dir(char *path)
+{
+	uint64_t hash = feh_hash64(path);
+	feh_thumbatlas_dir *d;
+	char name[32];
+	uint32_t i, n;
+
+	if (last_dir && (last_dir->hash == hash) && !strcmp(last_dir->path, path))
+		return(last_dir);
+
+	if (dir_buckets) {
+		for (i = hash & (dir_buckets - 1); (n = dir_table[i]);
+				i = (i + 1) & (dir_buckets - 1)) {
+			d = dirs[n - 1];
+			if ((d->hash == hash) && !strcmp(d->path, path))
+				return(last_dir = d);
+		}
+	}
+
+	if (dir_count == dir_size) {
+		dir_size = dir_size ? dir_size * 2 : 64;
+		dirs = erealloc(dirs, dir_size * sizeof(feh_thumbatlas_dir *));
+	}
+	d = emalloc(sizeof(feh_thumbatlas_dir));
+	memset(d, 0, sizeof(feh_thumbatlas_dir));
+	d->path = estrdup(path);
+	d->hash = hash;
+	snprintf(name, sizeof(name), "%016llx.atlas", (unsigned long long) hash);
+	d->cache_file = estrjoin("/", atlas_dir, name, NULL);
+	feh_thumbatlas_view_open(&d->view, d->cache_file, path);
+	dirs[dir_count++] = d;
+
+	if (2 * dir_count > dir_buckets) {
+		dir_buckets = dir_buckets ? dir_buckets * 2 : 128;
+		dir_table = erealloc(dir_table, dir_buckets * sizeof(uint32_t));
+		memset(dir_table, 0, dir_buckets * sizeof(uint32_t));
+		for (n = 1; n < dir_count; n++)
+			feh_thumbatlas_table_add(n);
+	}
+	feh_thumbatlas_table_add(dir_count);
+
+	return(last_dir = d);
+}
+
+/*
+ * Loads the thumbnail of file from the atlas of its directory if file's size
+ * and mtime still match.
+ */
+int feh_thumbatlas_lookup(Imlib_Image * image, feh_file * file, int *orig_w,
+		int *orig_h)
+{
+	char buf[PATH_MAX];
+	char *name;
+	feh_thumbatlas_dir *d;
+	feh_thumbatlas_entry *entry;
+	struct stat st;
+
+	if (!atlas_dir || !(name = feh_thumbatlas_split(file->filename, buf,
+					sizeof(buf))))
+		return(0);
+
+	d = feh_thumbatlas_get_dir(buf);
+	if (!d->view.map || !(entry = feh_thumbatlas_find(&d->view, name))
+			|| stat(file->filename, &st)
+			|| (entry->mtime != st.st_mtim.tv_sec)
+			|| (entry->mtime_nsec != st.st_mtim.tv_nsec)
+			|| (entry->size != st.st_size))
+		return(0);
+
+	*image = imlib_create_image_using_copied_data(entry->width, entry->height,
+			(DATA32 *) ((char *) d->view.map + entry->pixels));
+	if (!*image)
+		return(0);
+	imlib_context_set_image(*image);
+	imlib_image_set_has_alpha(entry->has_alpha);
+	*orig_w = entry->orig_width;
+	*orig_h = entry->orig_height;
+	return(1);
+}
+
+/*
+ * Forgets the thumbnails added so far. In a forked thumbnail worker, these
+ * are the parent's, which the parent saves itself.
+ */
+static void feh_thumbatlas_reset(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < dir_count; i++) {
+		for (j = 0; j < dirs[i]->added_count; j++)
+			free(dirs[i]->added[j].name);
+		dirs[i]->added_count = 0;
+	}
+	if (spool_fd != -1)
+		close(spool_fd);
+	for (i = 0; i < worker_spool_count; i++)
+		close(worker_spools[i]);
+	worker_spool_count = 0;
+	spool_fd = -1;
+	spool_failed = 0;
+	spool_len = 0;
+	spool_pid = getpid();
+}
+
+/* returns an unlinked file in the atlas directory, or -1 */
+static int feh_thumbatlas_spool_create(void)
+{
+	char *tmpname;
+	int fd;
+
+	tmpname = estrjoin("/", atlas_dir, ".spool_XXXXXX", NULL);
+	if ((fd = mkstemp(tmpname)) == -1) {
+		weprintf("cannot create thumbnail spool file %s:", tmpname);
+		spool_failed = 1;
+	} else {
+		unlink(tmpname);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+	free(tmpname);
+	return(fd);
+}
+
+/*
+ * Returns a spool file for a thumbnail worker about to be forked, or -1 if
+ * atlases are not used or cannot be written.
+ */
+int feh_thumbatlas_spool_open(void)
+{
+	if (!atlas_dir || spool_failed)
+		return(-1);
+	return(feh_thumbatlas_spool_create());
+}
+
+/*
+ * Called in a forked thumbnail worker with a file from
+ * feh_thumbatlas_spool_open. Thumbnails stored from now on are written to
+ * it as records, which the parent reads with feh_thumbatlas_collect once
+ * the worker has exited. With fd -1, they are not kept.
+ */
+void feh_thumbatlas_spool_to(int fd)
+{
+	feh_thumbatlas_reset();
+	spool_fd = fd;
+	spool_failed = (fd == -1);
+	spool_records = 1;
+}
+
+static void feh_thumbatlas_add(char *path, char *name,
+		feh_thumbatlas_entry * entry, int fd)
+{
+	feh_thumbatlas_dir *d = feh_thumbatlas_get_dir(path);
+	feh_thumbatlas_added *added;
+
+	if (d->added_count == d->added_size) {
+		d->added_size = d->added_size ? d->added_size * 2 : 64;
+		d->added = erealloc(d->added,
+				d->added_size * sizeof(feh_thumbatlas_added));
+	}
+	added = &d->added[d->added_count++];
+	added->name = estrdup(name);
+	added->entry = *entry;
+	added->fd = fd;
+}
+
+/*
+ * Remembers image, the thumbnail of file scaled to fit into the atlas size,
+ * for feh_thumbatlas_save.
+ */
+void feh_thumbatlas_store(feh_file * file, Imlib_Image image, int orig_w,
+		int orig_h)
+{
+	char buf[PATH_MAX];
+	char *name;
+	feh_thumbatlas_entry entry;
+	feh_thumbatlas_record record;
+	struct stat st;
+	uint64_t offset = spool_len;
+	size_t len;
+	int w, h;
+
+	/* a forked process which was not handed a spool file */
+	if (spool_pid != getpid())
+		return;
+
+	if (!atlas_dir || !(name = feh_thumbatlas_split(file->filename, buf,
+					sizeof(buf))) || stat(file->filename, &st))
+		return;
+
+	w = gib_imlib_image_get_width(image);
+	h = gib_imlib_image_get_height(image);
+	if ((w <= 0) || (h <= 0) || ((uint32_t) w > atlas_dim)
+			|| ((uint32_t) h > atlas_dim))
+		return;
+
+	if (spool_failed)
+		return;
+	if ((spool_fd == -1) && ((spool_fd = feh_thumbatlas_spool_create()) == -1))
+		return;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mtime = st.st_mtim.tv_sec;
+	entry.mtime_nsec = st.st_mtim.tv_nsec;
+	entry.size = st.st_size;
+	entry.orig_width = orig_w;
+	entry.orig_height = orig_h;
+	entry.width = w;
+	entry.height = h;
+	entry.has_alpha = gib_imlib_image_has_alpha(image);
+	len = (size_t) w * h * sizeof(DATA32);
+
+	if (spool_records) {
+		memset(&record, 0, sizeof(record));
+		record.dir_len = strlen(buf) + 1;
+		record.name_len = strlen(name) + 1;
+		offset += sizeof(record) + record.dir_len + record.name_len;
+		entry.pixels = offset;
+		record.entry = entry;
+		if (!feh_io_all(spool_fd, &record, sizeof(record), (off_t) spool_len, 0)
+				|| !feh_io_all(spool_fd, buf, record.dir_len,
+					(off_t) (spool_len + sizeof(record)), 0)
+				|| !feh_io_all(spool_fd, name, record.name_len,
+					(off_t) (spool_len + sizeof(record) + record.dir_len), 0)) {
+			/* the parent stops reading at the broken record */
+			spool_failed = 1;
+			return;
+		}
+	}
+
+	imlib_context_set_image(image);
+	if (!feh_io_all(spool_fd, imlib_image_get_data_for_reading_only(),
+				len, (off_t) offset, 0)) {
+		if (spool_records)
+			spool_failed = 1;
+		return;
+	}
+	spool_len = offset + len;
+
+	entry.pixels = offset;
+	if (!spool_records)
+		feh_thumbatlas_add(buf, name, &entry, spool_fd);
+}
+
+/*
+ * Takes over the spool file fd of a thumbnail worker which has exited, so
+ * that feh_thumbatlas_save merges the thumbnails in it along with the ones
+ * of this process. A record the worker did not finish ends the file.
+ */
+void feh_thumbatlas_collect(int fd)
+{
+	char dir[PATH_MAX], name[PATH_MAX];
+	feh_thumbatlas_record record;
+	struct stat st;
+	uint64_t offset = 0, len;
+	int used = 0;
+
+	if (fd == -1)
+		return;
+	if (!atlas_dir || (spool_pid != getpid()) || fstat(fd, &st)) {
+		close(fd);
+		return;
+	}
+
+	while ((offset + sizeof(record) <= (uint64_t) st.st_size)
+			&& feh_io_all(fd, &record, sizeof(record), (off_t) offset, 1)) {
+		len = (uint64_t) record.entry.width * record.entry.height
+			* sizeof(DATA32);
+		if (!record.dir_len || (record.dir_len > sizeof(dir))
+				|| !record.name_len || (record.name_len > sizeof(name))
+				|| (record.entry.width <= 0) || (record.entry.height <= 0)
+				|| ((uint32_t) record.entry.width > atlas_dim)
+				|| ((uint32_t) record.entry.height > atlas_dim)
+				|| (record.entry.pixels != offset + sizeof(record)
+					+ record.dir_len + record.name_len)
+				|| (record.entry.pixels + len > (uint64_t) st.st_size)
+				|| !feh_io_all(fd, dir, record.dir_len,
+					(off_t) (offset + sizeof(record)), 1)
+				|| !feh_io_all(fd, name, record.name_len,
+					(off_t) (offset + sizeof(record) + record.dir_len), 1)
+				|| dir[record.dir_len - 1] || name[record.name_len - 1])
+			break;
+		feh_thumbatlas_add(dir, name, &record.entry, fd);
+		used = 1;
+		offset = record.entry.pixels + len;
+	}
+
+	if (!used) {
+		close(fd);
+		return;
+	}
+	worker_spools = erealloc(worker_spools,
+			(worker_spool_count + 1) * sizeof(int));
+	worker_spools[worker_spool_count++] = fd;
+}
+
+static int feh_thumbatlas_source_cmp(const void *a, const void *b)
+{
+	const feh_thumbatlas_source *sa = a, *sb = b;
+	int cmp = strcmp(sa->name, sb->name);
+
+	if (cmp)
+		return(cmp);
+	return((sa->order > sb->order) - (sa->order < sb->order));
+}
+
+/*
+ * Writes the atlas of d with this run's thumbnails merged into the current
+ * one, which another feh (or thumbnail worker) may have replaced since d was
+ * mapped. Entries of files which were removed or changed are dropped.
+ */
+static void feh_thumbatlas_write(feh_thumbatlas_dir * d)
+{
+	static const char zero[16] = { 0 };
+	feh_thumbatlas_view old;
+	feh_thumbatlas_source *sources;
+	feh_thumbatlas_header header;
+	uint64_t strings_len, data_start, offset, len;
+	unsigned int i, count, order = 0;
+	char path[PATH_MAX];
+	char *name, *tmpname, *buf = NULL, *pixels;
+	struct stat st;
+	FILE *fp;
+	int fd, err = 0;
+
+	feh_thumbatlas_view_open(&old, d->cache_file, d->path);
+	sources = emalloc((d->added_count + old.count) * sizeof(feh_thumbatlas_source));
+
+	/* newer thumbnails get a lower order, so they win */
+	for (i = d->added_count; i-- > 0; order++) {
+		sources[order].name = d->added[i].name;
+		sources[order].entry = d->added[i].entry;
+		sources[order].pixels = NULL;
+		sources[order].spool_fd = d->added[i].fd;
+		sources[order].spool_offset = d->added[i].entry.pixels;
+		sources[order].order = order;
+	}
+	for (i = 0; i < old.count; i++) {
+		name = old.strings + old.entries[i].name;
+		if ((snprintf(path, sizeof(path), "%s/%s", d->path, name)
+					>= (int) sizeof(path)) || stat(path, &st)
+				|| (old.entries[i].mtime != st.st_mtim.tv_sec)
+				|| (old.entries[i].mtime_nsec != st.st_mtim.tv_nsec)
+				|| (old.entries[i].size != st.st_size))
+			continue;
+		sources[order].name = name;
+		sources[order].entry = old.entries[i];
+		sources[order].pixels = (char *) old.map + old.entries[i].pixels;
+		sources[order].order = order;
+		order++;
+	}
+	qsort(sources, order, sizeof(feh_thumbatlas_source), feh_thumbatlas_source_cmp);
+
+	strings_len = strlen(d->path) + 1;
+	for (i = 0, count = 0; i < order; i++) {
+		if (count && !strcmp(sources[count - 1].name, sources[i].name))
+			continue;
+		sources[count] = sources[i];
+		sources[count].entry.name = strings_len;
+		strings_len += strlen(sources[i].name) + 1;
+		count++;
+	}
+
+	data_start = sizeof(header) + (uint64_t) count * sizeof(feh_thumbatlas_entry)
+		+ strings_len;
+	data_start = (data_start + 15) & ~(uint64_t) 15;
+	for (i = 0, offset = data_start; i < count; i++) {
+		sources[i].entry.pixels = offset;
+		len = (uint64_t) sources[i].entry.width * sources[i].entry.height
+			* sizeof(DATA32);
+		offset += (len + 15) & ~(uint64_t) 15;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, THUMBATLAS_MAGIC, 8);
+	header.key = feh_thumbatlas_key();
+	header.dim = atlas_dim;
+	header.count = count;
+	header.entry_size = sizeof(feh_thumbatlas_entry);
+	header.strings = strings_len;
+	header.size = offset;
+
+	tmpname = estrjoin(".", d->cache_file, "XXXXXX", NULL);
+	if ((fd = mkstemp(tmpname)) == -1 || !(fp = fdopen(fd, "w"))) {
+		weprintf("cannot write thumbnail atlas %s:", tmpname);
+		if (fd != -1)
+			close(fd);
+	} else {
+		fwrite(&header, sizeof(header), 1, fp);
+		for (i = 0; i < count; i++)
+			fwrite(&sources[i].entry, sizeof(feh_thumbatlas_entry), 1, fp);
+		fwrite(d->path, 1, strlen(d->path) + 1, fp);
+		for (i = 0; i < count; i++)
+			fwrite(sources[i].name, 1, strlen(sources[i].name) + 1, fp);
+		fwrite(zero, 1, data_start - sizeof(header)
+				- (uint64_t) count * sizeof(feh_thumbatlas_entry)
+				- strings_len, fp);
+
+		for (i = 0; (i < count) && !err; i++) {
+			len = (uint64_t) sources[i].entry.width * sources[i].entry.height
+				* sizeof(DATA32);
+			if (!(pixels = sources[i].pixels)) {
+				if (!buf)
+					buf = emalloc((size_t) atlas_dim * atlas_dim * sizeof(DATA32));
+				if (!feh_io_all(sources[i].spool_fd, buf, len,
+							(off_t) sources[i].spool_offset, 1))
+					err = 1;
+				pixels = buf;
+			}
+			fwrite(pixels, 1, len, fp);
+			fwrite(zero, 1, ((len + 15) & ~(uint64_t) 15) - len, fp);
+		}
+
+		if (ferror(fp))
+			err = 1;
+		if (fclose(fp))
+			err = 1;
+		if (err || rename(tmpname, d->cache_file)) {
+			weprintf("cannot write thumbnail atlas %s:", d->cache_file);
+			unlink(tmpname);
+		} else {
+			D(("wrote %u thumbnails to %s\n", count, d->cache_file));
+		}
+	}
+
+	free(tmpname);
+	free(buf);
+	free(sources);
+	if (old.map)
+		munmap(old.map, old.map_size);
+}
+
+/*
+ * Merges the thumbnails added in this process and collected from thumbnail
+ * workers into their atlases, writing each atlas once. Writers are
+ * serialized with a lock file, so that concurrent runs do not lose each
+ * other's thumbnails.
+ */
+void feh_thumbatlas_save(void)
+{
+	char *lock_file;
+	unsigned int i;
+	int lock_fd;
+
+	if (!atlas_dir || (spool_pid != getpid()) || spool_records
+			|| (!spool_len && !worker_spool_count))
+		return;
+
+	lock_file = estrjoin("/", atlas_dir, "lock", NULL);
+	if ((lock_fd = open(lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) != -1)
+		while (flock(lock_fd, LOCK_EX) && (errno == EINTR));
+	free(lock_file);
+
+	for (i = 0; i < dir_count; i++)
+		if (dirs[i]->added_count)
+			feh_thumbatlas_write(dirs[i]);
+
+	if (lock_fd != -1)
+		close(lock_fd);
+	feh_thumbatlas_reset();
+}
@@ -0,0 +1,53 @@
+/* thumbatlas.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef THUMBATLAS_H
+#define THUMBATLAS_H
+
+#include "filelist.h"
+
+/*
+ * With --cache-atlas, thumbnail mode keeps the thumbnails of each directory
+ * in a single file under $XDG_CACHE_HOME/feh/thumbnails/<size>/, together
+ * with the size and mtime of their images. An atlas is mmap'ed once when
+ * the first file of its directory is shown and thumbnails are copied out of
+ * it, so a warm start costs one open(2) per directory and a stat(2) per
+ * file. New thumbnails are spooled to an unlinked temporary file and merged
+ * into the atlases by feh_thumbatlas_save. Thumbnail workers spool theirs to
+ * files handed to them by the parent, which collects them once they have
+ * exited, so that each atlas is only written once.
+ */
+
+int feh_thumbatlas_init(char *size_dir, int dim);
+int feh_thumbatlas_lookup(Imlib_Image * image, feh_file * file, int *orig_w,
+		int *orig_h);
+void feh_thumbatlas_store(feh_file * file, Imlib_Image image, int orig_w,
+		int orig_h);
+int feh_thumbatlas_spool_open(void);
+void feh_thumbatlas_spool_to(int fd);
+void feh_thumbatlas_collect(int fd);
+void feh_thumbatlas_save(void);
+
+#endif
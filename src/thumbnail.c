@@ -28,16 +28,63 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "filelist.h"
 #include "winwidget.h"
 #include "options.h"
+#include "http.h"
 #include "thumbnail.h"
 #include "md5.h"
 #include "feh_png.h"
 #include "index.h"
 #include "signals.h"
+#include "timers.h"
+#include "thumbwork.h"
+#include "thumbatlas.h"
 
-static gib_list *thumbnails = NULL;
+#include <stdint.h>
+
+/* thumbnails in the order they were drawn, thumbnails[i]->index is i */
+static feh_thumbnail **thumbnails = NULL;
+static int thumbnails_len = 0;
+static int thumbnails_size = 0;
+
+/* open addressing index of thumbnails on their file, -1 marks a free slot */
+static int *file_slots = NULL;
+static int file_slots_size = 0;
+
+/*
+ * The rows (or columns, if td.vertical) of a grid which is not virtual.
+ * Line i starts at y (or x) pos and holds the thumbnails from first up to
+ * the first one of line i + 1.
+ */
+typedef struct {
+	int pos;
+	int first;
+} feh_thumbnail_line;
+
+static feh_thumbnail_line *lines = NULL;
+static int lines_len = 0;
+static int lines_size = 0;
+
+/* cached thumbnails of a virtual grid, most recently drawn first */
+static feh_thumbnail *lru_first = NULL;
+static feh_thumbnail *lru_last = NULL;
+
+#define THUMB_CACHE_BUDGET ((size_t) opt.thumb_cache_size * 1024 * 1024)
 
 static thumbmode_data td;
 
+static void feh_thumbnail_add(feh_thumbnail * thumb);
+static void feh_thumbnail_add_line(int pos);
+static char *feh_thumbnail_get_prefix(void);
+static int feh_thumbnail_load_cache_size(Imlib_Image * image, feh_file * file,
+		int * orig_w, int * orig_h);
+static int feh_thumbnail_virtual_geometry(void);
+static void feh_thumbnail_start_virtual(void);
+static feh_thumbnail *feh_thumbnail_at(int x, int y);
+static void feh_thumbnail_draw_removed(Imlib_Image im, feh_thumbnail * thumb,
+		int x, int y);
+static void feh_thumbnail_render(winwidget winwid);
+static void feh_thumbnail_damage(int x, int y, int w, int h);
+static void feh_thumbnail_flush(winwidget winwid);
+
 /* TODO Break this up a bit ;) */
 /* TODO s/bit/lot */
 void init_thumbnail_mode(void)
@@ -56,9 +103,7 @@ void init_thumbnail_mode(void)
 	 */
 
 	Imlib_Load_Error err;
-	Imlib_Image im_temp;
-	int ww = 0, hh = 0, www, hhh, xxx, yyy;
-	int orig_w, orig_h;
+	int www, hhh, xxx, yyy;
 	int x = 0, y = 0;
 	winwidget winwid = NULL;
 	Imlib_Image im_thumb = NULL;
@@ -67,6 +112,7 @@ void init_thumbnail_mode(void)
 	int tw = 0, th = 0;
 	int fw, fh;
 	int thumbnailcount = 0;
+	int i, seq, status;
 	feh_file *file = NULL;
 	gib_list *l, *last = NULL;
 	int lineno;
@@ -141,10 +187,20 @@ void init_thumbnail_mode(void)
 	}
 
 	/* figure out geometry for the main window and entries */
-	feh_thumbnail_calculate_geometry();
+	td.title_area_h = title_area_h;
+	td.trans_bg = trans_bg;
+	if (!(td.virtual = feh_thumbnail_virtual_geometry()))
+		feh_thumbnail_calculate_geometry();
 
 	index_image_width = td.w;
 	index_image_height = td.h + title_area_h;
+	if (td.virtual) {
+		/* only needs to hold what the window shows */
+		if (index_image_width > scr->width)
+			index_image_width = scr->width;
+		if (index_image_height > scr->height)
+			index_image_height = scr->height;
+	}
 	D(("imlib_create_image(%d, %d)\n", index_image_width, index_image_height));
 	td.im_main = imlib_create_image(index_image_width, index_image_height);
 
@@ -161,7 +217,11 @@ void init_thumbnail_mode(void)
 
 	gib_imlib_image_set_has_alpha(td.im_main, 1);
 
-	if (td.im_bg)
+	if (td.virtual)
+		/* the background is drawn along with the thumbnails */
+		gib_imlib_image_fill_rectangle(td.im_main, 0, 0, index_image_width,
+				index_image_height, 0, 0, 0, 0);
+	else if (td.im_bg)
 		gib_imlib_blend_image_onto_image(td.im_main, td.im_bg,
 						 gib_imlib_image_has_alpha
 						 (td.im_bg), 0, 0, td.bg_w, td.bg_h, 0, 0,
@@ -176,16 +236,10 @@ void init_thumbnail_mode(void)
 				td.h + title_area_h, 0, 0, 0, 255);
 	}
 
-
-	if (opt.display) {
-		winwid = winwidget_create_from_image(td.im_main, WIN_TYPE_THUMBNAIL);
-		winwidget_rename(winwid, PACKAGE " [thumbnail mode]");
-		winwidget_show(winwid);
-	}
-
 	td.cache_thumbnails = opt.cache_thumbnails;
+	td.cache_atlas = opt.cache_atlas;
 
-	if (td.cache_thumbnails) {
+	if (td.cache_thumbnails || td.cache_atlas) {
 		if (opt.thumb_w > opt.thumb_h)
 			td.cache_dim = opt.thumb_w;
 		else
@@ -194,6 +248,7 @@ void init_thumbnail_mode(void)
 		if (td.cache_dim > 1024) {
 			/* Not specified by XDG thumbnail standard */
 			td.cache_thumbnails = 0;
+			td.cache_atlas = 0;
 		} else if (td.cache_dim > 512) {
 			td.cache_dim = 1024;
 			td.cache_dir = estrdup("xx-large");
@@ -207,69 +262,47 @@ void init_thumbnail_mode(void)
 			td.cache_dim = 128;
 			td.cache_dir = estrdup("normal");
 		}
+	}
+
+	if (td.cache_thumbnails) {
+		/* the same for every file, so they are only looked up once */
+		td.cache_prefix = feh_thumbnail_get_prefix();
+		td.cwd = getcwd(NULL, 0);
 		feh_thumbnail_setup_thumbnail_dir();
 	}
 
-	for (l = filelist; l; l = l->next) {
+	if (td.cache_atlas)
+		td.cache_atlas = feh_thumbatlas_init(td.cache_dir, td.cache_dim);
+
+	if (td.virtual) {
+		feh_thumbnail_start_virtual();
+		return;
+	}
+
+	if (opt.display) {
+		winwid = winwidget_create_from_image(td.im_main, WIN_TYPE_THUMBNAIL);
+		winwidget_rename(winwid, PACKAGE " [thumbnail mode]");
+		winwidget_show(winwid);
+	}
+
+	/* files are decoded and scaled by workers, and drawn here in order */
+	feh_thumbwork_start();
+
+	for (l = filelist, seq = 0; l; l = l->next, seq++) {
 		file = FEH_FILE(l->data);
 		if (last) {
 			filelist = feh_file_remove_from_list(filelist, last);
 			last = NULL;
 		}
+		feh_http_prefetch(l, opt.parallel_downloads);
 		D(("About to load image %s\n", file->filename));
-		/*      if (feh_load_image(&im_temp, file) != 0) */
-		if (feh_thumbnail_get_thumbnail(&im_temp, file, &orig_w, &orig_h)
-				!= 0) {
+		if ((status = feh_thumbwork_take(seq, &im_thumb, &www, &hhh)) < 0)
+			status = feh_thumbnail_get_scaled(&im_thumb, file, &www, &hhh);
+		if (status) {
 			if (opt.verbose)
 				feh_display_status('.');
 			D(("Successfully loaded %s\n", file->filename));
-			www = opt.thumb_w;
-			hhh = opt.thumb_h;
-			ww = gib_imlib_image_get_width(im_temp);
-			hh = gib_imlib_image_get_height(im_temp);
-
-			if (!orig_w) {
-				orig_w = ww;
-				orig_h = hh;
-			}
-
 			thumbnailcount++;
-			if (gib_imlib_image_has_alpha(im_temp))
-				imlib_context_set_blend(1);
-			else
-				imlib_context_set_blend(0);
-
-			if (opt.aspect) {
-				double ratio = 0.0;
-
-				/* Keep the aspect ratio for the thumbnail */
-				ratio = ((double) ww / hh) / ((double) www / hhh);
-
-				if (ratio > 1.0)
-					hhh = opt.thumb_h / ratio;
-				else if (ratio != 1.0)
-					www = opt.thumb_w * ratio;
-			}
-
-			if ((!opt.stretch) && ((www > ww) || (hhh > hh))) {
-				/* Don't make the image larger unless stretch is specified */
-				www = ww;
-				hhh = hh;
-			}
-
-			im_thumb = gib_imlib_create_cropped_scaled_image(im_temp, 0, 0,
-					ww, hh, www, hhh, 1);
-			gib_imlib_free_image_and_decache(im_temp);
-
-			if (opt.alpha) {
-				DATA8 atab[256];
-
-				D(("Applying alpha options\n"));
-				gib_imlib_image_set_has_alpha(im_thumb, 1);
-				memset(atab, opt.alpha_level, sizeof(atab));
-				gib_imlib_apply_color_modifier_to_rectangle
-				    (im_thumb, 0, 0, www, hhh, NULL, NULL, NULL, atab);
-			}
 
 			td.text_area_w = opt.thumb_w;
 			/* Now draw on the info text */
@@ -320,8 +353,9 @@ void init_thumbnail_mode(void)
 							 yyy, www, hhh, 1,
 							 gib_imlib_image_has_alpha(im_thumb), 0);
 
-			thumbnails = gib_list_add_front(thumbnails,
-					feh_thumbnail_new(file, xxx, yyy, www, hhh));
+			feh_thumbnail_add_line(td.vertical ? x : y);
+			feh_thumbnail_add(feh_thumbnail_new(file, xxx, yyy, www, hhh));
+			feh_thumbnail_damage(x, y, td.text_area_w, td.thumb_tot_h);
 
 			gib_imlib_free_image_and_decache(im_thumb);
 
@@ -355,7 +389,7 @@ void init_thumbnail_mode(void)
 		if (opt.display) {
 			/* thumb_counter is unsigned, so no need to catch overflows */
 			if (++thumb_counter == opt.thumb_redraw) {
-				winwidget_render_image(winwid, 0, 1);
+				feh_thumbnail_flush(winwid);
 				thumb_counter = 0;
 			}
 			if (!feh_main_iteration(0))
@@ -363,8 +397,11 @@ void init_thumbnail_mode(void)
 		}
 	}
 
+	feh_thumbwork_stop();
+	feh_thumbatlas_save();
+
 	if (thumb_counter != 0)
-		winwidget_render_image(winwid, 0, 1);
+		feh_thumbnail_flush(winwid);
 
 	if (opt.verbose)
 		putc('\n', stderr);
@@ -413,11 +450,11 @@ void init_thumbnail_mode(void)
 	if (!opt.display)
 		gib_imlib_free_image_and_decache(td.im_main);
 	else if (opt.start_list_at) {
-		for (l = thumbnails; l; l = l->next) {
-			if (!strcmp(opt.start_list_at, FEH_THUMB(l->data)->file->filename)) {
+		for (i = 0; i < thumbnails_len; i++) {
+			if (!strcmp(opt.start_list_at, thumbnails[i]->file->filename)) {
 				free(opt.start_list_at);
 				opt.start_list_at = NULL;
-				feh_thumbnail_select(winwid, FEH_THUMB(l->data));
+				feh_thumbnail_select(winwid, thumbnails[i]);
 				break;
 			}
 		}
@@ -438,59 +475,133 @@ feh_thumbnail *feh_thumbnail_new(feh_file * file, int x, int y, int w, int h)
 	thumb->h = h;
 	thumb->file = file;
 	thumb->exists = 1;
+	thumb->removed = 0;
+	thumb->failed = 0;
+	thumb->index = -1;
+	thumb->im = NULL;
+	thumb->lru_prev = thumb->lru_next = NULL;
 
 	return(thumb);
 }
 
-feh_file *feh_thumbnail_get_file_from_coords(int x, int y)
+static int feh_thumbnail_file_slot(feh_file * file)
 {
-	gib_list *l;
-	feh_thumbnail *thumb;
+	int i;
 
-	for (l = thumbnails; l; l = l->next) {
-		thumb = FEH_THUMB(l->data);
-		if (XY_IN_RECT(x, y, thumb->x, thumb->y, thumb->w, thumb->h)) {
-			if (thumb->exists) {
-				return(thumb->file);
-			}
-		}
+	/* Fibonacci hashing, the low bits of a pointer are mostly zero */
+	for (i = (int) ((uint32_t) ((uintptr_t) file >> 4) * 0x9e3779b1U
+				>> 8) & (file_slots_size - 1);
+			(file_slots[i] >= 0) && (thumbnails[file_slots[i]]->file != file);
+			i = (i + 1) & (file_slots_size - 1));
+	return(i);
+}
+
+static void feh_thumbnail_add(feh_thumbnail * thumb)
+{
+	int i;
+
+	if (thumbnails_len == thumbnails_size) {
+		thumbnails_size = thumbnails_size ? thumbnails_size * 2 : 256;
+		thumbnails = erealloc(thumbnails,
+				thumbnails_size * sizeof(feh_thumbnail *));
 	}
-	D(("No matching %d %d\n", x, y));
-	return(NULL);
+	thumb->index = thumbnails_len;
+	thumbnails[thumbnails_len++] = thumb;
+
+	/* keep the file index at most half full */
+	if (thumbnails_len * 2 > file_slots_size) {
+		file_slots_size = file_slots_size ? file_slots_size * 2 : 512;
+		file_slots = erealloc(file_slots, file_slots_size * sizeof(int));
+		memset(file_slots, -1, file_slots_size * sizeof(int));
+		for (i = 0; i < thumbnails_len - 1; i++)
+			file_slots[feh_thumbnail_file_slot(thumbnails[i]->file)] = i;
+	}
+	file_slots[feh_thumbnail_file_slot(thumb->file)] = thumb->index;
 }
 
-feh_thumbnail *feh_thumbnail_get_thumbnail_from_coords(int x, int y)
+/* the next thumbnail is drawn in the line at pos */
+static void feh_thumbnail_add_line(int pos)
 {
-	gib_list *l;
-	feh_thumbnail *thumb;
+	if (lines_len && (lines[lines_len - 1].pos == pos))
+		return;
+	if (lines_len == lines_size) {
+		lines_size = lines_size ? lines_size * 2 : 64;
+		lines = erealloc(lines, lines_size * sizeof(feh_thumbnail_line));
+	}
+	lines[lines_len].pos = pos;
+	lines[lines_len++].first = thumbnails_len;
+}
 
-	for (l = thumbnails; l; l = l->next) {
-		thumb = FEH_THUMB(l->data);
-		if (XY_IN_RECT(x, y, thumb->x, thumb->y, thumb->w, thumb->h)) {
-			if (thumb->exists) {
-				return(thumb);
-			}
-		}
+/*
+ * Lines are sorted by their position, and the thumbnails of a line by
+ * their x (or y if td.vertical), so only the last thumbnail starting
+ * before x, y in the last line starting before it can contain x, y.
+ */
+static feh_thumbnail *feh_thumbnail_find(int x, int y)
+{
+	feh_thumbnail *thumb;
+	int lo, hi, mid, first, end, pos;
+
+	if (td.virtual)
+		return(feh_thumbnail_at(x, y));
+
+	lo = 0;
+	hi = lines_len;
+	pos = td.vertical ? x : y;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (lines[mid].pos <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	if (!lo)
+		return(NULL);
+
+	first = lines[lo - 1].first;
+	end = (lo < lines_len) ? lines[lo].first : thumbnails_len;
+	lo = first;
+	hi = end;
+	pos = td.vertical ? y : x;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if ((td.vertical ? thumbnails[mid]->y : thumbnails[mid]->x) <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == first)
+		return(NULL);
+	thumb = thumbnails[lo - 1];
+	if (thumb->exists && XY_IN_RECT(x, y, thumb->x, thumb->y, thumb->w, thumb->h))
+		return(thumb);
 	D(("No matching %d %d\n", x, y));
 	return(NULL);
 }
 
+feh_file *feh_thumbnail_get_file_from_coords(int x, int y)
+{
+	feh_thumbnail *thumb = feh_thumbnail_find(x, y);
+
+	return(thumb ? thumb->file : NULL);
+}
+
+feh_thumbnail *feh_thumbnail_get_thumbnail_from_coords(int x, int y)
+{
+	return(feh_thumbnail_find(x, y));
+}
+
 feh_thumbnail *feh_thumbnail_get_from_file(feh_file * file)
 {
-	gib_list *l;
 	feh_thumbnail *thumb;
+	int i;
 
-	for (l = thumbnails; l; l = l->next) {
-		thumb = FEH_THUMB(l->data);
-		if (thumb->file == file) {
-			if (thumb->exists) {
-				return(thumb);
-			}
-		}
+	if (!file_slots_size || ((i = file_slots[feh_thumbnail_file_slot(file)]) < 0)) {
+		D(("No match\n"));
+		return(NULL);
 	}
-	D(("No match\n"));
-	return(NULL);
+	thumb = thumbnails[i];
+	return(thumb->exists ? thumb : NULL);
 }
 
 void feh_thumbnail_mark_removed(feh_file * file, int deleted)
@@ -500,23 +611,14 @@ void feh_thumbnail_mark_removed(feh_file * file, int deleted)
 
 	thumb = feh_thumbnail_get_from_file(file);
 	if (thumb) {
+		/* a virtual grid draws it again when the thumbnail comes into view */
+		thumb->removed = deleted ? 2 : 1;
 		w = winwidget_get_first_window_of_type(WIN_TYPE_THUMBNAIL);
 		if (w) {
-			int tw, th;
-			if (deleted)
-				gib_imlib_image_fill_rectangle(w->im, thumb->x, thumb->y,
-						thumb->w, thumb->h, 255, 0, 0, 150);
-			else
-				gib_imlib_image_fill_rectangle(w->im, thumb->x, thumb->y,
-						thumb->w, thumb->h, 0, 0, 255, 150);
-
-			gib_imlib_get_text_size(td.font_main, "X", NULL, &tw, &th,
-					IMLIB_TEXT_TO_RIGHT);
-			gib_imlib_text_draw(w->im, td.font_main, NULL,
-					thumb->x + ((thumb->w - tw) / 2),
-					thumb->y + ((thumb->h - th) / 2), "X",
-					IMLIB_TEXT_TO_RIGHT, 205, 205, 50, 255);
-			winwidget_render_image(w, 0, 1);
+			feh_thumbnail_draw_removed(w->im, thumb, thumb->x - td.view_x,
+					thumb->y - td.view_y);
+			feh_thumbnail_damage(thumb->x, thumb->y, thumb->w, thumb->h);
+			feh_thumbnail_flush(w);
 		}
 		thumb->exists = 0;
 	}
@@ -560,6 +662,543 @@ void feh_thumbnail_calculate_geometry(void)
 	}
 }
 
+/*
+ * Grids which would take more than --thumb-cache-size MiB are virtual: all
+ * cells have the same size, so the position of each file is known without
+ * loading it, and td.im_main only holds the part of the grid around what
+ * the window shows. Thumbnails are loaded once their cell comes close to
+ * the view, and dropped again when they are far away and the cache is full.
+ */
+static int feh_thumbnail_virtual_geometry(void)
+{
+	int fw, fh, lines;
+
+	if (!opt.display || opt.output_file || !opt.thumb_cache_size)
+		return(0);
+
+	/* see feh_thumbnail_calculate_geometry */
+	if (!opt.limit_w && !opt.limit_h) {
+		if (td.im_bg)
+			return(0);
+		opt.limit_w = 800;
+	}
+	if (opt.limit_w && opt.limit_h)
+		return(0);
+
+	get_index_string_dim(NULL, td.font_main, &fw, &fh);
+	td.cell_w = opt.thumb_w;
+	if (fw > td.cell_w)
+		td.cell_w = fw + 5;
+
+	if (opt.limit_w) {
+		td.w = opt.limit_w;
+		if ((td.grid_len = td.w / td.cell_w) < 1)
+			td.grid_len = 1;
+		lines = (filelist_len + td.grid_len - 1) / td.grid_len;
+		td.h = (lines ? lines : 1) * td.thumb_tot_h;
+	} else {
+		td.vertical = 1;
+		td.h = opt.limit_h;
+		if ((td.grid_len = td.h / td.thumb_tot_h) < 1)
+			td.grid_len = 1;
+		lines = (filelist_len + td.grid_len - 1) / td.grid_len;
+		td.w = (lines ? lines : 1) * td.cell_w;
+	}
+
+	return((double) td.w * (td.h + td.title_area_h) * sizeof(DATA32)
+			> (double) opt.thumb_cache_size * 1024 * 1024);
+}
+
+/* position of the i-th cell of a virtual grid */
+static void feh_thumbnail_cell(int i, int *x, int *y)
+{
+	if (td.vertical) {
+		*x = (i / td.grid_len) * td.cell_w;
+		*y = (i % td.grid_len) * td.thumb_tot_h;
+	} else {
+		*x = (i % td.grid_len) * td.cell_w;
+		*y = (i / td.grid_len) * td.thumb_tot_h;
+	}
+}
+
+/* number of the cell at x, y of a virtual grid, or -1 */
+static int feh_thumbnail_cell_at(int x, int y)
+{
+	int col, row, i;
+
+	if ((x < 0) || (y < 0))
+		return(-1);
+	col = x / td.cell_w;
+	row = y / td.thumb_tot_h;
+	if (td.vertical) {
+		if (row >= td.grid_len)
+			return(-1);
+		i = col * td.grid_len + row;
+	} else {
+		if (col >= td.grid_len)
+			return(-1);
+		i = row * td.grid_len + col;
+	}
+	return((i < thumbnails_len) ? i : -1);
+}
+
+static feh_thumbnail *feh_thumbnail_at(int x, int y)
+{
+	feh_thumbnail *thumb;
+	int i;
+
+	if ((i = feh_thumbnail_cell_at(x, y)) < 0)
+		return(NULL);
+	thumb = thumbnails[i];
+	if (thumb->exists && XY_IN_RECT(x, y, thumb->x, thumb->y, thumb->w, thumb->h))
+		return(thumb);
+	return(NULL);
+}
+
+static int feh_thumbnail_in_view(feh_thumbnail * thumb)
+{
+	return((thumb->x < td.view_x + td.view_w)
+			&& (thumb->x + thumb->w > td.view_x)
+			&& (thumb->y < td.view_y + td.view_h)
+			&& (thumb->y + thumb->h > td.view_y));
+}
+
+static void feh_thumbnail_lru_unlink(feh_thumbnail * thumb)
+{
+	if (thumb->lru_prev)
+		thumb->lru_prev->lru_next = thumb->lru_next;
+	else
+		lru_first = thumb->lru_next;
+	if (thumb->lru_next)
+		thumb->lru_next->lru_prev = thumb->lru_prev;
+	else
+		lru_last = thumb->lru_prev;
+	thumb->lru_prev = thumb->lru_next = NULL;
+}
+
+static void feh_thumbnail_lru_push(feh_thumbnail * thumb)
+{
+	thumb->lru_prev = NULL;
+	thumb->lru_next = lru_first;
+	if (lru_first)
+		lru_first->lru_prev = thumb;
+	else
+		lru_last = thumb;
+	lru_first = thumb;
+}
+
+/*
+ * Drops the least recently drawn thumbnails outside td.im_main until the
+ * others fit into --thumb-cache-size.
+ */
+static void feh_thumbnail_evict(void)
+{
+	feh_thumbnail *thumb;
+
+	while ((td.cached > THUMB_CACHE_BUDGET) && (thumb = lru_last)
+			&& !feh_thumbnail_in_view(thumb)) {
+		feh_thumbnail_lru_unlink(thumb);
+		td.cached -= (size_t) thumb->w * thumb->h * sizeof(DATA32);
+		gib_imlib_free_image_and_decache(thumb->im);
+		thumb->im = NULL;
+	}
+}
+
+/*
+ * Makes sure thumb->im holds the scaled thumbnail, and moves its rectangle
+ * to where it is drawn in its cell. Returns 0 if the file cannot be loaded.
+ */
+static int feh_thumbnail_load(feh_thumbnail * thumb)
+{
+	int x, y, w, h;
+
+	if (thumb->im) {
+		feh_thumbnail_lru_unlink(thumb);
+		feh_thumbnail_lru_push(thumb);
+		return(1);
+	}
+	if (thumb->failed)
+		return(0);
+
+	D(("About to load image %s\n", thumb->file->filename));
+	if (!feh_thumbnail_get_scaled(&thumb->im, thumb->file, &w, &h)) {
+		thumb->im = NULL;
+		thumb->failed = 1;
+		thumb->exists = 0;
+		return(0);
+	}
+
+	feh_thumbnail_cell(thumb->index, &x, &y);
+	thumb->x = x + ((td.cell_w - w) / 2);
+	thumb->y = y;
+	if (opt.aspect)
+		thumb->y += (opt.thumb_h - h) / 2;
+	thumb->w = w;
+	thumb->h = h;
+
+	td.cached += (size_t) w * h * sizeof(DATA32);
+	feh_thumbnail_lru_push(thumb);
+	feh_thumbnail_evict();
+	return(1);
+}
+
+static void feh_thumbnail_draw_removed(Imlib_Image im, feh_thumbnail * thumb,
+		int x, int y)
+{
+	int tw, th;
+
+	if (thumb->removed == 2)
+		gib_imlib_image_fill_rectangle(im, x, y, thumb->w, thumb->h,
+				255, 0, 0, 150);
+	else
+		gib_imlib_image_fill_rectangle(im, x, y, thumb->w, thumb->h,
+				0, 0, 255, 150);
+
+	gib_imlib_get_text_size(td.font_main, "X", NULL, &tw, &th,
+			IMLIB_TEXT_TO_RIGHT);
+	gib_imlib_text_draw(im, td.font_main, NULL,
+			x + ((thumb->w - tw) / 2), y + ((thumb->h - th) / 2), "X",
+			IMLIB_TEXT_TO_RIGHT, 205, 205, 50, 255);
+}
+
+/* draws the loaded thumb and its info into td.im_main */
+static void feh_thumbnail_draw_cell(feh_thumbnail * thumb)
+{
+	int x, y, fw, fh, tw, th, lineno = 0;
+	gib_list *line, *lines;
+
+	feh_thumbnail_cell(thumb->index, &x, &y);
+	x -= td.view_x;
+	y -= td.view_y;
+
+	gib_imlib_blend_image_onto_image(td.im_main, thumb->im,
+			gib_imlib_image_has_alpha(thumb->im), 0, 0, thumb->w, thumb->h,
+			thumb->x - td.view_x, thumb->y - td.view_y, thumb->w, thumb->h,
+			1, gib_imlib_image_has_alpha(thumb->im), 0);
+
+	if (opt.index_info) {
+		gib_imlib_get_text_size(td.font_main, "W", NULL, &tw, &th,
+				IMLIB_TEXT_TO_RIGHT);
+		line = lines = feh_wrap_string(create_index_string(thumb->file),
+				td.cell_w, td.font_main, NULL);
+
+		/* long file names must not run into the next cell */
+		imlib_context_set_cliprect(x, y, td.cell_w, td.thumb_tot_h);
+		while (line) {
+			gib_imlib_get_text_size(td.font_main, (char *) line->data,
+					NULL, &fw, &fh, IMLIB_TEXT_TO_RIGHT);
+			gib_imlib_text_draw(td.im_main, td.font_main, NULL,
+					x + ((td.cell_w - fw) >> 1),
+					y + opt.thumb_h + (lineno++ * (th + 2)) + 2,
+					(char *) line->data, IMLIB_TEXT_TO_RIGHT, 255, 255, 255, 255);
+			line = line->next;
+		}
+		imlib_context_set_cliprect(0, 0, 0, 0);
+		gib_list_free_and_data(lines);
+	}
+
+	if (thumb->removed)
+		feh_thumbnail_draw_removed(td.im_main, thumb, thumb->x - td.view_x,
+				thumb->y - td.view_y);
+}
+
+static void feh_thumbnail_draw_view(void)
+{
+	char *s;
+	int c, r, i, fw, fh;
+
+	/* like the background of a whole grid, it is stretched over all of it */
+	if (td.im_bg)
+		gib_imlib_blend_image_onto_image(td.im_main, td.im_bg,
+				gib_imlib_image_has_alpha(td.im_bg),
+				(double) td.view_x * td.bg_w / td.w,
+				(double) td.view_y * td.bg_h / td.h,
+				(double) td.view_w * td.bg_w / td.w + 1,
+				(double) td.view_h * td.bg_h / td.h + 1,
+				0, 0, td.view_w, td.view_h, 1, 0, 0);
+	else
+		gib_imlib_image_fill_rectangle(td.im_main, 0, 0, td.view_w,
+				td.view_h, 0, 0, 0, td.trans_bg ? 0 : 255);
+
+	for (r = td.view_y / td.thumb_tot_h;
+			r <= (td.view_y + td.view_h - 1) / td.thumb_tot_h; r++) {
+		for (c = td.view_x / td.cell_w;
+				c <= (td.view_x + td.view_w - 1) / td.cell_w; c++) {
+			i = feh_thumbnail_cell_at(c * td.cell_w, r * td.thumb_tot_h);
+			if ((i >= 0) && thumbnails[i]->im) {
+				feh_thumbnail_load(thumbnails[i]);
+				feh_thumbnail_draw_cell(thumbnails[i]);
+			}
+		}
+	}
+
+	if (opt.title_font && (td.view_y + td.view_h > td.h)) {
+		s = create_index_title_string(thumbnails_len, td.w, td.h);
+		gib_imlib_get_text_size(td.font_title, s, NULL, &fw, &fh,
+				IMLIB_TEXT_TO_RIGHT);
+		gib_imlib_text_draw(td.im_main, td.font_title, NULL,
+				((td.w - fw) >> 1) - td.view_x,
+				td.h + td.title_area_h - fh - 2 - td.view_y, s,
+				IMLIB_TEXT_TO_RIGHT, 255, 255, 255, 255);
+	}
+}
+
+/* returns a thumbnail in the given part of the grid which is not loaded */
+static feh_thumbnail *feh_thumbnail_find_missing(int x, int y, int w, int h)
+{
+	int c, r, i;
+
+	if ((w <= 0) || (h <= 0))
+		return(NULL);
+	for (r = y / td.thumb_tot_h; r <= (y + h - 1) / td.thumb_tot_h; r++) {
+		for (c = x / td.cell_w; c <= (x + w - 1) / td.cell_w; c++) {
+			i = feh_thumbnail_cell_at(c * td.cell_w, r * td.thumb_tot_h);
+			if ((i >= 0) && !thumbnails[i]->im && !thumbnails[i]->failed)
+				return(thumbnails[i]);
+		}
+	}
+	return(NULL);
+}
+
+/*
+ * Timer callback which loads one missing thumbnail of td.im_main, the ones
+ * the window shows first, and draws it.
+ */
+static void feh_thumbnail_load_next(void *data)
+{
+	static unsigned int thumb_counter = 0;
+	feh_thumbnail *thumb;
+	winwidget winwid;
+	int shown = 1, x, y;
+
+	if (!(thumb = feh_thumbnail_find_missing(td.show_x, td.show_y,
+					td.show_w, td.show_h))) {
+		shown = 0;
+		thumb = feh_thumbnail_find_missing(td.view_x, td.view_y,
+				td.view_w, td.view_h);
+	}
+	if (!thumb) {
+		/* everything around the view is there */
+		feh_thumbatlas_save();
+		return;
+	}
+
+	if (feh_thumbnail_load(thumb)) {
+		feh_thumbnail_draw_cell(thumb);
+		feh_thumbnail_cell(thumb->index, &x, &y);
+		feh_thumbnail_damage(x, y, td.cell_w, td.thumb_tot_h);
+	}
+
+	if (shown && (winwid = winwidget_get_first_window_of_type(WIN_TYPE_THUMBNAIL))
+			&& ((opt.thumb_redraw && (++thumb_counter >= opt.thumb_redraw))
+				|| !feh_thumbnail_find_missing(td.show_x, td.show_y,
+					td.show_w, td.show_h))) {
+		thumb_counter = 0;
+		feh_thumbnail_flush(winwid);
+	}
+
+	feh_add_timer(feh_thumbnail_load_next, data, 0.0, "THUMB_LOAD");
+}
+
+/*
+ * Makes td.im_main hold the part x, y, w x h of a virtual grid, which the
+ * window shows, and a margin of a cell around it.
+ */
+static void feh_thumbnail_set_view(winwidget winwid, int x, int y, int w,
+		int h)
+{
+	Imlib_Image im;
+	int vx, vy, vw, vh;
+
+	td.show_x = x;
+	td.show_y = y;
+	td.show_w = w;
+	td.show_h = h;
+	feh_add_timer(feh_thumbnail_load_next, NULL, 0.0, "THUMB_LOAD");
+
+	if (td.view_w && (x >= td.view_x) && (y >= td.view_y)
+			&& (x + w <= td.view_x + td.view_w)
+			&& (y + h <= td.view_y + td.view_h))
+		return;
+
+	vw = w + 2 * td.cell_w;
+	vh = h + 2 * td.thumb_tot_h;
+	if (vw > td.w)
+		vw = td.w;
+	if (vh > td.h + td.title_area_h)
+		vh = td.h + td.title_area_h;
+	vx = x - td.cell_w;
+	vy = y - td.thumb_tot_h;
+	if (vx > td.w - vw)
+		vx = td.w - vw;
+	if (vx < 0)
+		vx = 0;
+	if (vy > td.h + td.title_area_h - vh)
+		vy = td.h + td.title_area_h - vh;
+	if (vy < 0)
+		vy = 0;
+
+	if ((vw != gib_imlib_image_get_width(td.im_main))
+			|| (vh != gib_imlib_image_get_height(td.im_main))) {
+		D(("imlib_create_image(%d, %d)\n", vw, vh));
+		if (!(im = imlib_create_image(vw, vh)))
+			eprintf("Failed to create %dx%d pixels thumbnail view", vw, vh);
+		gib_imlib_image_set_has_alpha(im, 1);
+		if (winwid->im == td.im_main)
+			winwid->im = im;
+		gib_imlib_free_image_and_decache(td.im_main);
+		td.im_main = im;
+	}
+
+	td.view_x = vx;
+	td.view_y = vy;
+	td.view_w = vw;
+	td.view_h = vh;
+	feh_thumbnail_draw_view();
+}
+
+/* the part of the grid winwid shows */
+static void feh_thumbnail_update_view(winwidget winwid)
+{
+	int x = 0, y = 0;
+
+	if (winwid->im_x < 0)
+		x = lround(-winwid->im_x / winwid->zoom);
+	if (winwid->im_y < 0)
+		y = lround(-winwid->im_y / winwid->zoom);
+	feh_thumbnail_set_view(winwid, x, y, lround(winwid->w / winwid->zoom),
+			lround(winwid->h / winwid->zoom));
+}
+
+int feh_thumbnail_is_virtual(void)
+{
+	return(td.virtual);
+}
+
+/*
+ * Called by winwidget_render_image before it renders the part sx, sy,
+ * sw x sh of a virtual grid. Makes sx and sy relative to winwid->im, which
+ * is td.im_main or a copy of it with the selection drawn in.
+ */
+void feh_thumbnail_prepare_view(winwidget winwid, int *sx, int *sy, int sw,
+		int sh)
+{
+	if (winwid->im == td.im_main)
+		feh_thumbnail_set_view(winwid, *sx, *sy, sw, sh);
+	*sx -= td.view_x;
+	*sy -= td.view_y;
+}
+
+/* scrolls winwid so that the cell of thumb is visible */
+static void feh_thumbnail_scroll_to(winwidget winwid, feh_thumbnail * thumb)
+{
+	int x, y;
+
+	feh_thumbnail_cell(thumb->index, &x, &y);
+	if (x * winwid->zoom < -winwid->im_x)
+		winwid->im_x = -x * winwid->zoom;
+	else if ((x + td.cell_w) * winwid->zoom > winwid->w - winwid->im_x)
+		winwid->im_x = winwid->w - (x + td.cell_w) * winwid->zoom;
+	if (y * winwid->zoom < -winwid->im_y)
+		winwid->im_y = -y * winwid->zoom;
+	else if ((y + td.thumb_tot_h) * winwid->zoom > winwid->h - winwid->im_y)
+		winwid->im_y = winwid->h - (y + td.thumb_tot_h) * winwid->zoom;
+	winwidget_sanitise_offsets(winwid);
+}
+
+static void feh_thumbnail_start_virtual(void)
+{
+	winwidget winwid;
+	gib_list *l;
+	int i, x, y;
+
+	/* until they are loaded, thumbnails take up all of their cell */
+	for (l = filelist, i = 0; l; l = l->next, i++) {
+		feh_thumbnail_cell(i, &x, &y);
+		feh_thumbnail_add(feh_thumbnail_new(FEH_FILE(l->data),
+				x + ((td.cell_w - opt.thumb_w) / 2), y, opt.thumb_w,
+				opt.thumb_h));
+	}
+	D(("virtual %dx%d grid of %d thumbnails\n", td.w, td.h, thumbnails_len));
+
+	winwid = winwidget_create_from_image(td.im_main, WIN_TYPE_THUMBNAIL);
+	winwid->im_w = td.w;
+	winwid->im_h = td.h + td.title_area_h;
+	winwidget_rename(winwid, PACKAGE " [thumbnail mode]");
+	winwidget_show(winwid);
+
+	if (opt.start_list_at) {
+		for (i = 0; i < thumbnails_len; i++) {
+			if (!strcmp(opt.start_list_at, thumbnails[i]->file->filename)) {
+				free(opt.start_list_at);
+				opt.start_list_at = NULL;
+				feh_thumbnail_select(winwid, thumbnails[i]);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Loads the thumbnail of file and scales it to the size it is drawn at,
+ * which is returned in w and h. Returns 0 if the file cannot be loaded.
+ */
+int feh_thumbnail_get_scaled(Imlib_Image * image, feh_file * file, int *w,
+		int *h)
+{
+	Imlib_Image im_temp;
+	int ww, hh, www, hhh, orig_w, orig_h;
+
+	if (feh_thumbnail_get_thumbnail(&im_temp, file, &orig_w, &orig_h) == 0)
+		return(0);
+
+	www = opt.thumb_w;
+	hhh = opt.thumb_h;
+	ww = gib_imlib_image_get_width(im_temp);
+	hh = gib_imlib_image_get_height(im_temp);
+
+	if (gib_imlib_image_has_alpha(im_temp))
+		imlib_context_set_blend(1);
+	else
+		imlib_context_set_blend(0);
+
+	if (opt.aspect) {
+		double ratio = 0.0;
+
+		/* Keep the aspect ratio for the thumbnail */
+		ratio = ((double) ww / hh) / ((double) www / hhh);
+
+		if (ratio > 1.0)
+			hhh = opt.thumb_h / ratio;
+		else if (ratio != 1.0)
+			www = opt.thumb_w * ratio;
+	}
+
+	if ((!opt.stretch) && ((www > ww) || (hhh > hh))) {
+		/* Don't make the image larger unless stretch is specified */
+		www = ww;
+		hhh = hh;
+	}
+
+	*image = gib_imlib_create_cropped_scaled_image(im_temp, 0, 0,
+			ww, hh, www, hhh, 1);
+	gib_imlib_free_image_and_decache(im_temp);
+
+	if (opt.alpha) {
+		DATA8 atab[256];
+
+		D(("Applying alpha options\n"));
+		gib_imlib_image_set_has_alpha(*image, 1);
+		memset(atab, opt.alpha_level, sizeof(atab));
+		gib_imlib_apply_color_modifier_to_rectangle
+		    (*image, 0, 0, www, hhh, NULL, NULL, NULL, atab);
+	}
+
+	*w = www;
+	*h = hhh;
+	return(1);
+}
+
 int feh_thumbnail_get_thumbnail(Imlib_Image * image, feh_file * file,
 	int * orig_w, int * orig_h)
 {
@@ -572,15 +1211,15 @@ int feh_thumbnail_get_thumbnail(Imlib_Image * image, feh_file * file,
 	if (!file || !file->filename)
 		return (0);
 
+	if (td.cache_atlas && feh_thumbatlas_lookup(image, file, orig_w, orig_h))
+		return (1);
+
 	if (td.cache_thumbnails) {
 		uri = feh_thumbnail_get_name_uri(file->filename);
 		thumb_file = feh_thumbnail_get_name(uri);
+	}
 
-		if (thumb_file == NULL) {
-			free(uri);
-			return feh_load_image(image, file);
-		}
-
+	if (thumb_file) {
 		status = feh_thumbnail_get_generated(image, file, thumb_file,
 			orig_w, orig_h);
 
@@ -589,12 +1228,18 @@ int feh_thumbnail_get_thumbnail(Imlib_Image * image, feh_file * file,
 				orig_w, orig_h);
 
 		D(("uri is %s, thumb_file is %s\n", uri, thumb_file));
-		free(uri);
-		free(thumb_file);
-	} else
-		status = feh_load_image(image, file);
-
-	return status;
+	} else if (td.cache_atlas)
+		status = feh_thumbnail_load_cache_size(image, file, orig_w, orig_h);
+	else
+		status = feh_load_image_thumbnail(image, file, opt.thumb_w,
+				opt.thumb_h, orig_w, orig_h);
+	free(uri);
+	free(thumb_file);
+
+	if (status && td.cache_atlas)
+		feh_thumbatlas_store(file, *image, *orig_w, *orig_h);
+
+	return (status != 0);
 }
 
 static char *feh_thumbnail_get_prefix(void)
@@ -618,16 +1263,14 @@ static char *feh_thumbnail_get_prefix(void)
 
 char *feh_thumbnail_get_name(char *uri)
 {
-	char *prefix, *thumb_file = NULL, *md5_name;
+	char *thumb_file = NULL, *md5_name;
 
 	/* FIXME: make sure original file isn't under ~/.thumbnails */
 
-	prefix = feh_thumbnail_get_prefix();
-	if (prefix) {
+	if (td.cache_prefix) {
 		md5_name = feh_thumbnail_get_name_md5(uri);
-		thumb_file = estrjoin("/", prefix, md5_name, NULL);
+		thumb_file = estrjoin("/", td.cache_prefix, md5_name, NULL);
 		free(md5_name);
-		free(prefix);
 	}
 
 	return thumb_file;
@@ -647,9 +1290,13 @@ char *feh_thumbnail_get_name_uri(char *name)
 			/* work around /some/path/./image.ext */
 			if ((strncmp(name, "./", 2)) == 0)
 				name += 2;
-			cwd = getcwd(NULL, 0);
-			uri = estrjoin("/", "file:/", cwd, name, NULL);
-			free(cwd);
+			if (td.cwd)
+				uri = estrjoin("/", "file:/", td.cwd, name, NULL);
+			else {
+				cwd = getcwd(NULL, 0);
+				uri = estrjoin("/", "file:/", cwd, name, NULL);
+				free(cwd);
+			}
 		} else {
 			uri = estrjoin(NULL, "file://", name, NULL);
 		}
@@ -681,106 +1328,96 @@ char *feh_thumbnail_get_name_md5(char *uri)
 	return md5_name;
 }
 
+/*
+ * Loads file scaled to fit into td.cache_dim x td.cache_dim pixels. Returns
+ * 2 if it had to be scaled down, 1 if it is small enough as it is and 0 if
+ * it cannot be loaded.
+ */
+static int feh_thumbnail_load_cache_size(Imlib_Image * image, feh_file * file,
+		int * orig_w, int * orig_h)
+{
+	int w, h, im_w, im_h, thumb_w, thumb_h;
+	Imlib_Image im_temp;
+
+	if (feh_load_image_thumbnail(&im_temp, file, td.cache_dim, td.cache_dim,
+				&w, &h) == 0)
+		return 0;
+
+	*orig_w = w;
+	*orig_h = h;
+	im_w = gib_imlib_image_get_width(im_temp);
+	im_h = gib_imlib_image_get_height(im_temp);
+	thumb_w = td.cache_dim;
+	thumb_h = td.cache_dim;
+
+	if ((w > td.cache_dim) || (h > td.cache_dim)) {
+		double ratio = (double) w / h;
+		if (ratio > 1.0)
+			thumb_h = td.cache_dim / ratio;
+		else if (ratio != 1.0)
+			thumb_w = td.cache_dim * ratio;
+	} else {
+		*image = im_temp;
+		return 1;
+	}
+
+	*image = gib_imlib_create_cropped_scaled_image(im_temp, 0, 0,
+			im_w, im_h, thumb_w, thumb_h, 1);
+	gib_imlib_free_image_and_decache(im_temp);
+
+	return 2;
+}
+
 int feh_thumbnail_generate(Imlib_Image * image, feh_file * file,
 		char *thumb_file, char *uri, int * orig_w, int * orig_h)
 {
-	int w, h, thumb_w, thumb_h;
-	Imlib_Image im_temp;
 	struct stat sb;
 	char c_width[8], c_height[8];
-	char *tmp_thumb_file, *prefix;
-	int tmp_fd;
-
-	if (feh_load_image(&im_temp, file) != 0) {
-		*orig_w = w = gib_imlib_image_get_width(im_temp);
-		*orig_h = h = gib_imlib_image_get_height(im_temp);
-		thumb_w = td.cache_dim;
-		thumb_h = td.cache_dim;
-
-		if ((w > td.cache_dim) || (h > td.cache_dim)) {
-			double ratio = (double) w / h;
-			if (ratio > 1.0)
-				thumb_h = td.cache_dim / ratio;
-			else if (ratio != 1.0)
-				thumb_w = td.cache_dim * ratio;
-		} else {
-			/*
-			 * The image is smaller than the specified thumbnail size.
-			 * Do not cache or transform it.
-			 */
-			*image = im_temp;
-			return 1;
-		}
+	char *tmp_thumb_file;
+	int tmp_fd, status;
 
-		*image = gib_imlib_create_cropped_scaled_image(im_temp, 0, 0, w, h,
-				thumb_w, thumb_h, 1);
-
-		if (!stat(file->filename, &sb)) {
-			char c_mtime[128];
-			sprintf(c_mtime, "%d", (int)sb.st_mtime);
-			snprintf(c_width, 8, "%d", w);
-			snprintf(c_height, 8, "%d", h);
-			prefix = feh_thumbnail_get_prefix();
-			if (prefix == NULL) {
-				gib_imlib_free_image_and_decache(im_temp);
-				return 0;
-			}
-			tmp_thumb_file = estrjoin("/", prefix, ".feh_thumbnail_XXXXXX", NULL);
-			free(prefix);
-			tmp_fd = mkstemp(tmp_thumb_file);
-			if (!feh_png_write_png_fd(*image, tmp_fd, "Thumb::URI", uri,
-					"Thumb::MTime", c_mtime,
-					"Thumb::Image::Width", c_width,
-					"Thumb::Image::Height", c_height)) {
-				rename(tmp_thumb_file, thumb_file);
-			} else {
-				unlink(tmp_thumb_file);
-			}
-			close(tmp_fd);
-			free(tmp_thumb_file);
+	/*
+	 * Images smaller than the specified thumbnail size are neither cached
+	 * nor transformed.
+	 */
+	if ((status = feh_thumbnail_load_cache_size(image, file, orig_w,
+					orig_h)) != 2)
+		return status;
+
+	if (!stat(file->filename, &sb) && td.cache_prefix) {
+		char c_mtime[128];
+		sprintf(c_mtime, "%d", (int)sb.st_mtime);
+		snprintf(c_width, 8, "%d", *orig_w);
+		snprintf(c_height, 8, "%d", *orig_h);
+		tmp_thumb_file = estrjoin("/", td.cache_prefix,
+				".feh_thumbnail_XXXXXX", NULL);
+		tmp_fd = mkstemp(tmp_thumb_file);
+		if (!feh_png_write_png_fd(*image, tmp_fd, "Thumb::URI", uri,
+				"Thumb::MTime", c_mtime,
+				"Thumb::Image::Width", c_width,
+				"Thumb::Image::Height", c_height)) {
+			rename(tmp_thumb_file, thumb_file);
+		} else {
+			unlink(tmp_thumb_file);
 		}
-
-		gib_imlib_free_image_and_decache(im_temp);
-
-		return 1;
+		close(tmp_fd);
+		free(tmp_thumb_file);
 	}
 
-	return 0;
+	return 1;
 }
 
 int feh_thumbnail_get_generated(Imlib_Image * image, feh_file * file,
 	char *thumb_file, int * orig_w, int * orig_h)
 {
 	struct stat sb;
-	char *c_mtime;
-	char *c_width, *c_height;
-	time_t mtime = 0;
-	gib_hash *hash;
-
-	if (!stat(file->filename, &sb)) {
-		hash = feh_png_read_comments(thumb_file);
-		if (hash != NULL) {
-			c_mtime  = (char *) gib_hash_get(hash, "Thumb::MTime");
-			c_width  = (char *) gib_hash_get(hash, "Thumb::Image::Width");
-			c_height = (char *) gib_hash_get(hash, "Thumb::Image::Height");
-			if (c_mtime != NULL)
-				mtime = (time_t) strtol(c_mtime, NULL, 10);
-			if (c_width != NULL)
-				*orig_w = atoi(c_width);
-			if (c_height != NULL)
-				*orig_h = atoi(c_height);
-			gib_hash_free_and_data(hash);
-		}
-
-		/* FIXME: should we bother about Thumb::URI? */
-		if (mtime == sb.st_mtime) {
-			feh_load_image_char(image, thumb_file);
 
-			return (1);
-		}
-	}
+	if (stat(file->filename, &sb))
+		return (0);
 
-	return (0);
+	/* FIXME: should we bother about Thumb::URI? */
+	*image = feh_png_read_thumbnail(thumb_file, sb.st_mtime, orig_w, orig_h);
+	return (*image != NULL);
 }
 
 void feh_thumbnail_show_fullsize(feh_file *thumbfile)
@@ -815,82 +1452,196 @@ void feh_thumbnail_show_fullsize(feh_file *thumbfile)
 	}
 }
 
-void feh_thumbnail_select(winwidget winwid, feh_thumbnail *thumbnail)
+/*
+ * Renders the part x, y, w x h of the grid, as far as td.im_main holds it,
+ * to winwid. Returns 0 if winwid must be rendered as a whole.
+ */
+static int feh_thumbnail_render_part(winwidget winwid, int x, int y, int w,
+		int h)
+{
+	int vw = gib_imlib_image_get_width(td.im_main);
+	int vh = gib_imlib_image_get_height(td.im_main);
+
+	x -= td.view_x;
+	y -= td.view_y;
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > vw)
+		w = vw - x;
+	if (y + h > vh)
+		h = vh - y;
+	if ((w <= 0) || (h <= 0))
+		return(1);
+	return(winwidget_render_image_part(winwid, td.im_main, x, y,
+				x + td.view_x, y + td.view_y, w, h));
+}
+
+static void feh_thumbnail_draw_highlight(Imlib_Image im, int x, int y,
+		int w, int h)
+{
+	gib_imlib_image_fill_rectangle(im, x, y, w, h, 50, 50, 255, 100);
+	gib_imlib_image_draw_rectangle(im, x, y, w, h, 255, 255, 255, 255);
+	gib_imlib_image_draw_rectangle(im, x + 1, y + 1, w - 2, h - 2,
+			0, 0, 0, 255);
+	gib_imlib_image_draw_rectangle(im, x + 2, y + 2, w - 4, h - 4,
+			255, 255, 255, 255);
+}
+
+/*
+ * Draws the highlight of the selected thumbnail over its part of winwid,
+ * using a copy of just that part. Returns 0 if winwid must be rendered as
+ * a whole.
+ */
+static int feh_thumbnail_highlight(winwidget winwid)
+{
+	feh_thumbnail *thumb = td.selected;
+	Imlib_Image im;
+	int x, y, w, h, ret;
+
+	x = thumb->x - td.view_x;
+	y = thumb->y - td.view_y;
+	w = thumb->w;
+	h = thumb->h;
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > gib_imlib_image_get_width(td.im_main))
+		w = gib_imlib_image_get_width(td.im_main) - x;
+	if (y + h > gib_imlib_image_get_height(td.im_main))
+		h = gib_imlib_image_get_height(td.im_main) - y;
+	if ((w <= 0) || (h <= 0))
+		return(1);
+
+	im = gib_imlib_create_cropped_scaled_image(td.im_main, x, y, w, h, w, h, 0);
+	if (!im)
+		return(0);
+	feh_thumbnail_draw_highlight(im, thumb->x - td.view_x - x,
+			thumb->y - td.view_y - y, thumb->w, thumb->h);
+	ret = winwidget_render_image_part(winwid, im, 0, 0, x + td.view_x,
+			y + td.view_y, w, h);
+	gib_imlib_free_image_and_decache(im);
+	return(ret);
+}
+
+static void feh_thumbnail_damage(int x, int y, int w, int h)
+{
+	int x2, y2;
+
+	if ((td.damage_w > 0) && (td.damage_h > 0)) {
+		x2 = x + w;
+		y2 = y + h;
+		if (td.damage_x + td.damage_w > x2)
+			x2 = td.damage_x + td.damage_w;
+		if (td.damage_y + td.damage_h > y2)
+			y2 = td.damage_y + td.damage_h;
+		if (td.damage_x < x)
+			x = td.damage_x;
+		if (td.damage_y < y)
+			y = td.damage_y;
+		w = x2 - x;
+		h = y2 - y;
+	}
+	td.damage_x = x;
+	td.damage_y = y;
+	td.damage_w = w;
+	td.damage_h = h;
+}
+
+/* shows the changed part of the grid in winwid */
+static void feh_thumbnail_flush(winwidget winwid)
+{
+	feh_thumbnail *thumb = td.selected;
+
+	if ((td.damage_w <= 0) || (td.damage_h <= 0))
+		return;
+	if (!feh_thumbnail_render_part(winwid, td.damage_x, td.damage_y,
+				td.damage_w, td.damage_h)
+			|| (thumb && RECT_INTERSECT(thumb->x, thumb->y, thumb->w,
+					thumb->h, td.damage_x, td.damage_y, td.damage_w,
+					td.damage_h) && !feh_thumbnail_highlight(winwid)))
+		feh_thumbnail_render(winwid);
+	td.damage_w = td.damage_h = 0;
+}
+
+/*
+ * Renders winwid with the selected thumbnail highlighted.
+ */
+static void feh_thumbnail_render(winwidget winwid)
 {
 	Imlib_Image origwin;
+	feh_thumbnail *thumbnail = td.selected;
 
-	if (thumbnail == td.selected)
+	if (td.virtual)
+		feh_thumbnail_update_view(winwid);
+	td.damage_w = td.damage_h = 0;
+
+	winwidget_render_image(winwid, 0, 0);
+	if (!thumbnail || feh_thumbnail_highlight(winwid))
 		return;
 
-	if (thumbnail) {
-		origwin = winwid->im;
-		winwid->im = gib_imlib_clone_image(origwin);
-		gib_imlib_image_fill_rectangle(winwid->im,
-				thumbnail->x, thumbnail->y, thumbnail->w,
-				thumbnail->h, 50, 50, 255, 100);
-		gib_imlib_image_draw_rectangle(winwid->im,
-				thumbnail->x, thumbnail->y, thumbnail->w,
-				thumbnail->h, 255, 255, 255, 255);
-		gib_imlib_image_draw_rectangle(winwid->im,
-				thumbnail->x + 1, thumbnail->y + 1,
-				thumbnail->w - 2, thumbnail->h - 2,
-				0, 0, 0, 255);
-		gib_imlib_image_draw_rectangle(winwid->im,
-				thumbnail->x + 2, thumbnail->y + 2,
-				thumbnail->w - 4, thumbnail->h - 4,
-				255, 255, 255, 255);
-		winwidget_render_image(winwid, 0, 0);
-		gib_imlib_free_image_and_decache(winwid->im);
-		winwid->im = origwin;
-	} else
-		winwidget_render_image(winwid, 0, 0);
+	/* zoomed or rotated windows need the highlight in a copy of all of it */
+	origwin = winwid->im;
+	winwid->im = gib_imlib_clone_image(origwin);
+	feh_thumbnail_draw_highlight(winwid->im, thumbnail->x - td.view_x,
+			thumbnail->y - td.view_y, thumbnail->w, thumbnail->h);
+	winwidget_render_image(winwid, 0, 0);
+	gib_imlib_free_image_and_decache(winwid->im);
+	winwid->im = origwin;
+}
+
+/*
+ * Only the cells of the old and the new selection are drawn again, unless
+ * the window has to scroll to the new one.
+ */
+void feh_thumbnail_select(winwidget winwid, feh_thumbnail *thumbnail)
+{
+	feh_thumbnail *old = td.selected;
+	int im_x = winwid->im_x, im_y = winwid->im_y;
+
+	if (thumbnail == td.selected)
+		return;
 
 	td.selected = thumbnail;
+	if (thumbnail && td.virtual)
+		feh_thumbnail_scroll_to(winwid, thumbnail);
+	if ((winwid->im_x == im_x) && (winwid->im_y == im_y)
+			&& (!old || feh_thumbnail_render_part(winwid, old->x, old->y,
+					old->w, old->h))
+			&& (!thumbnail || feh_thumbnail_highlight(winwid)))
+		return;
+	feh_thumbnail_render(winwid);
 }
 
 void feh_thumbnail_select_next(winwidget winwid, int jump)
 {
-	gib_list *l;
-	feh_thumbnail *thumb;
-	int len = 0, cur = 0, target = 0;
+	int cur;
 
-	for (l = thumbnails; l; l = l->next) {
-		thumb = FEH_THUMB(l->data);
-		if (thumb == td.selected)
-			cur = len;
-		len++;
-	}
-
-	target = (cur + len - jump) % len;
-
-	for (l = thumbnails; l; l = l->next) {
-		if (target-- == 0) {
-			feh_thumbnail_select(winwid, FEH_THUMB(l->data));
-		}
-	}
+	if (!thumbnails_len)
+		return;
+	cur = td.selected ? td.selected->index : thumbnails_len - 1;
+	feh_thumbnail_select(winwid, thumbnails[(cur + jump) % thumbnails_len]);
 }
 
 void feh_thumbnail_select_prev(winwidget winwid, int jump)
 {
-	gib_list *l;
-	feh_thumbnail *thumb;
-	int len = 0, cur = 0, target = 0;
-
-	for (l = thumbnails; l; l = l->next) {
-		thumb = FEH_THUMB(l->data);
-		if (thumb == td.selected)
-			cur = len;
-		len++;
-	}
+	int cur;
 
-	target = (cur + jump) % len;
-
-	for (l = thumbnails; l; l = l->next) {
-		if (target-- == 0) {
-			feh_thumbnail_select(winwid, FEH_THUMB(l->data));
-			break;
-		}
-	}
+	if (!thumbnails_len)
+		return;
+	cur = td.selected ? td.selected->index : thumbnails_len - 1;
+	feh_thumbnail_select(winwid, thumbnails[((cur - jump) % thumbnails_len
+			+ thumbnails_len) % thumbnails_len]);
 }
 
 void feh_thumbnail_show_selected(void)
@@ -912,7 +1663,7 @@ int feh_thumbnail_setup_thumbnail_dir(void)
 	struct stat sb;
 	char *dir, *p;
 
-	dir = feh_thumbnail_get_prefix();
+	dir = td.cache_prefix;
 
 	if (dir) {
 		if (!stat(dir, &sb)) {
@@ -941,7 +1692,6 @@ int feh_thumbnail_setup_thumbnail_dir(void)
 				}
 			}
 		}
-		free(dir);
 	}
 
 	return status;
@@ -40,7 +40,12 @@ typedef struct thumbnail {
 	int h;
 	feh_file *file;
 	unsigned char exists;
+	unsigned char removed;   /* 1 if removed, 2 if deleted */
+	unsigned char failed;    /* could not be loaded (virtual grids only) */
+	int index;               /* position in the thumbnail table */
 	struct feh_thumbnail *next;
+	Imlib_Image im;          /* the scaled thumbnail while it is cached */
+	struct thumbnail *lru_prev, *lru_next;
 } feh_thumbnail;
 
 typedef struct thumbmode_data {
@@ -57,10 +62,29 @@ typedef struct thumbmode_data {
 
 	int max_column_w;        /* FIXME: description */
 	int vertical;            /* == !opt.limit_w && opt.limit_h */
+	int title_area_h;
+	unsigned char trans_bg;
+
+	/*
+	 * In a virtual grid, all cells have the same size and im_main only holds
+	 * the part view_x, view_y, view_w x view_h of it.
+	 */
+	int virtual;
+	int cell_w;
+	int grid_len;            /* cells per row, or per column if vertical */
+	int view_x, view_y, view_w, view_h;
+	int show_x, show_y, show_w, show_h;  /* the part the window shows */
+	size_t cached;           /* bytes of scaled thumbnails kept */
+
+	/* the part of the grid which changed since the window was updated */
+	int damage_x, damage_y, damage_w, damage_h;
 
 	int cache_thumbnails;    /* use cached thumbnails from ~/.thumbnails */
+	int cache_atlas;         /* use the per-directory atlases in ~/.cache/feh/thumbnails */
 	int cache_dim;           /* 128 = 128x128 ("normal"), 256 = 256x256 ("large") */
 	char *cache_dir;         /* "normal"/"large" (.thumbnails/...) */
+	char *cache_prefix;      /* directory of cache_dir's thumbnails, may be NULL */
+	char *cwd;               /* for the URIs of relative paths */
 	feh_thumbnail *selected;     /* currently selected thumbnail */
 
 } thumbmode_data;
@@ -72,7 +96,11 @@ feh_thumbnail *feh_thumbnail_get_from_file(feh_file * file);
 void feh_thumbnail_mark_removed(feh_file * file, int deleted);
 
 void feh_thumbnail_calculate_geometry(void);
+int feh_thumbnail_is_virtual(void);
+void feh_thumbnail_prepare_view(winwidget winwid, int *sx, int *sy, int sw,
+		int sh);
 
+int feh_thumbnail_get_scaled(Imlib_Image * image, feh_file * file, int *w, int *h);
 int feh_thumbnail_get_thumbnail(Imlib_Image * image, feh_file * file, int * orig_w, int * orig_h);
 int feh_thumbnail_generate(Imlib_Image * image, feh_file * file, char *thumb_file, char *uri, int * orig_w, int * orig_h);
 int feh_thumbnail_get_generated(Imlib_Image * image, feh_file * file, char * thumb_file, int * orig_w, int * orig_h);
@@ -0,0 +1,442 @@
+/* thumbwork.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "thumbnail.h"
+#include "thumbatlas.h"
+#include "thumbwork.h"
+
+#include <fcntl.h>
+
+#define THUMBWORK_MAX_WORKERS 64
+
+/* jobs a worker is given before its first result is back */
+#define THUMBWORK_QUEUE 2
+
+/* finished results kept per worker while an earlier file is still busy */
+#define THUMBWORK_AHEAD 8
+
+enum thumbwork_state { THUMBWORK_NONE, THUMBWORK_QUEUED, THUMBWORK_DONE,
+	THUMBWORK_FAILED };
+
+typedef struct {
+	pid_t pid;
+	int job_fd;		/* -1 once the worker is gone */
+	int fd;
+	int spool_fd;		/* see feh_thumbatlas_spool_open */
+	int jobs[THUMBWORK_QUEUE];	/* queued jobs, oldest first */
+	int queued;
+	feh_thumbwork_header header;
+	size_t received;
+	Imlib_Image im;
+	DATA32 *data;
+} feh_thumbwork_worker;
+
+typedef struct {
+	enum thumbwork_state state;
+	feh_thumbwork_header header;
+	Imlib_Image im;
+} feh_thumbwork_result;
+
+static feh_thumbwork_worker *workers = NULL;
+static int worker_count = 0;
+
+/*
+ * Results of the jobs from the one taken next on, job seq is at
+ * results[seq % window]. THUMBWORK_NONE means the caller has to load the
+ * file itself.
+ */
+static feh_thumbwork_result *results = NULL;
+static int window = 0;
+
+/* the next file to hand out, and its job number */
+static gib_list *next_job = NULL;
+static int next_seq = 0;
+
+/*
+ * Runs in the forked child. Like the prefetch workers, it must never
+ * return. Thumbnails written to the cache are written from here; atlas
+ * entries go to spool_fd, which the parent merges in feh_thumbwork_stop.
+ */
+static void feh_thumbwork_worker_run(int job_fd, int fd, int spool_fd)
+{
+	feh_thumbwork_header header;
+	Imlib_Image im;
+	gib_list *l;
+	int seq, sent;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	/* a closed result pipe must not kill it in the middle of a spool record */
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGALRM, SIG_DFL);
+
+	/* progress is shown by the parent */
+	opt.verbose = 0;
+	feh_thumbatlas_spool_to(spool_fd);
+
+	while (feh_io_all(job_fd, &seq, sizeof(seq), -1, 1)) {
+		memset(&header, 0, sizeof(header));
+		header.seq = seq;
+		if ((l = feh_filelist_nth(seq)))
+			header.ok = feh_thumbnail_get_scaled(&im, FEH_FILE(l->data),
+					&header.width, &header.height);
+		if (header.ok)
+			header.has_alpha = gib_imlib_image_has_alpha(im);
+
+		sent = feh_io_all(fd, &header, sizeof(header), -1, 0);
+		if (header.ok) {
+			imlib_context_set_image(im);
+			sent = sent && feh_io_all(fd,
+					imlib_image_get_data_for_reading_only(),
+					(size_t) header.width * header.height * sizeof(DATA32), -1, 0);
+			gib_imlib_free_image_and_decache(im);
+		}
+		/* the parent stopped reading, see feh_thumbwork_stop */
+		if (!sent)
+			break;
+	}
+	_exit(0);
+}
+
+/*
+ * Starts a worker per CPU for the files in filelist. Returns their number;
+ * with none, thumbnail mode loads everything itself.
+ */
+int feh_thumbwork_start(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	feh_thumbwork_worker *w;
+	int jobs[2], res[2], spool;
+	pid_t pid;
+	int i, j;
+
+	if (cpus > THUMBWORK_MAX_WORKERS)
+		cpus = THUMBWORK_MAX_WORKERS;
+	if ((cpus < 2) || (filelist_len < 2))
+		return(0);
+
+	workers = emalloc(cpus * sizeof(feh_thumbwork_worker));
+	memset(workers, 0, cpus * sizeof(feh_thumbwork_worker));
+
+	for (i = 0; i < cpus; i++) {
+		if (pipe(jobs) == -1)
+			break;
+		if (pipe(res) == -1) {
+			close(jobs[0]);
+			close(jobs[1]);
+			break;
+		}
+		spool = feh_thumbatlas_spool_open();
+		if ((pid = fork()) < 0) {
+			D(("fork failed: %s\n", strerror(errno)));
+			close(jobs[0]);
+			close(jobs[1]);
+			close(res[0]);
+			close(res[1]);
+			if (spool != -1)
+				close(spool);
+			break;
+		} else if (pid == 0) {
+			/* the other workers must see EOF once the parent is done */
+			for (j = 0; j < i; j++) {
+				close(workers[j].job_fd);
+				close(workers[j].fd);
+				if (workers[j].spool_fd != -1)
+					close(workers[j].spool_fd);
+			}
+			close(jobs[1]);
+			close(res[0]);
+			feh_thumbwork_worker_run(jobs[0], res[1], spool);
+		}
+
+		close(jobs[0]);
+		close(res[1]);
+		fcntl(res[0], F_SETFL, fcntl(res[0], F_GETFL) | O_NONBLOCK);
+		fcntl(res[0], F_SETFD, FD_CLOEXEC);
+		fcntl(jobs[1], F_SETFD, FD_CLOEXEC);
+
+		w = &workers[i];
+		w->pid = pid;
+		w->job_fd = jobs[1];
+		w->fd = res[0];
+		w->spool_fd = spool;
+	}
+
+	if (!(worker_count = i)) {
+		free(workers);
+		workers = NULL;
+		return(0);
+	}
+
+	window = worker_count * THUMBWORK_AHEAD;
+	results = emalloc(window * sizeof(feh_thumbwork_result));
+	memset(results, 0, window * sizeof(feh_thumbwork_result));
+	next_job = filelist;
+	next_seq = 0;
+
+	D(("started %d thumbnail workers\n", worker_count));
+	return(worker_count);
+}
+
+static void feh_thumbwork_drop_image(feh_thumbwork_worker * w)
+{
+	if (!w->im)
+		return;
+	imlib_context_set_image(w->im);
+	imlib_image_put_back_data(w->data);
+	gib_imlib_free_image_and_decache(w->im);
+	w->im = NULL;
+	w->data = NULL;
+}
+
+/*
+ * Called if a worker died or sent garbage. The files it was working on
+ * are left to the caller.
+ */
+static void feh_thumbwork_lost(feh_thumbwork_worker * w)
+{
+	int i;
+
+	D(("lost thumbnail worker %d\n", w->pid));
+	for (i = 0; i < w->queued; i++)
+		results[w->jobs[i] % window].state = THUMBWORK_NONE;
+	w->queued = 0;
+	feh_thumbwork_drop_image(w);
+	close(w->job_fd);
+	close(w->fd);
+	w->job_fd = w->fd = -1;
+	kill(w->pid, SIGKILL);
+	waitpid(w->pid, NULL, 0);
+}
+
+static void feh_thumbwork_done(feh_thumbwork_worker * w)
+{
+	feh_thumbwork_result *result = &results[w->jobs[0] % window];
+
+	if (w->im) {
+		imlib_context_set_image(w->im);
+		imlib_image_put_back_data(w->data);
+	}
+	result->header = w->header;
+	result->im = w->im;
+	result->state = w->im ? THUMBWORK_DONE : THUMBWORK_FAILED;
+
+	w->im = NULL;
+	w->data = NULL;
+	w->received = 0;
+	memmove(w->jobs, w->jobs + 1, --w->queued * sizeof(int));
+}
+
+/*
+ * Reads whatever the worker has sent so far.
+ */
+static void feh_thumbwork_read(feh_thumbwork_worker * w)
+{
+	size_t total;
+	ssize_t ret;
+	char *dst;
+
+	while (w->queued) {
+		total = sizeof(feh_thumbwork_header);
+		if (w->im)
+			total += (size_t) w->header.width * w->header.height
+				* sizeof(DATA32);
+		if (w->received < sizeof(feh_thumbwork_header))
+			dst = (char *) &w->header + w->received;
+		else
+			dst = (char *) w->data
+				+ (w->received - sizeof(feh_thumbwork_header));
+
+		ret = read(w->fd, dst, total - w->received);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				feh_thumbwork_lost(w);
+			return;
+		} else if (ret == 0) {
+			feh_thumbwork_lost(w);
+			return;
+		}
+		w->received += ret;
+
+		if (w->received < total)
+			continue;
+		if (w->im) {
+			feh_thumbwork_done(w);
+			continue;
+		}
+
+		/* header complete, set up the image the pixels are read into */
+		if (w->header.seq != w->jobs[0]) {
+			feh_thumbwork_lost(w);
+			return;
+		}
+		if (!w->header.ok || (w->header.width <= 0)
+				|| (w->header.height <= 0)
+				|| !(w->im = imlib_create_image(w->header.width,
+						w->header.height))) {
+			feh_thumbwork_done(w);
+			continue;
+		}
+		imlib_context_set_image(w->im);
+		imlib_image_set_has_alpha(w->header.has_alpha);
+		w->data = imlib_image_get_data();
+	}
+}
+
+/*
+ * Hands out files until each worker has THUMBWORK_QUEUE of them or the
+ * results would not fit into the window starting at seq. Files which are
+ * downloaded first are left to the caller.
+ */
+static void feh_thumbwork_fill(int seq)
+{
+	feh_thumbwork_worker *w;
+	int i;
+
+	while (next_job && (next_seq < seq + window)) {
+		if (!path_is_url(FEH_FILE(next_job->data)->filename)) {
+			w = NULL;
+			for (i = 0; i < worker_count; i++)
+				if ((workers[i].job_fd >= 0)
+						&& (workers[i].queued < THUMBWORK_QUEUE)
+						&& (!w || (workers[i].queued < w->queued)))
+					w = &workers[i];
+			if (!w)
+				return;
+			if (!feh_io_all(w->job_fd, &next_seq, sizeof(int), -1, 0)) {
+				feh_thumbwork_lost(w);
+				continue;
+			}
+			w->jobs[w->queued++] = next_seq;
+			results[next_seq % window].state = THUMBWORK_QUEUED;
+		}
+		next_job = next_job->next;
+		next_seq++;
+	}
+}
+
+/*
+ * Waits until a worker sent something and reads it. Returns 0 if no worker
+ * has anything left to send.
+ */
+static int feh_thumbwork_wait(void)
+{
+	fd_set fdset;
+	int fdsize = 0;
+	int i;
+
+	FD_ZERO(&fdset);
+	for (i = 0; i < worker_count; i++) {
+		if ((workers[i].fd < 0) || !workers[i].queued)
+			continue;
+		FD_SET(workers[i].fd, &fdset);
+		if (workers[i].fd >= fdsize)
+			fdsize = workers[i].fd + 1;
+	}
+	if (!fdsize)
+		return(0);
+
+	if (select(fdsize, &fdset, NULL, NULL, NULL) < 0)
+		return(errno == EINTR);
+
+	for (i = 0; i < worker_count; i++)
+		if ((workers[i].fd >= 0) && FD_ISSET(workers[i].fd, &fdset))
+			feh_thumbwork_read(&workers[i]);
+	return(1);
+}
+
+/*
+ * Hands over the scaled thumbnail of the seq-th file, which must be taken
+ * in order. Returns 1 on success and 0 if the file could not be loaded. If
+ * the workers did not handle it, -1 is returned and the caller has to use
+ * feh_thumbnail_get_scaled itself.
+ */
+int feh_thumbwork_take(int seq, Imlib_Image * im, int *w, int *h)
+{
+	feh_thumbwork_result *result;
+
+	if (!worker_count)
+		return(-1);
+
+	result = &results[seq % window];
+	do
+		feh_thumbwork_fill(seq);
+	while (((seq >= next_seq) || (result->state == THUMBWORK_QUEUED))
+			&& feh_thumbwork_wait());
+
+	if ((seq >= next_seq) || (result->state == THUMBWORK_NONE)
+			|| (result->state == THUMBWORK_QUEUED))
+		return(-1);
+
+	if (result->state == THUMBWORK_FAILED) {
+		result->state = THUMBWORK_NONE;
+		return(0);
+	}
+
+	*im = result->im;
+	*w = result->header.width;
+	*h = result->header.height;
+	result->im = NULL;
+	result->state = THUMBWORK_NONE;
+	return(1);
+}
+
+/*
+ * Stops the workers. A worker still busy with a file finishes it first,
+ * so it does not leave a half-written cache entry behind. Its result then
+ * fails to go through the closed pipe, and it exits without taking further
+ * jobs. The atlas entries of all workers are handed to
+ * feh_thumbatlas_collect, so that feh_thumbatlas_save writes them at once.
+ */
+void feh_thumbwork_stop(void)
+{
+	int i;
+
+	for (i = 0; i < worker_count; i++) {
+		if (workers[i].job_fd >= 0) {
+			feh_thumbwork_drop_image(&workers[i]);
+			close(workers[i].job_fd);
+			close(workers[i].fd);
+			waitpid(workers[i].pid, NULL, 0);
+		}
+		feh_thumbatlas_collect(workers[i].spool_fd);
+	}
+	for (i = 0; i < window; i++)
+		if (results[i].im)
+			gib_imlib_free_image_and_decache(results[i].im);
+
+	free(workers);
+	free(results);
+	workers = NULL;
+	results = NULL;
+	worker_count = window = 0;
+	next_job = NULL;
+}
@@ -0,0 +1,49 @@
+/* thumbwork.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef THUMBWORK_H
+#define THUMBWORK_H
+
+/*
+ * Thumbnail mode decodes and scales its images in forked worker processes
+ * (Imlib2 is not thread-safe). Jobs are positions in the filelist as it was
+ * when the workers started; for each one, a worker sends a
+ * feh_thumbwork_header followed by width * height ARGB pixels.
+ */
+struct __feh_thumbwork_header {
+	int seq;
+	int ok;
+	int width;
+	int height;
+	int has_alpha;
+};
+
+typedef struct __feh_thumbwork_header feh_thumbwork_header;
+
+int feh_thumbwork_start(void);
+int feh_thumbwork_take(int seq, Imlib_Image * im, int *w, int *h);
+void feh_thumbwork_stop(void);
+
+#endif
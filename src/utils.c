@@ -227,3 +227,179 @@ char *shell_escape(char *input)
 
 	return ret;
 }
+
+/*
+ * Returns $XDG_CACHE_HOME/feh/subdir (or ~/.cache/feh/subdir) and creates it
+ * if necessary. Returns NULL if neither variable is usable or the directory
+ * cannot be created. free the result please.
+ */
+char *feh_cache_dir(char *subdir)
+{
+	char *dir = NULL, *home, *xdg_cache_home, *p;
+	struct stat st;
+
+	xdg_cache_home = getenv("XDG_CACHE_HOME");
+	if (xdg_cache_home && xdg_cache_home[0] == '/') {
+		dir = estrjoin("/", xdg_cache_home, "feh", subdir, NULL);
+	} else {
+		home = getenv("HOME");
+		if (home && home[0] == '/')
+			dir = estrjoin("/", home, ".cache/feh", subdir, NULL);
+	}
+
+	if (!dir || !stat(dir, &st))
+		return dir;
+
+	for (p = dir + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (stat(dir, &st) && (mkdir(dir, 0700) == -1) && (errno != EEXIST)) {
+			*p = '/';
+			break;
+		}
+		*p = '/';
+	}
+
+	if (*p || ((mkdir(dir, 0700) == -1) && (errno != EEXIST))) {
+		weprintf("unable to create directory %s:", dir);
+		free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+unsigned int feh_get16(const unsigned char *p, int big_endian)
+{
+	return big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+unsigned int feh_get32(const unsigned char *p, int big_endian)
+{
+	return big_endian
+		? ((unsigned int) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+		: ((unsigned int) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+/*
+ * Returns the orientation tag from IFD0 of the len bytes of an EXIF APP1
+ * marker at data, or 0 if there is none. Only IFD0 is looked at, so this
+ * does not need libexif.
+ */
+int feh_exif_ifd0_orientation(const unsigned char *data, unsigned int len)
+{
+	const unsigned char *tiff, *entry;
+	unsigned int ifd, count, i, orientation;
+	int big_endian;
+
+	if ((len < 14) || memcmp(data, "Exif\0\0", 6))
+		return 0;
+
+	tiff = data + 6;
+	len -= 6;
+	if (!memcmp(tiff, "MM", 2))
+		big_endian = 1;
+	else if (!memcmp(tiff, "II", 2))
+		big_endian = 0;
+	else
+		return 0;
+
+	ifd = feh_get32(tiff + 4, big_endian);
+	if (ifd > len - 2)
+		return 0;
+	count = feh_get16(tiff + ifd, big_endian);
+
+	for (i = 0; (i < count) && ((ifd + 2 + 12 * (i + 1)) <= len); i++) {
+		entry = tiff + ifd + 2 + 12 * i;
+		if (feh_get16(entry, big_endian) == 0x0112) {
+			orientation = feh_get16(entry + 8, big_endian);
+			return (orientation <= 8) ? orientation : 0;
+		}
+	}
+	return 0;
+}
+
+/* FNV-1a of the len bytes at data */
+uint32_t feh_hash32(const char *data, size_t len)
+{
+	uint32_t hash = 0x811c9dc5;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+/* 64 bit FNV-1a of the string str */
+uint64_t feh_hash64(const char *str)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (; *str; str++) {
+		hash ^= (unsigned char) *str;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static char full_path_cwd[PATH_MAX];
+
+/*
+ * Looks up the working directory for feh_full_path. Must be called before
+ * any threads which use it are started.
+ */
+void feh_full_path_init(void)
+{
+	if (!full_path_cwd[0] && !getcwd(full_path_cwd, sizeof(full_path_cwd)))
+		full_path_cwd[0] = '\0';
+}
+
+/*
+ * Returns the absolute path of filename without leading "./" components,
+ * written to buf if filename is relative, or NULL if it does not fit or
+ * feh_full_path_init has not found the working directory. Only reads
+ * shared state, so it is safe to call from several threads.
+ */
+char *feh_full_path(char *filename, char *buf, size_t size)
+{
+	if (filename[0] == '/')
+		return filename;
+	while ((filename[0] == '.') && (filename[1] == '/'))
+		for (filename++; *filename == '/'; filename++);
+	if (!full_path_cwd[0]
+			|| (snprintf(buf, size, "%s/%s", full_path_cwd, filename) >= (int) size))
+		return NULL;
+	return buf;
+}
+
+/*
+ * Reads (with reading set) or writes all of the len bytes at buf, at offset
+ * or, if offset is -1, at the current position of fd. Interrupted calls are
+ * retried. Returns 0 on errors and at the end of the file.
+ */
+int feh_io_all(int fd, void *buf, size_t len, off_t offset, int reading)
+{
+	char *p = buf;
+	ssize_t ret;
+
+	while (len > 0) {
+		if (offset < 0)
+			ret = reading ? read(fd, p, len) : write(fd, p, len);
+		else
+			ret = reading ? pread(fd, p, len, offset) : pwrite(fd, p, len, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		} else if (ret == 0)
+			return 0;
+		p += ret;
+		len -= ret;
+		if (offset >= 0)
+			offset += ret;
+	}
+	return 1;
+}
@@ -32,6 +32,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #ifndef __GNUC__
 # define __attribute__(x)
@@ -47,6 +49,15 @@ char path_is_url(char *path);
 char *feh_unique_filename(char *path, char *basename);
 char *ereadfile(char *path);
 char *shell_escape(char *input);
+char *feh_cache_dir(char *subdir);
+unsigned int feh_get16(const unsigned char *p, int big_endian);
+unsigned int feh_get32(const unsigned char *p, int big_endian);
+int feh_exif_ifd0_orientation(const unsigned char *data, unsigned int len);
+uint32_t feh_hash32(const char *data, size_t len);
+uint64_t feh_hash64(const char *str);
+void feh_full_path_init(void);
+char *feh_full_path(char *filename, char *buf, size_t size);
+int feh_io_all(int fd, void *buf, size_t len, off_t offset, int reading);
 
 #define ESTRAPPEND(a,b) \
   {\
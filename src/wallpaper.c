@@ -69,14 +69,21 @@ void feh_wm_set_bg_filelist(unsigned char bgmode)
 	}
 }
 
-static void feh_wm_load_next(Imlib_Image *im)
+/*
+ * Loads the next image of the filelist. If w and h are nonzero, the image
+ * will be scaled to w x h (or less) anyway, so it need not be decoded at
+ * full size.
+ */
+static void feh_wm_load_next(Imlib_Image *im, int w, int h)
 {
 	static gib_list *wpfile = NULL;
+	int orig_w, orig_h;
 
 	if (wpfile == NULL)
 		wpfile = filelist;
 
-	if (feh_load_image(im, FEH_FILE(wpfile->data)) == 0)
+	if (feh_load_image_at_least(im, FEH_FILE(wpfile->data), w, h,
+				&orig_w, &orig_h) == 0)
 		eprintf("Unable to load image %s", FEH_FILE(wpfile->data)->filename);
 	if (wpfile->next)
 		wpfile = wpfile->next;
@@ -88,7 +95,7 @@ static void feh_wm_set_bg_scaled(Pixmap pmap, Imlib_Image im, int use_filelist,
 		int x, int y, int w, int h)
 {
 	if (use_filelist)
-		feh_wm_load_next(&im);
+		feh_wm_load_next(&im, w, h);
 
 	gib_imlib_render_image_on_drawable_at_size(pmap, im, x, y, w, h,
 			1, 1, !opt.force_aliasing);
@@ -105,7 +112,7 @@ static void feh_wm_set_bg_centered(Pixmap pmap, Imlib_Image im, int use_filelist
 	int offset_x, offset_y;
 
 	if (use_filelist)
-		feh_wm_load_next(&im);
+		feh_wm_load_next(&im, 0, 0);
 
 	if(opt.geom_flags & XValue)
 		if(opt.geom_flags & XNegative)
@@ -147,7 +154,7 @@ static void feh_wm_set_bg_filled(Pixmap pmap, Imlib_Image im, int use_filelist,
 	int render_w, render_h, render_x, render_y;
 
 	if (use_filelist)
-		feh_wm_load_next(&im);
+		feh_wm_load_next(&im, w, h);
 
 	img_w = gib_imlib_image_get_width(im);
 	img_h = gib_imlib_image_get_height(im);
@@ -205,7 +212,7 @@ static void feh_wm_set_bg_maxed(Pixmap pmap, Imlib_Image im, int use_filelist,
 	int margin_x, margin_y;
 
 	if (use_filelist)
-		feh_wm_load_next(&im);
+		feh_wm_load_next(&im, w, h);
 
 	img_w = gib_imlib_image_get_width(im);
 	img_h = gib_imlib_image_get_height(im);
@@ -379,7 +386,7 @@ void feh_wm_set_bg(char *fil, Imlib_Image im, int centered, int scaled,
 
 	if (feh_wm_get_wm_is_e() && (enl_ipc_get_win() != None)) {
 		if (use_filelist) {
-			feh_wm_load_next(&im);
+			feh_wm_load_next(&im, 0, 0);
 			fil = FEH_FILE(filelist->data)->filename;
 		}
 		if ((size_t) snprintf(sendbuf, sizeof(sendbuf), "background %s bg.file %s", bgname, fil) >= sizeof(sendbuf)) {
@@ -542,7 +549,7 @@ void feh_wm_set_bg(char *fil, Imlib_Image im, int centered, int scaled,
 
 		} else {
 			if (use_filelist)
-				feh_wm_load_next(&im);
+				feh_wm_load_next(&im, 0, 0);
 			w = gib_imlib_image_get_width(im);
 			h = gib_imlib_image_get_height(im);
 			pmap_d1 = XCreatePixmap(disp, root, w, h, depth);
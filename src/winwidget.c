@@ -30,6 +30,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "options.h"
 #include "events.h"
 #include "timers.h"
+#include "prefetch.h"
+#include "http.h"
+#include "thumbnail.h"
 
 #ifdef HAVE_INOTIFY
 #include <sys/inotify.h>
@@ -121,6 +124,7 @@ winwidget winwidget_create_from_file(gib_list * list, char type)
 {
 	winwidget ret = NULL;
 	feh_file *file = FEH_FILE(list->data);
+	int res;
 
 	if (!file || !file->filename)
 		return(NULL);
@@ -129,7 +133,8 @@ winwidget winwidget_create_from_file(gib_list * list, char type)
 	ret->file = list;
 	ret->type = type;
 
-	if ((winwidget_loadimage(ret, file) == 0) || feh_should_ignore_image(ret->im)) {
+	if ((res = winwidget_loadimage(ret, file)) == 0
+			|| ((res > 0) && feh_should_ignore_image(ret->im))) {
 		winwidget_destroy(ret);
 		return(NULL);
 	}
@@ -561,6 +566,10 @@ void winwidget_render_image(winwidget winwid, int resize, int force_alias)
 	sw = lround(dw / winwid->zoom);
 	sh = lround(dh / winwid->zoom);
 
+	/* a virtual thumbnail grid only keeps the part around the view */
+	if ((winwid->type == WIN_TYPE_THUMBNAIL) && feh_thumbnail_is_virtual())
+		feh_thumbnail_prepare_view(winwid, &sx, &sy, sw, sh);
+
 	D(("sx: %d sy: %d sw: %d sh: %d dx: %d dy: %d dw: %d dh: %d zoom: %f\n",
 	   sx, sy, sw, sh, dx, dy, dw, dh, winwid->zoom));
 
@@ -678,7 +687,7 @@ Pixmap feh_create_checks(void)
 	return(checks_pmap);
 }
 
-void feh_draw_checks(winwidget win)
+static void feh_draw_checks_area(winwidget win, int x, int y, int w, int h)
 {
 	static GC gc = None;
 	XGCValues gcval;
@@ -688,10 +697,65 @@ void feh_draw_checks(winwidget win)
 		gcval.fill_style = FillTiled;
 		gc = XCreateGC(disp, win->win, GCTile | GCFillStyle, &gcval);
 	}
-	XFillRectangle(disp, win->bg_pmap, gc, 0, 0, win->w, win->h);
+	XFillRectangle(disp, win->bg_pmap, gc, x, y, w, h);
 	return;
 }
 
+void feh_draw_checks(winwidget win)
+{
+	feh_draw_checks_area(win, 0, 0, win->w, win->h);
+	return;
+}
+
+/*
+ * Renders the part sx, sy, w x h of im to where the part x, y, w x h of
+ * winwid->im is shown, and updates only that area of the window. im may be
+ * winwid->im itself, or an image holding a part of it with something drawn
+ * on top. Text drawn over the whole window, like --draw-filename, is not
+ * drawn again. Returns 0 if winwid must be rendered as a whole instead.
+ */
+int winwidget_render_image_part(winwidget winwid, Imlib_Image im, int sx,
+		int sy, int x, int y, int w, int h)
+{
+	int dx, dy;
+
+	if ((winwid->zoom != 1.0) || winwid->has_rotated || !winwid->bg_pmap
+			|| winwid->had_resize)
+		return(0);
+
+	/* clip the part to the window */
+	dx = winwid->im_x + x;
+	dy = winwid->im_y + y;
+	if (dx < 0) {
+		sx -= dx;
+		w += dx;
+		dx = 0;
+	}
+	if (dy < 0) {
+		sy -= dy;
+		h += dy;
+		dy = 0;
+	}
+	if (dx + w > winwid->w)
+		w = winwid->w - dx;
+	if (dy + h > winwid->h)
+		h = winwid->h - dy;
+	if ((w <= 0) || (h <= 0))
+		return(1);
+
+	D(("sx: %d sy: %d dx: %d dy: %d w: %d h: %d\n", sx, sy, dx, dy, w, h));
+
+	if (winwid->full_screen)
+		XFillRectangle(disp, winwid->bg_pmap, winwid->gc, dx, dy, w, h);
+	else if (gib_imlib_image_has_alpha(im))
+		feh_draw_checks_area(winwid, dx, dy, w, h);
+
+	gib_imlib_render_image_part_on_drawable_at_size(winwid->bg_pmap, im,
+			sx, sy, w, h, dx, dy, w, h, 1, gib_imlib_image_has_alpha(im), 0);
+	XClearArea(disp, winwid->win, dx, dy, w, h, False);
+	return(1);
+}
+
 void winwidget_destroy_xwin(winwidget winwid)
 {
 	if (winwid->win) {
@@ -718,7 +782,9 @@ void winwidget_destroy(winwidget winwid)
 		free(winwid->name);
 	if (winwid->gc)
 		XFreeGC(disp, winwid->gc);
-	if (winwid->im)
+	if (winwid->im && winwid->im_key.file)
+		feh_image_cache_put(winwid->im, &winwid->im_key);
+	else if (winwid->im)
 		gib_imlib_free_image_and_decache(winwid->im);
 	free(winwid);
 	return;
@@ -826,13 +892,37 @@ winwidget winwidget_get_first_window_of_type(unsigned int type)
 
 int winwidget_loadimage(winwidget winwid, feh_file * file)
 {
+	feh_image_key key;
+	int res;
+
 	D(("filename %s\n", file->filename));
 #ifdef HAVE_INOTIFY
     winwidget_inotify_remove(winwid);
 #endif
-    int res = feh_load_image(&(winwid->im), file);
+	winwid->converting = 0;
+	winwid->downloading = 0;
+	feh_image_key_init(&key, file);
+	if (feh_image_cache_get(&(winwid->im), &key)
+			|| feh_prefetch_take(&(winwid->im), file, &key))
+		res = 1;
+	else if (winwid->type == WIN_TYPE_SLIDESHOW)
+		res = feh_load_image_nowait(&(winwid->im), file, 1);
+	else
+		res = feh_load_image(&(winwid->im), file);
+
+	if (res < 0) {
+		/* slideshow_loaded takes over once the download or conversion is done */
+		winwid->im = feh_load_placeholder(file,
+				winwid->win ? winwid->w : 0, winwid->win ? winwid->h : 0);
+		if (path_is_url(file->filename) && feh_http_pending(file->filename))
+			winwid->downloading = 1;
+		else
+			winwid->converting = 1;
+		memset(&key, 0, sizeof(feh_image_key));
+	}
+	winwid->im_key = key;
 #ifdef HAVE_INOTIFY
-    if (res) {
+    if (res > 0) {
         winwidget_inotify_add(winwid, file);
     }
 #endif
@@ -1051,8 +1141,9 @@ void winwidget_rename(winwidget winwid, char *newname)
 void winwidget_free_image(winwidget w)
 {
 	if (w->im) {
-		gib_imlib_free_image(w->im);
+		feh_image_cache_put(w->im, &w->im_key);
 	}
+	memset(&w->im_key, 0, sizeof(feh_image_key));
 	w->im = NULL;
 	w->im_w = 0;
 	w->im_h = 0;
@@ -33,6 +33,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 # include <X11/Xproto.h>
 
 # include "transitions.h"  /* Include transitions.h for enum transition_type */
+# include "imagecache.h"
 
 /* Motif window hints */
 #define MWM_HINTS_FUNCTIONS     (1L << 0)
@@ -88,6 +89,8 @@ struct __winwidget {
 	enum win_type type;
 	unsigned char had_resize, full_screen;
 	Imlib_Image im;
+	/* where im was loaded from, used to check it into the image cache */
+	feh_image_key im_key;
 	GC gc;
 	Pixmap bg_pmap;
 	Pixmap bg_pmap_cache;
@@ -119,6 +122,11 @@ struct __winwidget {
 
 	unsigned char has_rotated;
 
+	/* im is a placeholder until the background conversion of file is done */
+	unsigned char converting;
+	/* im is a placeholder or partial image until file is downloaded */
+	unsigned char downloading;
+
 	/* transition state for slideshow effects */
 	unsigned char in_transition;
 	enum transition_type transition_type;
@@ -143,6 +151,8 @@ void winwidget_destroy_all(void);
 void winwidget_free_image(winwidget w);
 void winwidget_center_image(winwidget w);
 void winwidget_render_image(winwidget winwid, int resize, int force_alias);
+int winwidget_render_image_part(winwidget winwid, Imlib_Image im, int sx,
+		int sy, int x, int y, int w, int h);
 void winwidget_rotate_image(winwidget winid, double angle);
 void winwidget_move(winwidget winwid, int x, int y);
 void winwidget_resize(winwidget winwid, int w, int h, int force_resize);
@@ -2,7 +2,7 @@
 use strict;
 use warnings;
 use 5.010;
-use Test::Command tests => 73;
+use Test::Command tests => 94;
 
 $ENV{HOME} = 'test';
 
@@ -121,6 +121,21 @@ $cmd->exit_is_num(0);
 $cmd->stdout_is_file("test/${list_dir}/format_reverse");
 $cmd->stderr_like($re_warning);
 
+# all of test/ok/* are 16x16, so these compare equal
+$cmd = Test::Command->new( cmd =>
+	  "$feh --customlist %f --sort width test/ok/pnm test/ok/gif test/ok/png" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/pnm\ntest/ok/gif\ntest/ok/png\n");
+$cmd->stderr_is_eq('');
+
+$cmd = Test::Command->new( cmd => "$feh --customlist %f --sort pixels "
+	  . "--reverse test/ok/pnm test/ok/gif test/ok/png" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/png\ntest/ok/gif\ntest/ok/pnm\n");
+$cmd->stderr_is_eq('');
+
 $cmd = Test::Command->new(
 	cmd => "$feh --list --recursive --sort filename test/ok" );
 
@@ -190,6 +205,46 @@ $cmd->exit_is_num(0);
 $cmd->stdout_is_file("test/${list_dir}/default");
 $cmd->stderr_is_eq('');
 
+# sizes read from the file headers
+$cmd = Test::Command->new(
+	cmd => "$feh --customlist '%f %wx%h' --min-dimension 16x16 $images_ok" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq( "test/ok/gif 16x16\ntest/ok/jpg 16x16\n"
+	  . "test/ok/png 16x16\ntest/ok/pnm 16x16\n" );
+$cmd->stderr_is_eq('');
+
+# an intact header does not save damaged image data from --preload
+$cmd = Test::Command->new(
+	cmd => "$feh --customlist %f --preload test/ok/png test/fail/png_data" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/png\n");
+$cmd->stderr_like(qr{test/fail/png_data});
+
+# a regular file is mapped, empty lines and a missing final newline are fine
+$cmd = Test::Command->new( cmd =>
+	  "$feh --customlist %f --filelist - < test/filelist/no-final-newline" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/gif\ntest/ok/png\ntest/ok/jpg\n");
+$cmd->stderr_is_eq('');
+
+# a pipe is read in chunks
+$cmd = Test::Command->new( cmd =>
+	  "cat test/filelist/no-final-newline | $feh --customlist %f --filelist -" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/gif\ntest/ok/png\ntest/ok/jpg\n");
+$cmd->stderr_is_eq('');
+
+$cmd = Test::Command->new(
+	cmd => "$feh --prefetch -1 --customlist %f test/ok/png" );
+
+$cmd->exit_is_num(0);
+$cmd->stdout_is_eq("test/ok/png\n");
+$cmd->stderr_like(qr{--prefetch: expected AHEAD\[,BEHIND\]});
+
 $cmd = Test::Command->new( cmd => "$feh --list test/tiny.pbm" );
 $cmd->exit_is_num(0);
 $cmd->stderr_is_eq('');